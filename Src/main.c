@@ -35,6 +35,8 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define MODE_STATS_SWITCHES	1000	// DRAW/TOUCH round trips timed by ModeStats_Run()
+#define LOOKUP_BENCH_RUNS	10		// frames timed by LookupBench_Run(), the fastest one counts
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -56,6 +58,62 @@ void SystemClock_Config(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+#if defined (USE_MODE_STATS)
+// Times LCD_SetMode() back and forth and prints the cycle counts
+static void ModeStats_Run(void) {
+	LCD_ModeStats stats;
+
+	LCD_ResetModeStats();
+	for (uint32_t i = 0; i < MODE_STATS_SWITCHES; i++) {
+		LCD_SetMode(LCD_MODE_DRAW);
+		LCD_SetMode(LCD_MODE_TOUCH);
+	}
+	LCD_GetModeStats(&stats);
+
+	LCD_SetMode(LCD_MODE_DRAW);
+	LCD_Printf("LCD_SetMode: %lu switches, cycles last %lu, max %lu, mean %lu\n",
+			stats.switches, stats.cycles_last, stats.cycles_max,
+			(uint32_t) (stats.cycles_total / stats.switches));
+	LCD_SetMode(LCD_MODE_TOUCH);
+}
+#endif
+
+#if defined (USE_LOOKUP_BENCH)
+// Times a one-color fill and a screen of text and prints the cycle counts,
+// the lookup table is in SRAM or in flash as USE_LOOKUP_RAM says
+static void LookupBench_Run(void) {
+	uint32_t start, cycles, fill = UINT32_MAX, text = UINT32_MAX;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	for (uint32_t i = 0; i < LOOKUP_BENCH_RUNS; i++) {
+		start = DWT->CYCCNT;
+		LCD_FillScreen(0x051F);
+		cycles = DWT->CYCCNT - start;
+		if (cycles < fill)
+			fill = cycles;
+
+		LCD_SetCursor(0, 0);
+		start = DWT->CYCCNT;
+		for (uint16_t y = 0; y < TFTHEIGHT / 12; y++)  // Font12, portrait
+			LCD_Printf("The quick brown fox 0123456789\n");
+		cycles = DWT->CYCCNT - start;
+		if (cycles < text)
+			text = cycles;
+	}
+
+	LCD_FillScreen(BLACK);
+	LCD_SetCursor(0, 0);
+#if defined (USE_LOOKUP_RAM)
+	LCD_Printf("Lookup table in SRAM\n");
+#else
+	LCD_Printf("Lookup table in flash\n");
+#endif
+	LCD_Printf("FillScreen: %lu cycles, %lu.%lu FPS\n", fill, SystemCoreClock / fill,
+			SystemCoreClock * 10 / fill % 10);
+	LCD_Printf("Text: %lu cycles per screen\n", text);
+}
+#endif
 
 /* USER CODE END 0 */
 
@@ -96,9 +154,15 @@ int main(void)
 	LCD_SetTextSize(1);  // Font12
 	LCD_SetTextScaled(0);  // don't scale the text size by 2
 	LCD_SetTextColor(GREEN, BLACK);
+#if defined (USE_LOOKUP_BENCH)
+	LookupBench_Run();
+#endif
 
 	LCD_Touch_Init(&hadc2, ADC_CHANNEL_4, &hadc1, ADC_CHANNEL_1);
 	LCD_SetMode(LCD_MODE_TOUCH);
+#if defined (USE_MODE_STATS)
+	ModeStats_Run();
+#endif
 	LCD_TouchPoint p;
   /* USER CODE END 2 */
 
@@ -215,5 +215,31 @@ void EXTI4_IRQHandler(void) {
 	HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_4);
 }
 
+#if defined (USE_DMA)
+/* Called upon each LCD DMA chunk completion */
+void DMA2_Stream7_IRQHandler(void) {
+	LCD_DMA_IRQHandler();
+}
+#endif
+
+#if defined (USE_WR_TIMER)
+/* Called upon LCD timer flood completion */
+void TIM2_IRQHandler(void) {
+	LCD_FloodStrobe_IRQHandler();
+}
+#endif
+
+#if defined (USE_TOUCH_ASYNC)
+/* Called upon touch settling and sample period timeouts */
+void TIM7_IRQHandler(void) {
+	LCD_Touch_TIM_IRQHandler();
+}
+
+/* Called upon touch ADC conversions */
+void ADC_IRQHandler(void) {
+	LCD_Touch_ADC_IRQHandler();
+}
+#endif
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -61,6 +61,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "Fonts/fonts.h"
 #include "stm32f4xx_hal.h"
 #include <string.h>
+#if defined (USE_DIRTY_RECTS)
+#include "lcd_dirty.h"
+#endif
+#if defined (USE_TOUCH_ARBITER)
+#include "lcd_touch.h"
+#endif
 
 #pragma GCC push_options
 #pragma GCC optimize("O2")
@@ -75,12 +81,101 @@ static uint16_t m_textbgcolor;
 static uint8_t m_font;
 static uint8_t m_rotation;
 static uint8_t m_wrap;
-static uint8_t m_scale;
+static uint8_t m_scale = 1;
+static uint8_t m_batch;
+
+// Hardware transfers own the bus until their completion interrupt
+#if defined (USE_DMA)
+static volatile uint8_t m_dma_busy;
+#endif
+#if defined (USE_WR_TIMER)
+static volatile uint8_t m_strobe_busy;
+#endif
+
+// While LCD_RenderBands() runs or a canvas is selected, pixels go to RAM instead of the bus
+#if defined (USE_BAND_RENDER) || defined (USE_CANVAS8) || defined (USE_DIRTY_RECTS)
+#define LCD_RAM_TARGET
+static void *m_ram;						// band strip (RGB565) or canvas (8bpp), NULL - bus
+static int16_t m_ram_y;					// first row held in RAM
+static int16_t m_ram_h;					// rows held in RAM
+static int16_t m_ram_wx1, m_ram_wy1;	// address window
+static int16_t m_ram_wx2, m_ram_wy2;
+static int16_t m_ram_cx, m_ram_cy;		// address counter
+#endif
+#if defined (USE_CANVAS8)
+static uint8_t *m_canvas;				// selected canvas, m_ram == m_canvas
+static const uint16_t *m_palette;
+static int16_t m_dirty_x1[TFTHEIGHT];	// dirty columns of each row, x1 > x2 - clean
+static int16_t m_dirty_x2[TFTHEIGHT];
+#endif
+#if defined (USE_DIRTY_RECTS)
+static uint8_t m_report;				// windows go to lcd_dirty, m_ram_h == 0 drops the pixels
+#endif
+
+// LCD_Printf() console scrolled by VSCRSADD, rows in the current (portrait) orientation
+#if defined (USE_SCROLL_CONSOLE)
+static uint16_t m_con_top;				// header rows
+static uint16_t m_con_rows;				// scrolling rows, a multiple of m_con_lh
+static uint16_t m_con_lh;				// line height
+static uint16_t m_con_lines;			// lines on screen, 0 - console off
+static uint16_t m_con_line;				// cursor line, 0 - top of the scrolling area
+static uint16_t m_con_offset;			// rows scrolled, a multiple of m_con_lh
+#define LCD_CONSOLE_ON			(m_con_lines != 0)
+#else
+#define LCD_CONSOLE_ON			0
+#endif
+
+// Controllers with CASET/PASET style window registers: every drawing
+// function sets its own window, so the current window is shadowed and
+// unchanged register writes are skipped
+#if defined(ILI9340) || defined(ILI9340_INV) || defined(ILI9341) || defined(ILI9341_00) \
+		|| defined(ILI9486) || defined(R61520) || defined(UNKNOWN1602) || defined(HX8357D)
+#define LCD_ADDR_WINDOW_CACHE
+static uint32_t m_win_col = 0xFFFFFFFF;
+static uint32_t m_win_page = 0xFFFFFFFF;
+#endif
+
+#if defined (USE_BUS_STATS)
+static LCD_BusStats m_stats;
+#define LCD_STATS_INC(__field)	(m_stats.__field++)
+#else
+#define LCD_STATS_INC(__field)	((void) 0)
+#endif
 
 #if defined (USE_LOOKUP)
-static uint32_t lookup_gpioa[256] = { 0 };
-static uint32_t lookup_gpiob[256] = { 0 };
-static uint32_t lookup_gpioc[256] = { 0 };
+// BSRR words for every data byte, generated at compile time
+// ------ PORT -----     --- Data ----
+// GPIOA, GPIO_PIN_9  -> BIT 0 -> 0x01
+// GPIOC, GPIO_PIN_7  -> BIT 1 -> 0x02
+// GPIOA, GPIO_PIN_10 -> BIT 2 -> 0x04
+// GPIOB, GPIO_PIN_3  -> BIT 3 -> 0x08
+// GPIOB, GPIO_PIN_5  -> BIT 4 -> 0x10
+// GPIOB, GPIO_PIN_4  -> BIT 5 -> 0x20
+// GPIOB, GPIO_PIN_10 -> BIT 6 -> 0x40
+// GPIOA, GPIO_PIN_8  -> BIT 7 -> 0x80
+#define LOOKUP_GPIOA(d)		((((d) & 0x01) ? GPIO_PIN_9  : (GPIO_PIN_9  << 16)) |	\
+							 (((d) & 0x04) ? GPIO_PIN_10 : (GPIO_PIN_10 << 16)) |	\
+							 (((d) & 0x80) ? GPIO_PIN_8  : (GPIO_PIN_8  << 16)))
+#define LOOKUP_GPIOB(d)		((((d) & 0x08) ? GPIO_PIN_3  : (GPIO_PIN_3  << 16)) |	\
+							 (((d) & 0x10) ? GPIO_PIN_5  : (GPIO_PIN_5  << 16)) |	\
+							 (((d) & 0x20) ? GPIO_PIN_4  : (GPIO_PIN_4  << 16)) |	\
+							 (((d) & 0x40) ? GPIO_PIN_10 : (GPIO_PIN_10 << 16)))
+#define LOOKUP_GPIOC(d)		 (((d) & 0x02) ? GPIO_PIN_7  : (GPIO_PIN_7  << 16))
+#define LOOKUP_4(f, n)		f(n), f((n) + 1), f((n) + 2), f((n) + 3)
+#define LOOKUP_16(f, n)		LOOKUP_4(f, n), LOOKUP_4(f, (n) + 4), LOOKUP_4(f, (n) + 8), LOOKUP_4(f, (n) + 12)
+#define LOOKUP_64(f, n)		LOOKUP_16(f, n), LOOKUP_16(f, (n) + 16), LOOKUP_16(f, (n) + 32), LOOKUP_16(f, (n) + 48)
+#define LOOKUP_256(f)		LOOKUP_64(f, 0), LOOKUP_64(f, 64), LOOKUP_64(f, 128), LOOKUP_64(f, 192)
+
+// const tables stay in flash, behind the ART accelerator;
+// USE_LOOKUP_RAM lets the startup code copy them to SRAM instead
+#if defined (USE_LOOKUP_RAM)
+#define LOOKUP_CONST
+#else
+#define LOOKUP_CONST		const
+#endif
+static LOOKUP_CONST uint32_t lookup_gpioa[256] = { LOOKUP_256(LOOKUP_GPIOA) };
+static LOOKUP_CONST uint32_t lookup_gpiob[256] = { LOOKUP_256(LOOKUP_GPIOB) };
+static LOOKUP_CONST uint32_t lookup_gpioc[256] = { LOOKUP_256(LOOKUP_GPIOC) };
 #endif
 
 static font_t * fonts[] = {
@@ -102,6 +197,19 @@ static font_t * fonts[] = {
 					};
 const static uint8_t fontsNum = sizeof(fonts) / sizeof(fonts[0]);
 
+/**
+ *  \brief Triangle edge stepper: x = x0 + k * dx / dy (truncated) for k = 0, 1, ...
+ *
+ */
+typedef struct {
+	int16_t x;			// current crossing
+	int32_t q;			// dx / dy
+	int32_t r;			// dx % dy, same sign as dx
+	int32_t rem;		// accumulated remainder, same sign as dx
+	int32_t dy;
+} LCD_EdgeStep;
+
+static inline void LCD_SetBus8(uint8_t data);
 static inline void LCD_Write8(uint8_t data);
 static inline uint8_t LCD_Read8(void);
 static inline void LCD_Write8Register8(uint8_t a, uint8_t d);
@@ -111,11 +219,34 @@ static inline void LCD_Write32Register8(uint8_t a, uint32_t d);
 static inline void LCD_Write16Register16(uint16_t a, uint16_t d);
 static inline void LCD_Write16RegisterPair8(uint8_t aH, uint8_t aL, uint16_t d);
 static inline uint8_t LCD_Read8Register8(uint8_t a, uint8_t dummy);
+static inline void LCD_MemoryWriteStart(void);
+static inline void LCD_WriteColor(uint16_t color);
+static inline void LCD_ResetAddrWindow(void);
+static inline void LCD_FloodRepeat(uint16_t color, uint32_t len);
+#if defined (LCD_RAM_TARGET)
+static inline void LCD_RamSpan(int16_t x, int16_t y, uint16_t n, uint16_t color);
+static inline void LCD_RamPut(uint16_t color);
+static void LCD_RamFlood(uint16_t color, uint32_t len);
+#endif
 static inline uint32_t LCD_Color565_to_888(uint16_t color);
 static inline uint8_t LCD_Color565_to_R(uint16_t color);
 static inline uint8_t LCD_Color565_to_G(uint16_t color);
 static inline uint8_t LCD_Color565_to_B(uint16_t color);
 static void LCD_GPIO_Init(uint32_t mode);
+static void LCD_FillRoundSpans(int16_t xl, int16_t xr, int16_t y0, int16_t r, int16_t delta, uint16_t color);
+static inline void LCD_FillSpan(int16_t x1, int16_t x2, int16_t y, uint16_t color);
+static inline void LCD_EdgeInit(LCD_EdgeStep *e, int16_t x0, int32_t dx, int32_t dy, int32_t k);
+static inline void LCD_EdgeNext(LCD_EdgeStep *e);
+static void LCD_NewLine(uint16_t height);
+#if defined (USE_SCROLL_CONSOLE)
+static void LCD_ScrollConsoleStart(void);
+#endif
+#if defined (USE_DMA)
+static void LCD_DMA_Init(void);
+#endif
+#if defined (USE_WR_TIMER)
+static void LCD_WR_Timer_Init(void);
+#endif
 #if defined(HX8347D) || defined(HX8347G)
 static void LCD_SetLR(void);
 #endif
@@ -743,6 +874,12 @@ static const uint16_t SSD1297_regValues[] = {
 								b = t;\
 							} while(0)
 
+/**
+ *  \brief Largest radius filled with horizontal spans, the row widths live on the stack
+ *
+ */
+#define LCD_FILL_SPANS_MAX_R	(TFTHEIGHT / 2)
+
 
 /* =========================================================================== */
 /* =================== LOWLEVEL REGISTER ACCESS FUNCTIONS ==================== */
@@ -759,14 +896,29 @@ static const uint16_t SSD1297_regValues[] = {
 // GPIOC, GPIO_PIN_1  -> RST
 // GPIOA, GPIO_PIN_0  -> RD
 // GPIOA, GPIO_PIN_1  -> WR
+#if defined (USE_TOUCH_ARBITER)
+#define LCD_BUS_CLAIM()		LCD_Touch_Arbiter_Claim()
+#else
+#define LCD_BUS_CLAIM()		((void) 0)
+#endif
 #define LCD_CS_GPIO_PORT	GPIOB
 #define LCD_CS_PIN			GPIO_PIN_0
-#define LCD_CS_IDLE()		LCD_CS_GPIO_PORT->BSRR = LCD_CS_PIN						// CS_HIGH
-#define LCD_CS_ACTIVE()		LCD_CS_GPIO_PORT->BSRR = (uint32_t)LCD_CS_PIN << 16U	// CS_LOW
+#define LCD_CS_PIN_IDLE()	LCD_CS_GPIO_PORT->BSRR = LCD_CS_PIN						// CS_HIGH
+#define LCD_CS_PIN_ACTIVE()	do {																\
+								LCD_STATS_INC(cs_toggles);										\
+								LCD_CS_GPIO_PORT->BSRR = (uint32_t)LCD_CS_PIN << 16U;			\
+							} while(0)																// CS_LOW
+// CS is held active between LCD_BeginBatch() and LCD_EndBatch(),
+// every primitive claims the shared pins all the same
+#define LCD_CS_IDLE()		do { if (!m_batch) LCD_CS_PIN_IDLE(); } while(0)
+#define LCD_CS_ACTIVE()		do { LCD_BUS_CLAIM(); if (!m_batch) LCD_CS_PIN_ACTIVE(); } while(0)
 #define LCD_CD_GPIO_PORT	GPIOA
 #define LCD_CD_PIN			GPIO_PIN_4
 #define LCD_CD_DATA()		LCD_CD_GPIO_PORT->BSRR = LCD_CD_PIN						// CD_HIGH
-#define LCD_CD_COMMAND()	LCD_CD_GPIO_PORT->BSRR = (uint32_t)LCD_CD_PIN << 16U	// CD_LOW
+#define LCD_CD_COMMAND()	do {																\
+								LCD_STATS_INC(commands);										\
+								LCD_CD_GPIO_PORT->BSRR = (uint32_t)LCD_CD_PIN << 16U;			\
+							} while(0)																// CD_LOW
 #define LCD_RST_GPIO_PORT	GPIOC
 #define LCD_RST_PIN			GPIO_PIN_1
 #define LCD_RST_IDLE()		LCD_RST_GPIO_PORT->BSRR = LCD_RST_PIN					// RST_HIGH
@@ -815,7 +967,9 @@ static const uint16_t SSD1297_regValues[] = {
 #ifndef LCD_DELAY_CYCLES
 #define LCD_DELAY_CYCLES 3
 #endif
-#if LCD_DELAY_CYCLES > 1
+#if defined (LCD_DELAY)
+// supplied by the build, the host simulator in test/ has no delay loop
+#elif LCD_DELAY_CYCLES > 1
 #define LCD_DELAY(__value)										\
 	__asm__ __volatile__ (										\
 			"MOV R0,%[loops]\n"									\
@@ -843,6 +997,7 @@ static const uint16_t SSD1297_regValues[] = {
  *
  */
 #define LCD_WR_STROBE() 	do {								\
+								LCD_STATS_INC(wr_strobes);		\
 								LCD_WR_ACTIVE();				\
 								LCD_DELAY(LCD_DELAY_CYCLES);	\
 								LCD_WR_IDLE();					\
@@ -856,13 +1011,13 @@ static const uint16_t SSD1297_regValues[] = {
 							} while(0)
 
 /**
- * \brief Writes 8-Bit data
+ * \brief Puts 8-Bit data on the bus without strobing it
  *
  * \param data	8-Bit Data
  *
  * \return void
  */
-static inline void LCD_Write8(uint8_t data) {
+static inline void LCD_SetBus8(uint8_t data) {
 	// ------ PORT -----     --- Data ----
 	// GPIOA, GPIO_PIN_9  -> BIT 0 -> 0x01
 	// GPIOC, GPIO_PIN_7  -> BIT 1 -> 0x02
@@ -881,6 +1036,17 @@ static inline void LCD_Write8(uint8_t data) {
 	GPIOB->ODR = (GPIOB->ODR & 0xFBC7) | (data & 0x08) | ((data & 0x10) << 1) | ((data & 0x20) >> 1) | ((data & 0x40) << 4);
 	GPIOC->ODR = (GPIOC->ODR & 0xFF7F) | ((data & 0x02) << 6);
 #endif
+}
+
+/**
+ * \brief Writes 8-Bit data
+ *
+ * \param data	8-Bit Data
+ *
+ * \return void
+ */
+static inline void LCD_Write8(uint8_t data) {
+	LCD_SetBus8(data);
 	LCD_WR_STROBE();
 }
 
@@ -1026,6 +1192,136 @@ static inline uint8_t LCD_Read8Register8(uint8_t a, uint8_t dummy) {
 	return data;
 }
 
+/**
+ * \brief Issues the GRAM write command and leaves the bus ready for pixel data
+ *
+ * \param
+ *
+ * \return void
+ *
+ * \info CS is left active, call LCD_CS_IDLE() when the pixel data is sent
+ */
+static inline void LCD_MemoryWriteStart(void) {
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		m_ram_cx = m_ram_wx1;
+		m_ram_cy = m_ram_wy1;
+		return;
+	}
+#endif
+	LCD_CS_ACTIVE();
+	LCD_CD_COMMAND();
+#if	defined(ILI9325) || defined(ILI9328) || defined(R61505) || defined(R61505V) || defined(S6D0154) || defined(ST7781)
+	LCD_Write8(0x00); // High byte of GRAM register...
+	LCD_Write8(ILI932X_GRAM_WR); // Write data to GRAM
+#elif defined(ILI9340) || defined(ILI9340_INV) || defined(ILI9341) || defined(ILI9341_00) \
+		|| defined(ILI9486) || defined(R61520) || defined(UNKNOWN1602)
+	LCD_Write8(ILI9341_MEMORYWRITE); // Write data to GRAM
+#elif defined(HX8347D) || defined(HX8347G)
+	LCD_Write8(HX8347G_SRAM_WR); // Write data to GRAM
+#elif defined(HX8357D)
+	LCD_Write8(HX8357_RAMWR); // Write data to GRAM
+#elif defined(SSD1297)
+	LCD_Write8(SSD1297_RAMDATA_WRITE); // Write data to GRAM
+#endif
+	LCD_CD_DATA();
+}
+
+/**
+ * \brief Writes one pixel to GRAM after LCD_MemoryWriteStart()
+ *
+ * \param color	Color
+ *
+ * \return void
+ */
+static inline void LCD_WriteColor(uint16_t color) {
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		LCD_RamPut(color);
+		return;
+	}
+#endif
+#if defined(SSD1297)
+	LCD_Write8(LCD_Color565_to_R(color));
+	LCD_Write8(LCD_Color565_to_G(color));
+	LCD_Write8(LCD_Color565_to_B(color));
+#else
+	LCD_Write8(color >> 8);
+	LCD_Write8(color);
+#endif
+}
+
+#if defined (LCD_RAM_TARGET)
+/**
+ * \brief Writes n pixels of one color to a row of the RAM target
+ *
+ * \param x		The x-coordinate of the first pixel
+ * \param y		The y-coordinate, rows not held in RAM are skipped
+ * \param n		Number of pixels
+ * \param color	Color, a palette index on the canvas
+ *
+ * \return void
+ */
+static inline void LCD_RamSpan(int16_t x, int16_t y, uint16_t n, uint16_t color) {
+	int16_t r = y - m_ram_y;
+	if ((uint16_t) r >= (uint16_t) m_ram_h)
+		return;
+#if defined (USE_CANVAS8)
+	if (m_canvas) {
+		memset(m_canvas + r * m_width + x, (uint8_t) color, n);
+		if (x < m_dirty_x1[r])
+			m_dirty_x1[r] = x;
+		if (x + n - 1 > m_dirty_x2[r])
+			m_dirty_x2[r] = x + n - 1;
+		return;
+	}
+#endif
+	uint16_t *p = (uint16_t *) m_ram + r * m_width + x;
+	while (n--)
+		*p++ = color;
+}
+
+/**
+ * \brief Writes one pixel at the address counter of the RAM target, like GRAM does
+ *
+ * \param color	Color
+ *
+ * \return void
+ */
+static inline void LCD_RamPut(uint16_t color) {
+	LCD_RamSpan(m_ram_cx, m_ram_cy, 1, color);
+	if (++m_ram_cx > m_ram_wx2) {
+		m_ram_cx = m_ram_wx1;
+		if (++m_ram_cy > m_ram_wy2)
+			m_ram_cy = m_ram_wy1;
+	}
+}
+
+/**
+ * \brief Writes len pixels of one color at the address counter of the RAM target
+ *
+ * \param color	Color
+ * \param len	Number of pixels
+ *
+ * \return void
+ */
+static void LCD_RamFlood(uint16_t color, uint32_t len) {
+	while (len) {
+		uint32_t n = m_ram_wx2 - m_ram_cx + 1;
+		if (n > len)
+			n = len;
+		len -= n;
+		LCD_RamSpan(m_ram_cx, m_ram_cy, n, color);
+		m_ram_cx += n;
+		if (m_ram_cx > m_ram_wx2) {
+			m_ram_cx = m_ram_wx1;
+			if (++m_ram_cy > m_ram_wy2)
+				m_ram_cy = m_ram_wy1;
+		}
+	}
+}
+#endif
+
 
 /* =========================================================================== */
 /* ================= BASIC FUNCTIONS (HARDWARE DEPENDANT!) =================== */
@@ -1133,32 +1429,15 @@ void LCD_Init(void) {
 	m_font = 0;
 	m_textcolor = m_textbgcolor = 0xFFFF;
 	m_wrap = 1;
-
-#if defined (USE_LOOKUP)
-	// ------ PORT -----     --- Data ----
-	// GPIOA, GPIO_PIN_9  -> BIT 0 -> 0x01
-	// GPIOC, GPIO_PIN_7  -> BIT 1 -> 0x02
-	// GPIOA, GPIO_PIN_10 -> BIT 2 -> 0x04
-	// GPIOB, GPIO_PIN_3  -> BIT 3 -> 0x08
-	// GPIOB, GPIO_PIN_5  -> BIT 4 -> 0x10
-	// GPIOB, GPIO_PIN_4  -> BIT 5 -> 0x20
-	// GPIOB, GPIO_PIN_10 -> BIT 6 -> 0x40
-	// GPIOA, GPIO_PIN_8  -> BIT 7 -> 0x80
-	for (uint32_t data = 0; data < 256; data++) {
-		lookup_gpioa[data] =	((data & 0x01) ? GPIO_PIN_9  : (GPIO_PIN_9  << 16)) |
-								((data & 0x04) ? GPIO_PIN_10 : (GPIO_PIN_10 << 16)) |
-								((data & 0x80) ? GPIO_PIN_8  : (GPIO_PIN_8  << 16));
-
-		lookup_gpiob[data] =	((data & 0x08) ? GPIO_PIN_3  : (GPIO_PIN_3  << 16)) |
-								((data & 0x10) ? GPIO_PIN_5  : (GPIO_PIN_5  << 16)) |
-								((data & 0x20) ? GPIO_PIN_4  : (GPIO_PIN_4  << 16)) |
-								((data & 0x40) ? GPIO_PIN_10 : (GPIO_PIN_10 << 16));
-
-		lookup_gpioc[data] =	((data & 0x02) ? GPIO_PIN_7  : (GPIO_PIN_7  << 16));
-	}
-#endif
+	m_scale = 1;
 
 	LCD_GPIO_Init(GPIO_MODE_OUTPUT_PP);
+#if defined (USE_DMA)
+	LCD_DMA_Init();
+#endif
+#if defined (USE_WR_TIMER)
+	LCD_WR_Timer_Init();
+#endif
 
 	LCD_Reset();
 	HAL_Delay(50);
@@ -1406,6 +1685,14 @@ void LCD_DrawPixel(int16_t x, int16_t y, uint16_t color) {
 	// Clip
 	if ((x < 0) || (y < 0) || (x >= m_width) || (y >= m_height)) return;
 
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		LCD_SetAddrWindow(x, y, x, y);
+		LCD_RamPut(color);
+		return;
+	}
+#endif
+
 	LCD_CS_ACTIVE();
 
 #if	defined(ILI9325) || defined(ILI9328) || defined(R61505) || defined(R61505V) || defined(S6D0154) || defined(ST7781)
@@ -1465,6 +1752,60 @@ void LCD_DrawPixel(int16_t x, int16_t y, uint16_t color) {
 	LCD_CS_IDLE();
 }
 
+#if defined (USE_TOUCH_ARBITER)
+#if !(defined(ILI9340) || defined(ILI9340_INV) || defined(ILI9341) || defined(ILI9341_00) \
+		|| defined(ILI9486) || defined(UNKNOWN1602))
+#error Error in lcd.c: USE_TOUCH_ARBITER requires an ILI934x or ILI9486 command set
+#endif
+/**
+ * \brief Hands the pins shared with the touch panel over for a sample, if one is due
+ *
+ * \param resume	1 - a memory write is running, it goes on afterwards
+ * \param bus		Byte to put back on the bus, for loops that only strobe WR
+ *
+ * \return void
+ *
+ * \info CS is idle during the sample, so the LCD ignores the panel levels on WR and CD.
+ *       Write Memory Continue then picks the write up where it stopped.
+ */
+static void LCD_Yield(uint8_t resume, uint8_t bus) {
+	uint8_t cs;
+
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) return;
+#endif
+	if (!LCD_Touch_Arbiter_Due()) return;
+	cs = !(LCD_CS_GPIO_PORT->ODR & LCD_CS_PIN);
+	LCD_CS_PIN_IDLE();
+	LCD_Touch_Arbiter_Sample();
+	if (cs) LCD_CS_PIN_ACTIVE();
+	if (resume) {
+		LCD_CD_COMMAND();
+		LCD_Write8(ILI9341_MEMORYWRITECONT);
+		LCD_CD_DATA();
+	}
+	LCD_SetBus8(bus);
+}
+
+// Counts the pixels of a memory write, checks the touch budget every LCD_ARBITER_CHUNK_PX
+#define LCD_YIELD_PX(__px, __bus)	do {									\
+										if (++(__px) == LCD_ARBITER_CHUNK_PX) {	\
+											(__px) = 0;							\
+											LCD_Yield(1, (__bus));				\
+										}										\
+									} while(0)
+// The same for __n pixels at once, in unrolled loops
+#define LCD_YIELD_PXN(__px, __n, __bus)	do {										\
+											if (((__px) += (__n)) >= LCD_ARBITER_CHUNK_PX) {	\
+												(__px) = 0;							\
+												LCD_Yield(1, (__bus));				\
+											}										\
+										} while(0)
+#else
+#define LCD_YIELD_PX(__px, __bus)	((void) (__px))
+#define LCD_YIELD_PXN(__px, __n, __bus)	((void) (__px))
+#endif
+
 /**
  * \brief Floods screen with pixels
  *
@@ -1474,12 +1815,11 @@ void LCD_DrawPixel(int16_t x, int16_t y, uint16_t color) {
  * \return void
  */
 void LCD_Flood(uint16_t color, uint32_t len) {
-#if defined(SSD1297)
-	uint8_t red = LCD_Color565_to_R(color);
-	uint8_t green = LCD_Color565_to_G(color);
-	uint8_t blue = LCD_Color565_to_B(color);
-#else
-	uint8_t hi = color >> 8, lo = color;
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		LCD_RamFlood(color, len);
+		return;
+	}
 #endif
 
 	LCD_CS_ACTIVE();
@@ -1497,6 +1837,35 @@ void LCD_Flood(uint16_t color, uint32_t len) {
 	LCD_Write24Register8(SSD1297_RAMDATA_WRITE, LCD_Color565_to_888(color));
 #endif
 	len--;
+#if defined (USE_TOUCH_ARBITER)
+	// long floods go out in chunks, a touch sample may run between them
+	while (len > LCD_ARBITER_CHUNK_PX) {
+		LCD_FloodRepeat(color, LCD_ARBITER_CHUNK_PX);
+		len -= LCD_ARBITER_CHUNK_PX;
+		LCD_Yield(1, (uint8_t) color);
+	}
+#endif
+	LCD_FloodRepeat(color, len);
+	LCD_CS_IDLE();
+}
+
+/**
+ * \brief Repeats the pixel just written to GRAM
+ *
+ * \param color	Color of that pixel, its last byte is still on the bus
+ * \param len	Number of repeats
+ *
+ * \return void
+ */
+static inline void LCD_FloodRepeat(uint16_t color, uint32_t len) {
+#if defined(SSD1297)
+	uint8_t red = LCD_Color565_to_R(color);
+	uint8_t green = LCD_Color565_to_G(color);
+	uint8_t blue = LCD_Color565_to_B(color);
+#else
+	uint8_t hi = color >> 8, lo = color;
+#endif
+
 #if defined(SSD1297)
 	if ((red == green) && (green == blue) && (red == blue)) {
 #else
@@ -1512,6 +1881,55 @@ void LCD_Flood(uint16_t color, uint32_t len) {
 			LCD_WR_STROBE();
 		}
 	} else {
+#if defined(USE_LOOKUP) && !defined(SSD1297)
+		// The bus holds the lo byte now. Only the ports whose bits differ
+		// between the hi and lo bytes have to be rewritten for every byte,
+		// the others keep their (shared) level
+		GPIO_TypeDef *port[3];
+		uint32_t port_hi[3], port_lo[3];
+		uint8_t n = 0;
+		if (lookup_gpioa[hi] != lookup_gpioa[lo]) {
+			port[n] = GPIOA;
+			port_hi[n] = lookup_gpioa[hi];
+			port_lo[n++] = lookup_gpioa[lo];
+		}
+		if (lookup_gpiob[hi] != lookup_gpiob[lo]) {
+			port[n] = GPIOB;
+			port_hi[n] = lookup_gpiob[hi];
+			port_lo[n++] = lookup_gpiob[lo];
+		}
+		if (lookup_gpioc[hi] != lookup_gpioc[lo]) {
+			port[n] = GPIOC;
+			port_hi[n] = lookup_gpioc[hi];
+			port_lo[n++] = lookup_gpioc[lo];
+		}
+		switch (n) {
+		case 1:
+			while (len--) {
+				port[0]->BSRR = port_hi[0];
+				LCD_WR_STROBE();
+				port[0]->BSRR = port_lo[0];
+				LCD_WR_STROBE();
+			}
+			break;
+		case 2:
+			while (len--) {
+				port[0]->BSRR = port_hi[0];
+				port[1]->BSRR = port_hi[1];
+				LCD_WR_STROBE();
+				port[0]->BSRR = port_lo[0];
+				port[1]->BSRR = port_lo[1];
+				LCD_WR_STROBE();
+			}
+			break;
+		default:
+			while (len--) {
+				LCD_Write8(hi);
+				LCD_Write8(lo);
+			}
+			break;
+		}
+#else
 		while (len--) {
 #if defined(SSD1297)
 			LCD_Write8(red);
@@ -1522,9 +1940,8 @@ void LCD_Flood(uint16_t color, uint32_t len) {
 			LCD_Write8(lo);
 #endif
 		}
+#endif
 	}
-
-	LCD_CS_IDLE();
 }
 
 /**
@@ -1535,6 +1952,14 @@ void LCD_Flood(uint16_t color, uint32_t len) {
  * \return void
  */
 void LCD_FillScreen(uint16_t color) {
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+		for (int16_t y = m_ram_y; y < m_ram_y + m_ram_h; y++)
+			LCD_RamSpan(0, y, m_width, color);
+		return;
+	}
+#endif
 #if defined(ILI9325) || defined(ILI9328) || defined(R61505) || defined(R61505V) || defined(SSD1297) || defined(ST7781)
 	/* 
 		For the 932X, a full-screen address window is already the default
@@ -1593,6 +2018,9 @@ void LCD_FillScreen(uint16_t color) {
  * \return void
  */
 void LCD_Reset(void) {
+#if defined(LCD_ADDR_WINDOW_CACHE)
+	m_win_col = m_win_page = 0xFFFFFFFF;
+#endif
 	LCD_CS_IDLE();
 	LCD_CD_DATA();
 	LCD_WR_IDLE();
@@ -1624,6 +2052,25 @@ void LCD_Reset(void) {
  * \return void
  */
 void LCD_SetAddrWindow(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		m_ram_cx = m_ram_wx1 = x1;
+		m_ram_cy = m_ram_wy1 = y1;
+		m_ram_wx2 = x2;
+		m_ram_wy2 = y2;
+#if defined (USE_DIRTY_RECTS)
+		if (m_report)
+			LCD_Dirty_Add(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+#endif
+		return;
+	}
+#endif
+#if defined(LCD_ADDR_WINDOW_CACHE)
+	uint32_t col = ((uint32_t) x1 << 16) | x2;
+	uint32_t page = ((uint32_t) y1 << 16) | y2;
+	if ((col == m_win_col) && (page == m_win_page)) return;
+#endif
+	LCD_STATS_INC(addr_windows);
 	LCD_CS_ACTIVE();
 #if	defined(ILI9325) || defined(ILI9328) || defined(R61505) || defined(R61505V) || defined(S6D0154) || defined(ST7781)
 	/* 
@@ -1688,16 +2135,28 @@ void LCD_SetAddrWindow(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
 #endif
 #elif defined(ILI9340) || defined(ILI9340_INV) || defined(ILI9341) || defined(ILI9341_00) \
 		|| defined(ILI9486) || defined(R61520) || defined(UNKNOWN1602)
-	LCD_Write32Register8(ILI9341_COLADDRSET, (x1 << 16) | x2);
-	LCD_Write32Register8(ILI9341_PAGEADDRSET, (y1 << 16) | y2);
+	if (col != m_win_col) {
+		LCD_Write32Register8(ILI9341_COLADDRSET, col);
+		m_win_col = col;
+	}
+	if (page != m_win_page) {
+		LCD_Write32Register8(ILI9341_PAGEADDRSET, page);
+		m_win_page = page;
+	}
 #elif defined(HX8347D) || defined(HX8347G)
     LCD_Write16RegisterPair8(HX8347G_COLADDRSTART_HI, HX8347G_COLADDRSTART_LO, x1);
     LCD_Write16RegisterPair8(HX8347G_COLADDREND_HI, HX8347G_COLADDREND_LO, x2);
     LCD_Write16RegisterPair8(HX8347G_ROWADDRSTART_HI, HX8347G_ROWADDRSTART_LO, y1);
     LCD_Write16RegisterPair8(HX8347G_ROWADDREND_HI, HX8347G_ROWADDREND_LO, y2);
 #elif defined(HX8357D)
-	LCD_Write32Register8(HX8357_CASET, x1 << 16 | x2);
-	LCD_Write32Register8(HX8357_PASET, y1 << 16 | y2);
+	if (col != m_win_col) {
+		LCD_Write32Register8(HX8357_CASET, col);
+		m_win_col = col;
+	}
+	if (page != m_win_page) {
+		LCD_Write32Register8(HX8357_PASET, page);
+		m_win_page = page;
+	}
 #elif defined(SSD1297)
 	if(m_rotation & 1) {
 		LCD_Write16Register8(SSD1297_SETXCOUNTER, y1); //GRAM Address Set
@@ -1716,6 +2175,22 @@ void LCD_SetAddrWindow(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
 	LCD_CS_IDLE();
 }
 
+/**
+ * \brief Restores the full-screen address window after a drawing function
+ *
+ * \param
+ *
+ * \return void
+ *
+ * \info Only the controllers that draw pixels by setting the address counter
+ *       rely on the full-screen window, the others set their own window
+ */
+static inline void LCD_ResetAddrWindow(void) {
+#if !defined(LCD_ADDR_WINDOW_CACHE)
+	LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+#endif
+}
+
 #if defined(HX8347D) || defined(HX8347G)
 /*
 	Unlike the 932X drivers that set the address window to the full screen
@@ -1869,59 +2344,122 @@ uint8_t LCD_GetRotation() {
 }
 
 /**
- * \brief  Draws a BMP picture loaded in the STM32 MCU internal memory.
+ * \brief Starts a bus batch: CS stays active until the matching LCD_EndBatch()
+ *
+ * \param
  *
- * \param xPos		Bmp X position in the LCD
- * \param yPos		Bmp Y position in the LCD
- * \param pBmp		Pointer to Bmp picture address
  * \return void
+ *
+ * \info Batches nest, only the outermost pair toggles CS
  */
-void LCD_DrawBMP(int16_t xPos, int16_t yPos, const uint8_t *pBmp) {
-	uint8_t *ptr;
-	uint8_t *start;
-	uint8_t *end;
-	uint32_t offset = 0, size = 0;
-	int32_t height = 0, width = 0;
-	uint16_t colordepth = 0;
-
-	/* Read bitmap size */
-	size = *(volatile uint16_t *) (pBmp + 2);
-	size |= (*(volatile uint16_t *) (pBmp + 4)) << 16;
-	/* Get bitmap data address offset */
-	offset = *(volatile uint16_t *) (pBmp + 10);
-	offset |= (*(volatile uint16_t *) (pBmp + 12)) << 16;
-	/* Read bitmap width */
-	width = *(uint16_t *) (pBmp + 18);
-	width |= (*(uint16_t *) (pBmp + 20)) << 16;
-	/* Read bitmap height */
-	height = *(uint16_t *) (pBmp + 22);
-	height |= (*(uint16_t *) (pBmp + 24)) << 16;
-	/* Read color depth */
-	colordepth = *(uint16_t *) (pBmp + 28);
-
-	/* Calculate pixel data boundary addresses */
-	start = (uint8_t *) pBmp + offset;
-	end = (uint8_t *) pBmp + size;
+void LCD_BeginBatch(void) {
+	if (m_batch++ == 0) {
+		LCD_BUS_CLAIM();
+		LCD_CS_PIN_ACTIVE();
+	}
+}
 
-	/* Start drawing */
+/**
+ * \brief Ends a bus batch started with LCD_BeginBatch()
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_EndBatch(void) {
+	if (m_batch == 0) return;
+	if (--m_batch == 0) {
+		LCD_CS_PIN_IDLE();
+	}
+}
+
+/**
+ * \brief Tells whether the LCD holds CS active past the current call
+ *
+ * \param
+ *
+ * \return uint8_t 1 - a batch, a DMA or a WR timer transfer is running
+ *
+ * \info The pins shared with the touch panel must not change meanwhile
+ */
+uint8_t LCD_IsBusBusy(void) {
+	if (m_batch) return 1;
+#if defined (USE_DMA)
+	if (m_dma_busy) return 1;
+#endif
+#if defined (USE_WR_TIMER)
+	if (m_strobe_busy) return 1;
+#endif
+	return 0;
+}
+
+#if defined(USE_BUS_STATS)
+/**
+ * \brief Copies the bus transaction counters accumulated since the last reset
+ *
+ * \param stats	Pointer to the structure to fill
+ *
+ * \return void
+ */
+void LCD_GetBusStats(LCD_BusStats *stats) {
+	*stats = m_stats;
+}
+
+/**
+ * \brief Resets the bus transaction counters
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_ResetBusStats(void) {
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+#endif
+
+/**
+ * \brief  Draws a BMP picture loaded in the STM32 MCU internal memory.
+ *
+ * \param xPos		Bmp X position in the LCD
+ * \param yPos		Bmp Y position in the LCD
+ * \param pBmp		Pointer to Bmp picture address
+ * \return void
+ */
+void LCD_DrawBMP(int16_t xPos, int16_t yPos, const uint8_t *pBmp) {
+	uint8_t *ptr;
+	uint8_t *start;
+	uint8_t *end;
+	uint32_t offset = 0, size = 0;
+	int32_t height = 0, width = 0;
+	uint16_t colordepth = 0;
+	uint32_t px = 0;
+
+	/* Read bitmap size */
+	size = *(volatile uint16_t *) (pBmp + 2);
+	size |= (*(volatile uint16_t *) (pBmp + 4)) << 16;
+	/* Get bitmap data address offset */
+	offset = *(volatile uint16_t *) (pBmp + 10);
+	offset |= (*(volatile uint16_t *) (pBmp + 12)) << 16;
+	/* Read bitmap width */
+	width = *(uint16_t *) (pBmp + 18);
+	width |= (*(uint16_t *) (pBmp + 20)) << 16;
+	/* Read bitmap height */
+	height = *(uint16_t *) (pBmp + 22);
+	height |= (*(uint16_t *) (pBmp + 24)) << 16;
+	/* Read color depth */
+	colordepth = *(uint16_t *) (pBmp + 28);
+
+	/* Calculate pixel data boundary addresses */
+	start = (uint8_t *) pBmp + offset;
+	end = (uint8_t *) pBmp + size;
+
+	/* Start drawing */
 	if ((xPos + width >= m_width) || (yPos + abs(height) >= m_height)) return;
 	LCD_SetAddrWindow(xPos, yPos, xPos + width - 1, yPos + abs(height) - 1);
-	LCD_CS_ACTIVE();
-	LCD_CD_COMMAND();
-#if	defined(ILI9325) || defined(ILI9328) || defined(R61505) || defined(R61505V) || defined(S6D0154) || defined(ST7781)
-	LCD_Write8(0x00); // High byte of GRAM register...
-	LCD_Write8(ILI932X_GRAM_WR); // Write data to GRAM
-#elif defined(ILI9340) || defined(ILI9340_INV) || defined(ILI9341) || defined(ILI9341_00) \
-		|| defined(ILI9486) || defined(R61520) || defined(UNKNOWN1602)
-	LCD_Write8(ILI9341_MEMORYWRITE); // Write data to GRAM
-#elif defined(HX8347D) || defined(HX8347G)
-	LCD_Write8(HX8347G_SRAM_WR); // Write data to GRAM
-#elif defined(HX8357D)
-	LCD_Write8(HX8357_RAMWR); // Write data to GRAM
-#elif defined(SSD1297)
-	LCD_Write8(SSD1297_RAMDATA_WRITE); // Write data to GRAM
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) return; // bitmaps go straight to the bus, only their window is reported
 #endif
-	LCD_CD_DATA();
+	LCD_MemoryWriteStart();
 	if (height < 0) {
 		/* Top-bottom file */
 		ptr = start;
@@ -1937,6 +2475,7 @@ void LCD_DrawBMP(int16_t xPos, int16_t yPos, const uint8_t *pBmp) {
 				LCD_Write8(*(ptr));
 #endif
 				ptr += 2;
+				LCD_YIELD_PX(px, 0);
 			}
 		} else if (colordepth == 24) {
 			while (ptr < end) {
@@ -1949,6 +2488,7 @@ void LCD_DrawBMP(int16_t xPos, int16_t yPos, const uint8_t *pBmp) {
 				LCD_Write8(((*(ptr + 1) & 0x1C) << 3) | (*(ptr) >> 3));
 #endif
 				ptr += 3;
+				LCD_YIELD_PX(px, 0);
 			}
 		}
 	} else {
@@ -1971,6 +2511,7 @@ void LCD_DrawBMP(int16_t xPos, int16_t yPos, const uint8_t *pBmp) {
 					LCD_Write8(*(ptr));
 #endif
 					ptr += 2;
+					LCD_YIELD_PX(px, 0);
 				}
 			}
 		} else if (colordepth == 24) {
@@ -1988,12 +2529,13 @@ void LCD_DrawBMP(int16_t xPos, int16_t yPos, const uint8_t *pBmp) {
 					LCD_Write8(((*(ptr + 1) & 0x1C) << 3) | (*(ptr) >> 3));
 #endif
 					ptr += 3;
+					LCD_YIELD_PX(px, 0);
 				}
 			}
 		}
 	}
 	LCD_CS_IDLE();
-	LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+	LCD_ResetAddrWindow();
 }
 
 
@@ -2015,6 +2557,7 @@ void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile) {
 	uint32_t offset = 0, size = 0;
 	int32_t height = 0, width = 0;
 	uint16_t colordepth = 0;
+	uint32_t px = 0;
 
 	/* Read BMP header: 54 bytes = 14 bytes header + 40 bytes DIB header (assuming BITMAPINFOHEADER) */
 	f_read(pFile, buf, 54, (UINT *) &readBytes);
@@ -2044,6 +2587,9 @@ void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile) {
 	/* Start drawing */
 	if ((xPos + width > m_width) || (yPos + abs(height) > m_height) || clusterSize > sizeof(buf)) return;
 	LCD_SetAddrWindow(xPos, yPos, xPos + width - 1, yPos + abs(height) - 1);
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) return; // bitmaps go straight to the bus, only their window is reported
+#endif
 	LCD_CS_ACTIVE();
 	LCD_CD_COMMAND();
 #if	defined(ILI9325) || defined(ILI9328) || defined(R61505) || defined(R61505V) || defined(S6D0154) || defined(ST7781)
@@ -2084,6 +2630,7 @@ void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile) {
 					LCD_Write8(*(pBmp));
 #endif
 					pBmp += 2;
+					LCD_YIELD_PX(px, 0);
 				}
 			} else if (colordepth == 24) {
 				while (pBmp < end) {
@@ -2096,6 +2643,7 @@ void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile) {
 					LCD_Write8(((*(pBmp + 1) & 0x1C) << 3) | (*(pBmp) >> 3));
 #endif
 					pBmp += 3;
+					LCD_YIELD_PX(px, 0);
 				}
 			}
 			clusterNum++;
@@ -2120,6 +2668,7 @@ void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile) {
 					LCD_Write8(*(pBmp));
 #endif
 					pBmp += 2;
+					LCD_YIELD_PX(px, 0);
 				}
 			} else if (colordepth == 24) {
 				while (pBmp < end) {
@@ -2131,14 +2680,775 @@ void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile) {
 					LCD_Write8((*(pBmp + 2) & 0xF8) | (*(pBmp + 1) >> 5));
 					LCD_Write8(((*(pBmp + 1) & 0x1C) << 3) | (*(pBmp) >> 3));
 #endif
-					pBmp += 3;
-				}
-			}
-			clusterNum--;
-		}
+					pBmp += 3;
+					LCD_YIELD_PX(px, 0);
+				}
+			}
+			clusterNum--;
+		}
+	}
+	LCD_CS_IDLE();
+	LCD_ResetAddrWindow();
+}
+#endif
+
+/**
+ * \brief Writes a block of RGB565 pixels from a caller-owned buffer
+ *
+ * \param x			The x-coordinate of the upper-left corner of the block
+ * \param y			The y-coordinate of the upper-left corner of the block
+ * \param w			Width of the block
+ * \param h			Height of the block
+ * \param pixels	Row-major RGB565 pixels, w * h entries
+ *
+ * \return void
+ */
+void LCD_WritePixels(int16_t x, int16_t y, int16_t w, int16_t h, const uint16_t *pixels) {
+	LCD_WritePixelsStride(x, y, w, h, pixels, w);
+}
+
+/**
+ * \brief Writes a block of RGB565 pixels from a caller-owned buffer with a row stride
+ *
+ * \param x			The x-coordinate of the upper-left corner of the block
+ * \param y			The y-coordinate of the upper-left corner of the block
+ * \param w			Width of the block
+ * \param h			Height of the block
+ * \param pixels	Row-major RGB565 pixels
+ * \param stride	Distance between the starts of two rows, in pixels
+ *
+ * \return void
+ */
+void LCD_WritePixelsStride(int16_t x, int16_t y, int16_t w, int16_t h, const uint16_t *pixels, uint16_t stride) {
+	uint32_t px = 0;
+
+	// Initial off-screen clipping
+	if ((w <= 0) || (h <= 0) || (x >= m_width) || (y >= m_height)
+			|| (x + w <= 0) || (y + h <= 0))
+		return;
+	if (x < 0) { // Clip left
+		pixels -= x;
+		w += x;
+		x = 0;
+	}
+	if (y < 0) { // Clip top
+		pixels -= (int32_t) y * stride;
+		h += y;
+		y = 0;
+	}
+	if (x + w > m_width) { // Clip right
+		w = m_width - x;
+	}
+	if (y + h > m_height) { // Clip bottom
+		h = m_height - y;
+	}
+
+	LCD_SetAddrWindow(x, y, x + w - 1, y + h - 1);
+	LCD_MemoryWriteStart();
+	while (h--) {
+		const uint16_t *ptr = pixels;
+		int16_t n = w;
+		while (n >= 4) {
+			LCD_WriteColor(ptr[0]);
+			LCD_WriteColor(ptr[1]);
+			LCD_WriteColor(ptr[2]);
+			LCD_WriteColor(ptr[3]);
+			ptr += 4;
+			n -= 4;
+			LCD_YIELD_PXN(px, 4, 0);
+		}
+		while (n--) {
+			LCD_WriteColor(*ptr++);
+			LCD_YIELD_PX(px, 0);
+		}
+		pixels += stride;
+	}
+	LCD_CS_IDLE();
+	LCD_ResetAddrWindow();
+}
+
+#if defined (USE_BAND_RENDER)
+/**
+ * \brief Draws a frame through a RAM strip, one band of rows at a time
+ *
+ * \param buf		Strip buffer, width * rows pixels (240 or 320 wide, by rotation)
+ * \param rows		Rows per band
+ * \param draw		Draws the whole frame, called once per band
+ *
+ * \return void
+ *
+ * \info Inside draw() the drawing functions write to the strip, which is then
+ *       pushed with one address window. Overdraw only costs RAM bandwidth.
+ *       The text cursor, colors, font and size are restored before each band.
+ *       The strip is not cleared between bands, draw() must cover every pixel
+ *       of the frame (start it with LCD_FillScreen(), for example).
+ *       LCD_DrawBMP() and LCD_DrawBMPFromFile() are skipped inside draw(),
+ *       the async fills write to the strip at once.
+ */
+void LCD_RenderBands(uint16_t *buf, uint16_t rows, void (*draw)(void)) {
+	int16_t cursor_x = m_cursor_x, cursor_y = m_cursor_y;
+	uint16_t textcolor = m_textcolor, textbgcolor = m_textbgcolor;
+	uint8_t font = m_font, scale = m_scale, wrap = m_wrap;
+	int16_t y;
+
+	if ((buf == NULL) || (rows == 0) || (draw == NULL) || m_ram)
+		return;
+
+	for (y = 0; y < m_height; y += rows) {
+		m_cursor_x = cursor_x;
+		m_cursor_y = cursor_y;
+		m_textcolor = textcolor;
+		m_textbgcolor = textbgcolor;
+		m_font = font;
+		m_scale = scale;
+		m_wrap = wrap;
+
+		m_ram = buf;
+		m_ram_y = y;
+		m_ram_h = (m_height - y < rows) ? m_height - y : rows;
+		m_ram_cx = m_ram_wx1 = 0;
+		m_ram_cy = m_ram_wy1 = 0;
+		m_ram_wx2 = m_width - 1;
+		m_ram_wy2 = m_height - 1;
+		draw();
+		m_ram = NULL;
+
+		LCD_WritePixels(0, y, m_width, m_ram_h, buf);
+	}
+}
+#endif
+
+#if defined (USE_DIRTY_RECTS)
+/**
+ * \brief Starts reporting: the drawing functions add their bounding boxes to
+ *        the dirty list (lcd_dirty.h) instead of drawing
+ *
+ * \param
+ *
+ * \return void
+ *
+ * \info Every address window a function would set is reported, so lines and
+ *       circles report a few tight boxes that lcd_dirty merges.
+ */
+void LCD_ReportBegin(void) {
+	if (m_ram)
+		return;
+	m_report = 1;
+	m_ram = &m_report;
+	m_ram_y = 0;
+	m_ram_h = 0;
+}
+
+/**
+ * \brief Ends reporting, the drawing functions write to the bus again
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_ReportEnd(void) {
+	if (!m_report)
+		return;
+	m_report = 0;
+	m_ram = NULL;
+}
+#endif
+
+#if defined (USE_CANVAS8)
+/**
+ * \brief Selects an 8bpp indexed canvas as the target of the drawing functions
+ *
+ * \param buf		Canvas, 240 * 320 bytes, row-major in the current rotation
+ * \param palette	256 RGB565 colors, must stay valid while the canvas is selected
+ *
+ * \return void
+ *
+ * \info Colors passed to the drawing functions are palette indices (low byte)
+ *       until LCD_CanvasEnd(). The whole canvas is marked dirty.
+ */
+void LCD_CanvasBegin(uint8_t *buf, const uint16_t *palette) {
+	if ((buf == NULL) || (palette == NULL) || m_ram)
+		return;
+	m_canvas = buf;
+	m_ram = buf;
+	m_ram_y = 0;
+	m_ram_h = m_height;
+	m_ram_cx = m_ram_wx1 = 0;
+	m_ram_cy = m_ram_wy1 = 0;
+	m_ram_wx2 = m_width - 1;
+	m_ram_wy2 = m_height - 1;
+	LCD_CanvasSetPalette(palette);
+}
+
+/**
+ * \brief Deselects the canvas, the drawing functions write to the bus again
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_CanvasEnd(void) {
+	if (m_canvas == NULL)
+		return;
+	m_canvas = NULL;
+	m_ram = NULL;
+}
+
+/**
+ * \brief Replaces the palette and marks the whole canvas dirty
+ *
+ * \param palette	256 RGB565 colors
+ *
+ * \return void
+ *
+ * \info Call it again after changing the current palette in place.
+ *       The next LCD_CanvasFlush() re-colors the screen without redrawing.
+ */
+void LCD_CanvasSetPalette(const uint16_t *palette) {
+	if ((m_canvas == NULL) || (palette == NULL))
+		return;
+	m_palette = palette;
+	for (int16_t y = 0; y < m_height; y++) {
+		m_dirty_x1[y] = 0;
+		m_dirty_x2[y] = m_width - 1;
+	}
+}
+
+/**
+ * \brief Streams the dirty parts of the canvas to the LCD through the palette
+ *
+ * \param
+ *
+ * \return void
+ *
+ * \info Consecutive dirty rows share one address window while that wastes
+ *       at most LCD_CANVAS_MERGE_PX pixels per row.
+ */
+void LCD_CanvasFlush(void) {
+	int16_t y = 0;
+	uint32_t px = 0;
+
+	if (m_canvas == NULL)
+		return;
+
+	m_ram = NULL;
+	LCD_BeginBatch();
+	while (y < m_height) {
+		if (m_dirty_x1[y] > m_dirty_x2[y]) {
+			y++;
+			continue;
+		}
+
+		// Block of dirty rows y1..y-1, columns x1..x2
+		int16_t y1 = y, x1 = m_dirty_x1[y], x2 = m_dirty_x2[y];
+		uint32_t used = x2 - x1 + 1;
+		while ((++y < m_height) && (m_dirty_x1[y] <= m_dirty_x2[y])) {
+			int16_t nx1 = (m_dirty_x1[y] < x1) ? m_dirty_x1[y] : x1;
+			int16_t nx2 = (m_dirty_x2[y] > x2) ? m_dirty_x2[y] : x2;
+			uint32_t rows = y - y1 + 1;
+			uint32_t span = m_dirty_x2[y] - m_dirty_x1[y] + 1;
+			if ((uint32_t) (nx2 - nx1 + 1) * rows - (used + span) > LCD_CANVAS_MERGE_PX * rows)
+				break;
+			x1 = nx1;
+			x2 = nx2;
+			used += span;
+		}
+
+		LCD_SetAddrWindow(x1, y1, x2, y - 1);
+		LCD_MemoryWriteStart();
+		for (int16_t r = y1; r < y; r++) {
+			const uint8_t *p = m_canvas + r * m_width + x1;
+			for (int16_t n = x2 - x1 + 1; n > 0; n--) {
+				LCD_WriteColor(m_palette[*p++]);
+				LCD_YIELD_PX(px, 0);
+			}
+			m_dirty_x1[r] = TFTHEIGHT;
+			m_dirty_x2[r] = -1;
+		}
+	}
+	LCD_CS_IDLE();
+	LCD_ResetAddrWindow();
+	LCD_EndBatch();
+	m_ram = m_canvas;
+}
+#endif
+
+#if defined (USE_DMA)
+/* =========================================================================== */
+/* ============================ DMA FUNCTIONS ================================ */
+/* =========================================================================== */
+
+/**
+ *  \brief Bus streaming with DMA2 and TIM8
+ *
+ *  Every byte is split into three BSRR words (one per data port) plus one WR
+ *  high word. TIM8 runs one period per byte and each compare channel requests
+ *  one DMA2 transfer (channel 7) into a BSRR register:
+ *
+ *  tick:     CCR1         CCR2         CCR3               CCR4
+ *  stream:   S2 -> GPIOB  S3 -> GPIOC  S4 -> GPIOA + WR=0  S7 -> WR=1
+ *
+ *  The timer runs in one-pulse mode with RCR = bytes - 1, so it stops by itself
+ *  after a chunk and never leaves a stale DMA request behind. The S7 transfer
+ *  complete interrupt re-arms the next chunk from the other half of the double
+ *  buffer and refills the half that has just been sent.
+ */
+#if defined(SSD1297)
+#error Error in lcd.c: USE_DMA does not support SSD1297 (3 bytes per pixel)
+#endif
+#if !defined(USE_LOOKUP)
+#error Error in lcd.c: USE_DMA requires USE_LOOKUP
+#endif
+#if (LCD_DMA_CHUNK > 256) || (LCD_DMA_CHUNK & 1)
+#error Error in lcd.c: LCD_DMA_CHUNK must be even and not greater than 256 (TIM8 RCR)
+#endif
+#if LCD_DMA_PERIOD < 12
+#error Error in lcd.c: LCD_DMA_PERIOD is too short for the DMA to keep up
+#endif
+
+#define LCD_DMA_CR			((7U << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_PL | DMA_SxCR_MSIZE_1 \
+								| DMA_SxCR_PSIZE_1 | DMA_SxCR_DIR_0)
+#define LCD_DMA_LIFCR		(DMA_LIFCR_CTCIF2 | DMA_LIFCR_CHTIF2 | DMA_LIFCR_CTEIF2		\
+								| DMA_LIFCR_CDMEIF2 | DMA_LIFCR_CFEIF2					\
+								| DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3	\
+								| DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3)
+#define LCD_DMA_HIFCR		(DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4		\
+								| DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4					\
+								| DMA_HIFCR_CTCIF7 | DMA_HIFCR_CHTIF7 | DMA_HIFCR_CTEIF7	\
+								| DMA_HIFCR_CDMEIF7 | DMA_HIFCR_CFEIF7)
+
+static uint32_t m_dma_gpioa[2][LCD_DMA_CHUNK];
+static uint32_t m_dma_gpiob[2][LCD_DMA_CHUNK];
+static uint32_t m_dma_gpioc[2][LCD_DMA_CHUNK];
+static uint32_t m_dma_wr_idle = LCD_WR_PIN;
+static uint16_t m_dma_len[2];			// bytes queued in each half, 0 - empty
+static uint8_t m_dma_cur;				// half being sent
+static uint32_t m_dma_left;				// bytes not yet queued
+static const uint16_t *m_dma_row;		// NULL - flood, the pattern is already in both halves
+static uint16_t m_dma_col;
+static uint16_t m_dma_width;
+static uint16_t m_dma_stride;
+static void (*m_dma_callback)(void);
+
+/**
+ * \brief Configures TIM8 and the DMA2 streams, called from LCD_Init()
+ *
+ * \param
+ *
+ * \return void
+ */
+static void LCD_DMA_Init(void) {
+	RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+	RCC->APB2ENR |= RCC_APB2ENR_TIM8EN;
+	(void) RCC->APB2ENR;
+
+	TIM8->CR1 = TIM_CR1_OPM;
+	TIM8->PSC = 0;
+	TIM8->ARR = LCD_DMA_PERIOD - 1;
+	TIM8->CCMR1 = 0;
+	TIM8->CCMR2 = 0;
+	// B and C settle for a whole period before the WR rising edge,
+	// A changes together with the falling edge, half a period before it
+	TIM8->CCR1 = 2;
+	TIM8->CCR2 = 3;
+	TIM8->CCR3 = LCD_DMA_PERIOD / 2;
+	TIM8->CCR4 = LCD_DMA_PERIOD - 1;
+	TIM8->DIER = TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE | TIM_DIER_CC4DE;
+
+	DMA2_Stream2->CR = 0;
+	DMA2_Stream3->CR = 0;
+	DMA2_Stream4->CR = 0;
+	DMA2_Stream7->CR = 0;
+	while ((DMA2_Stream2->CR | DMA2_Stream3->CR | DMA2_Stream4->CR | DMA2_Stream7->CR) & DMA_SxCR_EN);
+	DMA2_Stream2->PAR = (uint32_t) (uintptr_t) &GPIOB->BSRR;
+	DMA2_Stream3->PAR = (uint32_t) (uintptr_t) &GPIOC->BSRR;
+	DMA2_Stream4->PAR = (uint32_t) (uintptr_t) &GPIOA->BSRR;
+	DMA2_Stream7->PAR = (uint32_t) (uintptr_t) &GPIOA->BSRR;
+	DMA2_Stream7->M0AR = (uint32_t) (uintptr_t) &m_dma_wr_idle;
+	DMA2_Stream2->CR = LCD_DMA_CR | DMA_SxCR_MINC;
+	DMA2_Stream3->CR = LCD_DMA_CR | DMA_SxCR_MINC;
+	DMA2_Stream4->CR = LCD_DMA_CR | DMA_SxCR_MINC;
+	DMA2_Stream7->CR = LCD_DMA_CR | DMA_SxCR_TCIE;
+
+	HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+}
+
+/**
+ * \brief Splits one byte into the BSRR words of half i
+ *
+ * \param i		Buffer half
+ * \param j		Index in the half
+ * \param data	8-Bit data
+ *
+ * \return void
+ */
+static inline void LCD_DMA_Put(uint8_t i, uint16_t j, uint8_t data) {
+	m_dma_gpioa[i][j] = lookup_gpioa[data] | ((uint32_t)LCD_WR_PIN << 16U);
+	m_dma_gpiob[i][j] = lookup_gpiob[data];
+	m_dma_gpioc[i][j] = lookup_gpioc[data];
+}
+
+/**
+ * \brief Queues the next chunk of the source into half i
+ *
+ * \param i		Buffer half
+ *
+ * \return void
+ */
+static void LCD_DMA_Fill(uint8_t i) {
+	uint16_t n = (m_dma_left > LCD_DMA_CHUNK) ? LCD_DMA_CHUNK : m_dma_left;
+	m_dma_left -= n;
+	m_dma_len[i] = n;
+	if (m_dma_row == NULL)
+		return;
+	for (uint16_t j = 0; j < n; j += 2) {
+		uint16_t color = m_dma_row[m_dma_col];
+		if (++m_dma_col == m_dma_width) {
+			m_dma_col = 0;
+			m_dma_row += m_dma_stride;
+		}
+		LCD_DMA_Put(i, j, color >> 8);
+		LCD_DMA_Put(i, j + 1, color);
+	}
+}
+
+/**
+ * \brief Starts sending half i
+ *
+ * \param i		Buffer half
+ *
+ * \return void
+ */
+static void LCD_DMA_Start(uint8_t i) {
+	uint16_t n = m_dma_len[i];
+
+	DMA2->LIFCR = LCD_DMA_LIFCR;
+	DMA2->HIFCR = LCD_DMA_HIFCR;
+	DMA2_Stream2->M0AR = (uint32_t) (uintptr_t) m_dma_gpiob[i];
+	DMA2_Stream3->M0AR = (uint32_t) (uintptr_t) m_dma_gpioc[i];
+	DMA2_Stream4->M0AR = (uint32_t) (uintptr_t) m_dma_gpioa[i];
+	DMA2_Stream2->NDTR = n;
+	DMA2_Stream3->NDTR = n;
+	DMA2_Stream4->NDTR = n;
+	DMA2_Stream7->NDTR = n;
+	DMA2_Stream2->CR |= DMA_SxCR_EN;
+	DMA2_Stream3->CR |= DMA_SxCR_EN;
+	DMA2_Stream4->CR |= DMA_SxCR_EN;
+	DMA2_Stream7->CR |= DMA_SxCR_EN;
+#if defined (USE_BUS_STATS)
+	m_stats.wr_strobes += n;
+#endif
+
+	TIM8->RCR = n - 1;
+	TIM8->EGR = TIM_EGR_UG;		// load RCR, CNT = 0
+	TIM8->SR = 0;
+	TIM8->CR1 |= TIM_CR1_CEN;
+}
+
+/**
+ * \brief Sends the queued chunks, the address window must be set
+ *
+ * \param bytes		Number of bytes
+ * \param callback	Called from the interrupt when done, may be NULL
+ *
+ * \return void
+ */
+static void LCD_DMA_Run(uint32_t bytes, void (*callback)(void)) {
+	m_dma_busy = 1;
+	m_dma_callback = callback;
+	m_dma_left = bytes;
+	m_dma_cur = 0;
+	LCD_DMA_Fill(0);
+	LCD_DMA_Fill(1);
+	LCD_MemoryWriteStart();
+	LCD_DMA_Start(0);
+}
+
+/**
+ * \brief Fills the current address window with color, without the CPU
+ *
+ * \param color		Color
+ * \param len		Number of pixels
+ * \param callback	Called from the interrupt when done, may be NULL
+ *
+ * \return 1 if the transfer has started, 0 if the bus is busy or len is 0
+ *
+ * \info With a band strip or a canvas selected the pixels go to RAM at once
+ *       and the callback is called before returning.
+ */
+uint8_t LCD_FloodAsync(uint16_t color, uint32_t len, void (*callback)(void)) {
+	if (!len)
+		return 0;
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		LCD_Flood(color, len);
+		if (callback)
+			callback();
+		return 1;
+	}
+#endif
+	if (m_dma_busy)
+		return 0;
+#if defined (USE_WR_TIMER)
+	if (m_strobe_busy)
+		return 0;
+#endif
+	for (uint16_t j = 0; j < LCD_DMA_CHUNK; j += 2) {
+		LCD_DMA_Put(0, j, color >> 8);
+		LCD_DMA_Put(0, j + 1, color);
+		LCD_DMA_Put(1, j, color >> 8);
+		LCD_DMA_Put(1, j + 1, color);
+	}
+	m_dma_row = NULL;
+	LCD_DMA_Run(len * 2, callback);
+	return 1;
+}
+
+/**
+ * \brief Writes a block of RGB565 pixels with a row stride, without the CPU
+ *
+ * \param x			The x-coordinate of the upper-left corner of the block
+ * \param y			The y-coordinate of the upper-left corner of the block
+ * \param w			Width of the block
+ * \param h			Height of the block
+ * \param pixels	Row-major RGB565 pixels, must stay valid until the callback
+ * \param stride	Distance between the starts of two rows, in pixels
+ * \param callback	Called from the interrupt when done, may be NULL
+ *
+ * \return 1 if the transfer has started, 0 if the bus is busy or the block is off-screen
+ *
+ * \info With a band strip or a canvas selected the pixels go to RAM at once
+ *       and the callback is called before returning.
+ */
+uint8_t LCD_WritePixelsAsync(int16_t x, int16_t y, int16_t w, int16_t h, const uint16_t *pixels,
+		uint16_t stride, void (*callback)(void)) {
+	// Initial off-screen clipping
+	if ((w <= 0) || (h <= 0) || (x >= m_width) || (y >= m_height)
+			|| (x + w <= 0) || (y + h <= 0))
+		return 0;
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		LCD_WritePixelsStride(x, y, w, h, pixels, stride);
+		if (callback)
+			callback();
+		return 1;
+	}
+#endif
+	if (m_dma_busy)
+		return 0;
+#if defined (USE_WR_TIMER)
+	if (m_strobe_busy)
+		return 0;
+#endif
+	if (x < 0) { // Clip left
+		pixels -= x;
+		w += x;
+		x = 0;
+	}
+	if (y < 0) { // Clip top
+		pixels -= (int32_t) y * stride;
+		h += y;
+		y = 0;
+	}
+	if (x + w > m_width) { // Clip right
+		w = m_width - x;
+	}
+	if (y + h > m_height) { // Clip bottom
+		h = m_height - y;
+	}
+
+	LCD_SetAddrWindow(x, y, x + w - 1, y + h - 1);
+	m_dma_row = pixels;
+	m_dma_col = 0;
+	m_dma_width = w;
+	m_dma_stride = stride;
+	LCD_DMA_Run((uint32_t) w * h * 2, callback);
+	return 1;
+}
+
+/**
+ * \brief Checks whether a DMA transfer is in progress
+ *
+ * \param
+ *
+ * \return 1 if busy, 0 otherwise
+ */
+uint8_t LCD_DMA_IsBusy(void) {
+	return m_dma_busy;
+}
+
+/**
+ * \brief Chunk complete handler, call from DMA2_Stream7_IRQHandler()
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_DMA_IRQHandler(void) {
+	if (!(DMA2->HISR & DMA_HISR_TCIF7))
+		return;
+	DMA2->HIFCR = DMA_HIFCR_CTCIF7;
+	if (!m_dma_busy)
+		return;
+
+	m_dma_len[m_dma_cur] = 0;
+	m_dma_cur ^= 1;
+	if (m_dma_len[m_dma_cur]) {
+		LCD_DMA_Start(m_dma_cur);
+		LCD_DMA_Fill(m_dma_cur ^ 1);
+		return;
+	}
+
+	LCD_CS_IDLE();
+	LCD_ResetAddrWindow();
+	m_dma_busy = 0;
+	if (m_dma_callback)
+		m_dma_callback();
+}
+#endif
+
+#if defined (USE_WR_TIMER)
+/* =========================================================================== */
+/* ========================= WR TIMER FUNCTIONS ============================== */
+/* =========================================================================== */
+
+/**
+ *  \brief WR strobes generated by TIM5 for colors with equal bytes
+ *
+ *  The data bus is set once, then the WR pin (PA1) is handed over to TIM5_CH2
+ *  (AF2) in PWM mode 1: high for the first half of each period, low for the
+ *  second, so every period ends with a rising edge and the counter idles high
+ *  at CNT = 0. TIM5 is in gated slave mode behind TIM2 (ITR0), which runs once
+ *  (one-pulse mode) and keeps OC1REF -> TRGO high for len * 2 periods plus one
+ *  tick: a one tick slack still ends high, so the pulse count is exact.
+ *  The TIM2 update interrupt gives the pin back to the GPIO.
+ */
+#if defined(SSD1297)
+#error Error in lcd.c: USE_WR_TIMER does not support SSD1297 (3 bytes per pixel)
+#endif
+#if LCD_WR_TIMER_PERIOD < 6
+#error Error in lcd.c: LCD_WR_TIMER_PERIOD is too short for the WR cycle
+#endif
+
+static void (*m_strobe_callback)(void);
+
+/**
+ * \brief Configures TIM2 and TIM5, called from LCD_Init()
+ *
+ * \param
+ *
+ * \return void
+ */
+static void LCD_WR_Timer_Init(void) {
+	RCC->APB1ENR |= RCC_APB1ENR_TIM2EN | RCC_APB1ENR_TIM5EN;
+	(void) RCC->APB1ENR;
+
+	// TIM2: OC1REF in PWM mode 2 is high from CNT = 1 up to the update
+	TIM2->CR1 = TIM_CR1_OPM | TIM_CR1_URS;
+	TIM2->PSC = 0;
+	TIM2->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1M_0;
+	TIM2->CCR1 = 1;
+	TIM2->CR2 = TIM_CR2_MMS_2;							// TRGO = OC1REF
+	TIM2->DIER = TIM_DIER_UIE;
+
+	// TIM5: counts only while TIM2 TRGO is high
+	TIM5->CR1 = 0;
+	TIM5->PSC = 0;
+	TIM5->ARR = LCD_WR_TIMER_PERIOD - 1;
+	TIM5->CCMR1 = TIM_CCMR1_OC2M_2 | TIM_CCMR1_OC2M_1;	// PWM mode 1
+	TIM5->CCR2 = LCD_WR_TIMER_PERIOD / 2;
+	TIM5->CCER = TIM_CCER_CC2E;
+	TIM5->SMCR = TIM_SMCR_SMS_2 | TIM_SMCR_SMS_0;		// gated, TS = ITR0 (TIM2)
+
+	HAL_NVIC_SetPriority(TIM2_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+/**
+ * \brief Fills the current address window with a color whose bytes are equal, without the CPU
+ *
+ * \param color		Color, e.g. BLACK, WHITE or a gray like 0x8484
+ * \param len		Number of pixels
+ * \param callback	Called from the interrupt when done, may be NULL
+ *
+ * \return 1 if the transfer has started, 0 if the bus is busy, the bytes differ or len is 0
+ *
+ * \info With a band strip or a canvas selected the pixels go to RAM at once
+ *       and the callback is called before returning.
+ */
+uint8_t LCD_FloodStrobeAsync(uint16_t color, uint32_t len, void (*callback)(void)) {
+	uint8_t hi = color >> 8;
+
+	if (!len || (hi != (uint8_t) color))
+		return 0;
+#if defined (LCD_RAM_TARGET)
+	if (m_ram) {
+		LCD_Flood(color, len);
+		if (callback)
+			callback();
+		return 1;
 	}
+#endif
+	if (m_strobe_busy)
+		return 0;
+#if defined (USE_DMA)
+	if (m_dma_busy)
+		return 0;
+#endif
+	m_strobe_busy = 1;
+	m_strobe_callback = callback;
+
+	LCD_MemoryWriteStart();
+	LCD_SetBus8(hi);
+	LCD_WR_IDLE();
+	TIM5->EGR = TIM_EGR_UG;								// CNT = 0, CH2 high
+	TIM5->CR1 = TIM_CR1_CEN;							// waits for the gate
+	TIM2->ARR = len * 2 * LCD_WR_TIMER_PERIOD + 1;
+	TIM2->EGR = TIM_EGR_UG;								// CNT = 0, no interrupt (URS)
+	// WR -> TIM5_CH2
+	GPIOA->AFR[0] = (GPIOA->AFR[0] & ~GPIO_AFRL_AFSEL1) | (2U << GPIO_AFRL_AFSEL1_Pos);
+	GPIOA->MODER = (GPIOA->MODER & ~GPIO_MODER_MODER1) | GPIO_MODER_MODER1_1;
+#if defined (USE_BUS_STATS)
+	m_stats.wr_strobes += len * 2;
+#endif
+	TIM2->CR1 |= TIM_CR1_CEN;
+	return 1;
+}
+
+/**
+ * \brief Checks whether a timer flood is in progress
+ *
+ * \param
+ *
+ * \return 1 if busy, 0 otherwise
+ */
+uint8_t LCD_FloodStrobe_IsBusy(void) {
+	return m_strobe_busy;
+}
+
+/**
+ * \brief Timer flood complete handler, call from TIM2_IRQHandler()
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_FloodStrobe_IRQHandler(void) {
+	if (!(TIM2->SR & TIM_SR_UIF))
+		return;
+	TIM2->SR = ~TIM_SR_UIF;
+	if (!m_strobe_busy)
+		return;
+
+	TIM5->CR1 = 0;
+	// WR -> GPIO, its ODR bit is still high
+	GPIOA->MODER = (GPIOA->MODER & ~GPIO_MODER_MODER1) | GPIO_MODER_MODER1_0;
 	LCD_CS_IDLE();
-	LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+	LCD_ResetAddrWindow();
+	m_strobe_busy = 0;
+	if (m_strobe_callback)
+		m_strobe_callback();
 }
 #endif
 
@@ -2161,7 +3471,7 @@ void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile) {
  */
 void LCD_DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
 	// Bresenham's algorithm - thx wikpedia
-
+	// Pixels are emitted as runs along the major axis, one window per run
 	int16_t steep = abs(y1 - y0) > abs(x1 - x0);
 	if (steep) {
 		swap(x0, y0);
@@ -2173,11 +3483,19 @@ void LCD_DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color
 		swap(y0, y1);
 	}
 
-	int16_t dx, dy;
+	// Major and minor axis limits
+	int32_t wmax = (steep ? m_height : m_width) - 1;
+	int32_t hmax = (steep ? m_width : m_height) - 1;
+
+	// Trivial reject: both ends beyond the same screen edge
+	if ((x1 < 0) || (x0 > wmax) || ((y0 < 0) && (y1 < 0)) || ((y0 > hmax) && (y1 > hmax)))
+		return;
+
+	int32_t dx, dy;
 	dx = x1 - x0;
 	dy = abs(y1 - y0);
 
-	int16_t err = dx / 2;
+	int32_t err = dx / 2;
 	int16_t ystep;
 
 	if (y0 < y1) {
@@ -2186,18 +3504,66 @@ void LCD_DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color
 		ystep = -1;
 	}
 
-	for (; x0 <= x1; x0++) {
-		if (steep) {
-			LCD_DrawPixel(y0, x0, color);
+	// Clip to the visible range of steps k = x - x0. After k steps the
+	// minor axis has moved by m(k) = (k * dy - err + dx - 1) / dx, so the
+	// first and last steps with a visible minor coordinate follow directly.
+	int32_t kmin = (x0 < 0) ? -x0 : 0;
+	int32_t kmax = (x1 > wmax) ? wmax - x0 : dx;
+	if (dy) {
+		int32_t tmin, tmax;	// visible range of m(k)
+		if (ystep > 0) {
+			tmin = -y0;
+			tmax = hmax - y0;
 		} else {
-			LCD_DrawPixel(x0, y0, color);
+			tmin = y0 - hmax;
+			tmax = y0;
+		}
+		if (tmin > 0) {
+			int32_t k = ((uint32_t) err + (uint32_t) (tmin - 1) * dx) / dy + 1;
+			if (k > kmin)
+				kmin = k;
 		}
+		if (tmax < dy) {
+			int32_t k = ((uint32_t) err + (uint32_t) tmax * dx) / dy;
+			if (k < kmax)
+				kmax = k;
+		}
+	}
+	if (kmin > kmax)
+		return;
+
+	// Advance the Bresenham state to the first visible step
+	if (kmin) {
+		uint32_t m = ((uint32_t) kmin * dy + dx - 1 - err) / dx;
+		err = (uint32_t) err + m * dx - (uint32_t) kmin * dy;
+		y0 += ystep * (int16_t) m;
+		x0 += kmin;
+	}
+	x1 = x0 + (kmax - kmin);
+
+	LCD_BeginBatch();
+	int16_t start = x0;
+	for (; x0 <= x1; x0++) {
 		err -= dy;
 		if (err < 0) {
+			if (steep) {
+				LCD_DrawFastVLine(y0, start, x0 - start + 1, color);
+			} else {
+				LCD_DrawFastHLine(start, y0, x0 - start + 1, color);
+			}
+			start = x0 + 1;
 			y0 += ystep;
 			err += dx;
 		}
 	}
+	if (start <= x1) {
+		if (steep) {
+			LCD_DrawFastVLine(y0, start, x1 - start + 1, color);
+		} else {
+			LCD_DrawFastHLine(start, y0, x1 - start + 1, color);
+		}
+	}
+	LCD_EndBatch();
 }
 
 /**
@@ -2229,7 +3595,7 @@ void LCD_DrawFastHLine(int16_t x, int16_t y, int16_t length, uint16_t color) {
 
 	LCD_SetAddrWindow(x, y, x2, y);
 	LCD_Flood(color, length);
-	LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+	LCD_ResetAddrWindow();
 
 }
 
@@ -2260,7 +3626,7 @@ void LCD_DrawFastVLine(int16_t x, int16_t y, int16_t length, uint16_t color) {
 	}
 	LCD_SetAddrWindow(x, y, x, y2);
 	LCD_Flood(color, length);
-	LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+	LCD_ResetAddrWindow();
 }
 
 /**
@@ -2275,10 +3641,12 @@ void LCD_DrawFastVLine(int16_t x, int16_t y, int16_t length, uint16_t color) {
  * \return void
  */
 void LCD_DrawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+	LCD_BeginBatch();
 	LCD_DrawFastHLine(x, y, w, color);
 	LCD_DrawFastHLine(x, y + h - 1, w, color);
 	LCD_DrawFastVLine(x, y, h, color);
 	LCD_DrawFastVLine(x + w - 1, y, h, color);
+	LCD_EndBatch();
 }
 
 /**
@@ -2318,7 +3686,7 @@ void LCD_FillRect(int16_t x, int16_t y1, int16_t w, int16_t h, uint16_t color) {
 
 	LCD_SetAddrWindow(x, y1, x2, y2);
 	LCD_Flood(color, (uint32_t) w * (uint32_t) h);
-	LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+	LCD_ResetAddrWindow();
 }
 
 /**
@@ -2332,6 +3700,7 @@ void LCD_FillRect(int16_t x, int16_t y1, int16_t w, int16_t h, uint16_t color) {
  * \return void
  */
 void LCD_DrawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+	LCD_BeginBatch();
 	int16_t f = 1 - r;
 	int16_t ddF_x = 1;
 	int16_t ddF_y = -2 * r;
@@ -2362,6 +3731,7 @@ void LCD_DrawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
 		LCD_DrawPixel(x0 + y, y0 - x, color);
 		LCD_DrawPixel(x0 - y, y0 - x, color);
 	}
+	LCD_EndBatch();
 }
 
 /**
@@ -2376,6 +3746,7 @@ void LCD_DrawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
  * \return void
  */
 void LCD_DrawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername, uint16_t color) {
+	LCD_BeginBatch();
 	int16_t f = 1 - r;
 	int16_t ddF_x = 1;
 	int16_t ddF_y = -2 * r;
@@ -2408,6 +3779,7 @@ void LCD_DrawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername,
 			LCD_DrawPixel(x0 - x, y0 - y, color);
 		}
 	}
+	LCD_EndBatch();
 }
 
 /**
@@ -2421,8 +3793,86 @@ void LCD_DrawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername,
  * \return void
  */
 void LCD_FillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+	if (r <= LCD_FILL_SPANS_MAX_R) {
+		LCD_FillRoundSpans(x0, x0, y0, r, 0, color);
+		return;
+	}
+	LCD_BeginBatch();
 	LCD_DrawFastVLine(x0, y0 - r, 2 * r + 1, color);
 	LCD_FillCircleHelper(x0, y0, r, 3, 0, color);
+	LCD_EndBatch();
+}
+
+/**
+ * \brief Fills a circle split at its center by a rectangle, using horizontal spans
+ *
+ * \param xl		The x-coordinate of the left centers
+ * \param xr		The x-coordinate of the right centers (xl for a circle)
+ * \param y0		The y-coordinate of the top centers
+ * \param r			Radius, 0..LCD_FILL_SPANS_MAX_R
+ * \param delta		Bottom centers row - y0, 0 for a circle
+ * \param color		Color
+ *
+ * \return void
+ *
+ * \info Covers the same pixels as LCD_FillCircleHelper() plus the center rectangle.
+ *       Spans are drawn top to bottom and rows of equal width are merged into one rectangle.
+ */
+static void LCD_FillRoundSpans(int16_t xl, int16_t xr, int16_t y0, int16_t r, int16_t delta, uint16_t color) {
+	int16_t ext[LCD_FILL_SPANS_MAX_R + 1];	// half-width of the rows r = y0 - row
+	int16_t f = 1 - r;
+	int16_t ddF_x = 1;
+	int16_t ddF_y = -2 * r;
+	int16_t x = 0;
+	int16_t y = r;
+	int16_t d;
+
+	if (r < 0)
+		return;
+	for (d = 0; d <= r; d++)
+		ext[d] = 0;
+	while (x < y) {
+		if (f >= 0) {
+			y--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x++;
+		ddF_x += 2;
+		f += ddF_x;
+		// the column at x covers the rows up to y, the column at y those up to x
+		if (ext[y] < x)
+			ext[y] = x;
+		if (ext[x] < y)
+			ext[x] = y;
+	}
+	for (d = r - 1; d >= 0; d--) {
+		if (ext[d] < ext[d + 1])
+			ext[d] = ext[d + 1];
+	}
+
+	// Rows top to bottom: upper arc, middle, lower arc
+	int16_t ymid = y0 + ((delta > 0) ? delta : 0);
+	int16_t row = y0 - r;
+	int16_t start = row;
+	int16_t e = ext[r];
+	LCD_BeginBatch();
+	for (; row <= y0 + delta + r; row++) {
+		int16_t n;
+		if (row < y0)
+			n = ext[y0 - row];
+		else if (row <= ymid)
+			n = ext[0];
+		else
+			n = ext[row - y0 - delta];
+		if (n != e) {
+			LCD_FillRect(xl - e, start, xr - xl + 1 + 2 * e, row - start, color);
+			start = row;
+			e = n;
+		}
+	}
+	LCD_FillRect(xl - e, start, xr - xl + 1 + 2 * e, row - start, color);
+	LCD_EndBatch();
 }
 
 /**
@@ -2438,6 +3888,7 @@ void LCD_FillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
  * \return void
  */
 void LCD_FillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername, int16_t delta, uint16_t color) {
+	LCD_BeginBatch();
 	int16_t f = 1 - r;
 	int16_t ddF_x = 1;
 	int16_t ddF_y = -2 * r;
@@ -2463,6 +3914,7 @@ void LCD_FillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername,
 			LCD_DrawFastVLine(x0 - y, y0 - x, 2 * x + 1 + delta, color);
 		}
 	}
+	LCD_EndBatch();
 }
 
 /**
@@ -2479,9 +3931,73 @@ void LCD_FillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername,
  * \return void
  */
 void LCD_DrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+	LCD_BeginBatch();
 	LCD_DrawLine(x0, y0, x1, y1, color);
 	LCD_DrawLine(x1, y1, x2, y2, color);
 	LCD_DrawLine(x2, y2, x0, y0, color);
+	LCD_EndBatch();
+}
+
+/**
+ * \brief Fills one clipped scanline span, the address window is left set
+ *
+ * \param x1		The x-coordinate of the first pixel
+ * \param x2		The x-coordinate of the last pixel
+ * \param y			The y-coordinate
+ * \param color		Color
+ *
+ * \return void
+ */
+static inline void LCD_FillSpan(int16_t x1, int16_t x2, int16_t y, uint16_t color) {
+	if ((y < 0) || (y >= m_height) || (x1 >= m_width) || (x2 < 0) || (x1 > x2))
+		return;
+	if (x1 < 0)
+		x1 = 0;
+	if (x2 >= m_width)
+		x2 = m_width - 1;
+	LCD_SetAddrWindow(x1, y, x2, y);
+	LCD_Flood(color, x2 - x1 + 1);
+}
+
+/**
+ * \brief Starts an edge stepper k scanlines below its first point
+ *
+ * \param e			Edge stepper
+ * \param x0		The x-coordinate of the first point
+ * \param dx		x-distance to the last point
+ * \param dy		y-distance to the last point, greater than 0
+ * \param k			First scanline, relative to the first point
+ *
+ * \return void
+ */
+static inline void LCD_EdgeInit(LCD_EdgeStep *e, int16_t x0, int32_t dx, int32_t dy, int32_t k) {
+	int64_t v = (int64_t) dx * k;
+	e->x = x0 + v / dy;
+	e->rem = v % dy;
+	e->q = dx / dy;
+	e->r = dx % dy;
+	e->dy = dy;
+}
+
+/**
+ * \brief Steps an edge to the next scanline
+ *
+ * \param e			Edge stepper
+ *
+ * \return void
+ */
+static inline void LCD_EdgeNext(LCD_EdgeStep *e) {
+	e->x += e->q;
+	e->rem += e->r;
+	if (e->r >= 0) {
+		if (e->rem >= e->dy) {
+			e->rem -= e->dy;
+			e->x++;
+		}
+	} else if (e->rem <= -e->dy) {
+		e->rem += e->dy;
+		e->x--;
+	}
 }
 
 /**
@@ -2498,7 +4014,8 @@ void LCD_DrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2
  * \return void
  */
 void LCD_FillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
-	int16_t a, b, y, last;
+	int16_t a, b, y, yend;
+	int32_t last;
 
 	// Sort coordinates by Y order (y2 >= y1 >= y0)
 	if (y0 > y1) {
@@ -2514,63 +4031,189 @@ void LCD_FillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2
 		swap(x0, x1);
 	}
 
+	// Off-screen clipping
+	if ((y2 < 0) || (y0 >= m_height))
+		return;
+
 	if(y0 == y2) { // Handle awkward all-on-same-line case as its own thing
 		a = b = x0;
 		if(x1 < a)      a = x1;
 		else if(x1 > b) b = x1;
 		if(x2 < a)      a = x2;
 		else if(x2 > b) b = x2;
+		if (a < 0) a = 0;  // keep the length in range
+		if (b >= m_width) b = m_width - 1;
 		LCD_DrawFastHLine(a, y0, b - a + 1, color);
 		return;
 	}
 
-	int16_t	dx01 = x1 - x0,
-			dy01 = y1 - y0,
-			dx02 = x2 - x0,
-			dy02 = y2 - y0,
-			dx12 = x2 - x1,
-			dy12 = y2 - y1;
-	int32_t	sa   = 0,
-			sb   = 0;
+	LCD_BeginBatch();
+
+	// Edge crossings x0 + (x1 - x0) * (y - y0) / (y1 - y0), stepped per
+	// scanline with a quotient and a remainder instead of a division
+	LCD_EdgeStep ea, eb;
 
 	// For upper part of triangle, find scanline crossings for segments
 	// 0-1 and 0-2.  If y1=y2 (flat-bottomed triangle), the scanline y1
-	// is included here (and second loop will be skipped, avoiding a /0
-	// error there), otherwise scanline y1 is skipped here and handled
-	// in the second loop...which also avoids a /0 error here if y0=y1
-	// (flat-topped triangle).
+	// is included here (and second part will be skipped), otherwise
+	// scanline y1 is skipped here and handled in the second part...
+	// which also keeps segment 0-1 out of it if y0=y1 (flat-topped triangle).
 	if (y1 == y2) last = y1;   // Include y1 scanline
 	else last = y1 - 1; // Skip it
 
-	for(y = y0; y <= last; y++) {
-		a = x0 + sa / dy01;
-		b = x0 + sb / dy02;
-		sa += dx01;
-		sb += dx02;
-		/* longhand:
-		a = x0 + (x1 - x0) * (y - y0) / (y1 - y0);
-		b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
-		*/
-		if(a > b) swap(a,b);
-		LCD_DrawFastHLine(a, y, b-a+1, color);
+	// Only the scanlines 0..m_height-1 are stepped, edges starting above
+	// the screen begin at its first one
+	y = (y0 < 0) ? 0 : y0;
+	yend = (y2 >= m_height) ? m_height - 1 : y2;
+	if (last > yend) last = yend;
+
+	LCD_EdgeInit(&eb, x0, x2 - x0, y2 - y0, y - y0);
+	if (y <= last) {
+		LCD_EdgeInit(&ea, x0, x1 - x0, y1 - y0, y - y0);
+		for(; y <= last; y++) {
+			a = ea.x;
+			b = eb.x;
+			LCD_EdgeNext(&ea);
+			LCD_EdgeNext(&eb);
+			if(a > b) swap(a,b);
+			LCD_FillSpan(a, b, y, color);
+		}
 	}
 
 	// For lower part of triangle, find scanline crossings for segments
-	// 0-2 and 1-2.  This loop is skipped if y1=y2.
-	sa = dx12 * (y - y1);
-	sb = dx02 * (y - y0);
-	for(; y <= y2; y++) {
-		a = x1 + sa / dy12;
-		b = x0 + sb / dy02;
-		sa += dx12;
-		sb += dx02;
-		/* longhand:
-		a = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
-		b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
-		*/
-		if(a > b) swap(a,b);
-		LCD_DrawFastHLine(a, y, b - a + 1, color);
+	// 0-2 and 1-2.  This part is skipped if y1=y2.
+	if (y <= yend) {
+		LCD_EdgeInit(&ea, x1, x2 - x1, y2 - y1, y - y1);
+		for(; y <= yend; y++) {
+			a = ea.x;
+			b = eb.x;
+			LCD_EdgeNext(&ea);
+			LCD_EdgeNext(&eb);
+			if(a > b) swap(a,b);
+			LCD_FillSpan(a, b, y, color);
+		}
+	}
+	LCD_ResetAddrWindow();
+	LCD_EndBatch();
+}
+
+/**
+ * \brief Draws a filled polygon
+ *
+ * \param xy		Vertices as x, y pairs: x0, y0, x1, y1, ...
+ * \param n			Number of vertices, 3..LCD_POLYGON_MAX_VERTICES
+ * \param rule		LCD_FILL_EVENODD or LCD_FILL_NONZERO
+ * \param color		Color
+ *
+ * \return void
+ *
+ * \info Pixels whose centers lie inside the outline are filled, so polygons
+ *       sharing an edge do not overlap.
+ */
+void LCD_FillPolygon(const int16_t *xy, uint8_t n, uint8_t rule, uint16_t color) {
+	// The crossing of an edge with the center of scanline y = y1 + k is
+	// x = x1 + (2k + 1) * dx / (2 * dy). The first pixel whose center lies at
+	// or right of it, ceil(x - 0.5) = -floor(m / den) with m = -(2 * x1 * dy
+	// + (2k + 1) * dx - dy) and den = 2 * dy, is stepped exactly per scanline.
+	struct {
+		int32_t q;			// floor(m / den), -first pixel
+		int32_t rem;		// m - q * den, 0..den-1
+		int32_t qs, rs;		// -2 * dx = qs * den + rs, rs = 0..den-1
+		int32_t den;
+		int16_t y1, y2;		// covered scanlines: y1 <= y < y2
+		int8_t dir;			// +1 downwards, -1 upwards
+	} edges[LCD_POLYGON_MAX_VERTICES];
+	int16_t xs[LCD_POLYGON_MAX_VERTICES];
+	int8_t dirs[LCD_POLYGON_MAX_VERTICES];
+	uint8_t i, j = 0, k, ne = 0;
+	int16_t y, ymin = INT16_MAX, ymax = INT16_MIN;
+
+	if ((n < 3) || (n > LCD_POLYGON_MAX_VERTICES))
+		return;
+
+	// Edge table, horizontal edges never cross a scanline center
+	for (i = 0; i < n; i++) {
+		int16_t x1 = xy[2 * i], y1 = xy[2 * i + 1];
+		k = (i + 1 == n) ? 0 : i + 1;
+		int16_t x2 = xy[2 * k], y2 = xy[2 * k + 1];
+		int8_t dir = 1;
+		if (y1 == y2)
+			continue;
+		if (y1 > y2) {
+			swap(x1, x2);
+			swap(y1, y2);
+			dir = -1;
+		}
+		int32_t dx = x2 - x1, dy = y2 - y1, den = 2 * dy;
+		// Edges starting above the screen begin at its first scanline
+		int16_t ys = (y1 < 0) ? 0 : y1;
+		int64_t m = -(2 * (int64_t) x1 * dy + (2 * (int64_t) (ys - y1) + 1) * dx - dy);
+		edges[ne].q = m / den;
+		edges[ne].rem = m % den;
+		if (edges[ne].rem < 0) {
+			edges[ne].rem += den;
+			edges[ne].q--;
+		}
+		edges[ne].qs = (-2 * dx) / den;
+		edges[ne].rs = (-2 * dx) % den;
+		if (edges[ne].rs < 0) {
+			edges[ne].rs += den;
+			edges[ne].qs--;
+		}
+		edges[ne].den = den;
+		edges[ne].y1 = ys;
+		edges[ne].y2 = y2;
+		edges[ne].dir = dir;
+		if (y1 < ymin) ymin = y1;
+		if (y2 > ymax) ymax = y2;
+		ne++;
+	}
+	if (!ne)
+		return;
+	if (ymin < 0)
+		ymin = 0;
+	if (ymax > m_height)
+		ymax = m_height;
+
+	LCD_BeginBatch();
+	for (y = ymin; y < ymax; y++) {
+		// Active edges, sorted by crossing
+		k = 0;
+		for (i = 0; i < ne; i++) {
+			if ((y < edges[i].y1) || (y >= edges[i].y2))
+				continue;
+			int16_t x = -edges[i].q;
+			edges[i].q += edges[i].qs;
+			edges[i].rem += edges[i].rs;
+			if (edges[i].rem >= edges[i].den) {
+				edges[i].rem -= edges[i].den;
+				edges[i].q++;
+			}
+			for (j = k; (j > 0) && (xs[j - 1] > x); j--) {
+				xs[j] = xs[j - 1];
+				dirs[j] = dirs[j - 1];
+			}
+			xs[j] = x;
+			dirs[j] = edges[i].dir;
+			k++;
+		}
+
+		// A pixel is inside if the edges left of its center say so
+		int16_t wind = 0;
+		for (i = 0; i < k; i++) {
+			int16_t prev = wind;
+			if (rule == LCD_FILL_NONZERO)
+				wind += dirs[i];
+			else
+				wind ^= 1;
+			if (!prev && wind)
+				j = i;
+			else if (prev && !wind)
+				LCD_FillSpan(xs[j], xs[i] - 1, y, color);
+		}
 	}
+	LCD_ResetAddrWindow();
+	LCD_EndBatch();
 }
 
 /**
@@ -2587,6 +4230,7 @@ void LCD_FillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2
  */
 void LCD_DrawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) {
 	// smarter version
+	LCD_BeginBatch();
 	LCD_DrawFastHLine(x + r, y, w - 2 * r, color); // Top
 	LCD_DrawFastHLine(x + r, y + h - 1, w - 2 * r, color); // Bottom
 	LCD_DrawFastVLine(x, y + r, h - 2 * r, color); // Left
@@ -2596,6 +4240,7 @@ void LCD_DrawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, ui
 	LCD_DrawCircleHelper(x + w - r - 1, y + r, r, 2, color);
 	LCD_DrawCircleHelper(x + w - r - 1, y + h - r - 1, r, 4, color);
 	LCD_DrawCircleHelper(x + r, y + h - r - 1, r, 8, color);
+	LCD_EndBatch();
 }
 
 /**
@@ -2611,12 +4256,18 @@ void LCD_DrawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, ui
  * \return void
  */
 void LCD_FillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) {
-	// smarter version
+	// smarter version, corners that meet (2 * r >= w or h) take the column path
+	if ((r >= 0) && (r <= LCD_FILL_SPANS_MAX_R) && (w > 2 * r) && (h > 2 * r)) {
+		LCD_FillRoundSpans(x + r, x + w - r - 1, y + r, r, h - 2 * r - 1, color);
+		return;
+	}
+	LCD_BeginBatch();
 	LCD_FillRect(x + r, y, w - 2 * r, h, color);
 
 	// draw four corners
 	LCD_FillCircleHelper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
 	LCD_FillCircleHelper(x + r, y + r, r, 2, h - 2 * r - 1, color);
+	LCD_EndBatch();
 }
 
 
@@ -2694,14 +4345,14 @@ static inline uint8_t LCD_Color565_to_B(uint16_t color) {
  * \return void
  */
 void LCD_DrawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t fontindex) {
-	uint16_t height, width, bytes;
-	uint8_t offset;
+	int16_t height, width, bytes;
 	uint32_t charindex = 0;
 	uint8_t *pchar;
 	uint32_t line = 0;
+	uint32_t px = 0;
 
-	height = fonts[fontindex]->Height;
-	width = fonts[fontindex]->Width;
+	height = fonts[fontindex]->Height * m_scale;
+	width = fonts[fontindex]->Width * m_scale;
 
 	if ((x >= m_width) || // Clip right
 		(y >= m_height) || // Clip bottom
@@ -2709,16 +4360,25 @@ void LCD_DrawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_
 		((y + height - 1) < 0))   // Clip top
 		return;
 
-	bytes = (width + 7) / 8;
+	bytes = (fonts[fontindex]->Width + 7) / 8;
 	if (c < ' ') c = ' ';
 #ifndef USE_CP1251
 	else if (c > '~') c = ' ';
 #endif
-	charindex = (c - ' ') * height * bytes;
-	offset = 8 * bytes - width;
-
-	for (uint32_t i = 0; i < height; i++) {
-		pchar = ((uint8_t *) &fonts[fontindex]->table[charindex] + (width + 7) / 8 * i);
+	charindex = (c - ' ') * fonts[fontindex]->Height * bytes;
+
+	// Visible part of the (scaled) glyph, in glyph coordinates
+	int16_t col0 = (x < 0) ? -x : 0;
+	int16_t row0 = (y < 0) ? -y : 0;
+	int16_t col1 = (x + width > m_width) ? m_width - x : width;
+	int16_t row1 = (y + height > m_height) ? m_height - y : height;
+
+	// One address window for the whole glyph, then stream its pixels,
+	// repeating every glyph row and column m_scale times
+	LCD_SetAddrWindow(x + col0, y + row0, x + col1 - 1, y + row1 - 1);
+	LCD_MemoryWriteStart();
+	for (int16_t i = row0; i < row1; i++) {
+		pchar = ((uint8_t *) &fonts[fontindex]->table[charindex] + bytes * (i / m_scale));
 		switch (bytes) {
 		case 1:
 			line = pchar[0];
@@ -2731,26 +4391,19 @@ void LCD_DrawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_
 			line = (pchar[0] << 16) | (pchar[1] << 8) | pchar[2];
 			break;
 		}
-		if (m_scale) {
-			for (uint32_t j = 0; j < width * 2; j+=2) {
-				if (line & (1 << (width - j / 2 + offset - 1))) {
-					LCD_FillRect(x + j, y, 2, 2, color);
-				} else {
-					LCD_FillRect(x + j, y, 2, 2, bg);
-				}
-			}
-			y+=2;
-		} else {
-			for (uint32_t j = 0; j < width; j++) {
-				if (line & (1 << (width - j + offset - 1))) {
-					LCD_DrawPixel((x + j), y, color);
-				} else {
-					LCD_DrawPixel((x + j), y, bg);
-				}
+		uint32_t mask = 1UL << (8 * bytes - 1 - col0 / m_scale);
+		uint8_t repeat = m_scale - col0 % m_scale;
+		for (int16_t j = col0; j < col1; j++) {
+			LCD_WriteColor((line & mask) ? color : bg);
+			LCD_YIELD_PX(px, 0);
+			if (--repeat == 0) {
+				repeat = m_scale;
+				mask >>= 1;
 			}
-			y++;
 		}
 	}
+	LCD_CS_IDLE();
+	LCD_ResetAddrWindow();
 }
 
 /**
@@ -2773,15 +4426,13 @@ void LCD_Printf(const char *fmt, ...) {
 	volatile uint16_t height, width;
 	height = fonts[m_font]->Height;
 	width = fonts[m_font]->Width;
-	if (m_scale) {
-		height *= 2;
-		width *= 2;
-	}
+	height *= m_scale;
+	width *= m_scale;
 	p = buf;
+	LCD_BeginBatch();
 	while (*p) {
 		if (*p == '\n') {
-			m_cursor_y += height;
-			m_cursor_x = 0;
+			LCD_NewLine(height);
 		} else if (*p == '\r') {
 			m_cursor_x = 0;
 		} else if (*p == '\t') {
@@ -2791,25 +4442,179 @@ void LCD_Printf(const char *fmt, ...) {
 			if (m_cursor_x == 0) {
 				LCD_SetAddrWindow(0, m_cursor_y, m_width - 1, m_cursor_y + height);
 				LCD_Flood(m_textbgcolor, (long) m_width * height);
-				LCD_SetAddrWindow(0, 0, m_width - 1, m_height - 1);
+				LCD_ResetAddrWindow();
 			}
 #endif
-			if (m_cursor_y >= (m_height - height)) {
+			if (!LCD_CONSOLE_ON && (m_cursor_y >= (m_height - height))) {
 				m_cursor_y = 0;
 #ifdef WIPE_SCREEN
 				LCD_FillScreen(m_textbgcolor);
 #endif
 			}
 			LCD_DrawChar(m_cursor_x, m_cursor_y, *p, m_textcolor, m_textbgcolor, m_font);
+#if defined (USE_TOUCH_ARBITER)
+			LCD_Yield(0, 0);
+#endif
 			m_cursor_x += width;
 			if (m_wrap && (m_cursor_x > (m_width - width))) {
-				m_cursor_y += height;
-				m_cursor_x = 0;
+				LCD_NewLine(height);
 			}
 		}
 		p++;
 	}
+	LCD_EndBatch();
+}
+
+/**
+ * \brief Moves the cursor to the start of the next text line
+ *
+ * \param height	Line height
+ *
+ * \return void
+ *
+ * \info On the last console line the screen scrolls by one line instead: the top
+ *       line is cleared and shown again at the bottom, nothing else is redrawn.
+ */
+static void LCD_NewLine(uint16_t height) {
+	m_cursor_x = 0;
+#if defined (USE_SCROLL_CONSOLE)
+	if (m_con_lines) {
+		if (m_con_line + 1 < m_con_lines) {
+			m_con_line++;
+		} else {
+			LCD_FillRect(0, m_con_top + m_con_offset, m_width, m_con_lh, m_textbgcolor);
+			m_con_offset += m_con_lh;
+			if (m_con_offset == m_con_rows)
+				m_con_offset = 0;
+			LCD_ScrollConsoleStart();
+		}
+		m_cursor_y = m_con_top + (m_con_offset + m_con_line * m_con_lh) % m_con_rows;
+		return;
+	}
+#endif
+	m_cursor_y += height;
+}
+
+#if defined (USE_SCROLL_CONSOLE)
+/*
+ *  VSCRDEF and VSCRSADD count frame memory lines, which run against the rows
+ *  when MADCTL MY is set: the header is then the bottom fixed area and the
+ *  scrolling start moves backwards. The three VSCRDEF areas must add up to
+ *  all lines of the frame memory, which may be more than TFTHEIGHT.
+ */
+#if !(defined(ILI9340) || defined(ILI9340_INV) || defined(ILI9341) || defined(ILI9341_00) \
+		|| defined(ILI9486) || defined(UNKNOWN1602))
+#error Error in lcd.c: USE_SCROLL_CONSOLE requires an ILI934x or ILI9486 command set
+#endif
+#if defined(ILI9340_INV) || defined(UNKNOWN1602)
+#define LCD_SCROLL_MY			(m_rotation == 0)
+#else
+#define LCD_SCROLL_MY			(m_rotation == 2)
+#endif
+#if defined(ILI9486)
+#define LCD_SCROLL_LINES		480
+#else
+#define LCD_SCROLL_LINES		320
+#endif
+
+/**
+ * \brief Writes the scrolling start address for m_con_offset
+ *
+ * \param
+ *
+ * \return void
+ */
+static void LCD_ScrollConsoleStart(void) {
+	uint16_t tfa, vsp;
+	if (LCD_SCROLL_MY) {
+		tfa = LCD_SCROLL_LINES - m_con_top - m_con_rows;
+		vsp = tfa + (m_con_offset ? m_con_rows - m_con_offset : 0);
+	} else {
+		tfa = m_con_top;
+		vsp = tfa + m_con_offset;
+	}
+	LCD_CS_ACTIVE();
+	LCD_Write16Register8(ILI9341_VSCRSADD, vsp);
+	LCD_CS_IDLE();
+}
+
+/**
+ * \brief Turns the console off and shows the frame memory unscrolled
+ *
+ * \param
+ *
+ * \return void
+ */
+static void LCD_ScrollConsoleReset(void) {
+	m_con_lines = 0;
+	LCD_CS_ACTIVE();
+	LCD_Write32Register8(ILI9341_VSCRDEF, LCD_SCROLL_LINES);
+	LCD_Write8(0);
+	LCD_Write8(0);
+	LCD_Write16Register8(ILI9341_VSCRSADD, 0);
+	LCD_CS_IDLE();
+}
+
+/**
+ * \brief Turns LCD_Printf() into a console that scrolls with the hardware
+ *        vertical scrolling between a fixed header and footer
+ *
+ * \param top		Header height in pixels, not scrolled
+ * \param bottom	Footer height in pixels, not scrolled
+ *
+ * \return uint8_t 1 - console on, 0 - landscape rotation or no room for a line,
+ *         a console that was on is then turned off and its scrolling reset
+ *
+ * \info The line height is taken from the current font and scale. The scrolling
+ *       area is rounded down to whole lines, the rest is added to the footer.
+ *       The area is cleared and the cursor goes to its first line. Call it
+ *       again after LCD_SetRotation().
+ */
+uint8_t LCD_ScrollConsole(uint16_t top, uint16_t bottom) {
+	uint16_t lh = fonts[m_font]->Height * m_scale;
+	if ((m_rotation & 1) || (top + bottom + lh > TFTHEIGHT)) {
+		if (m_con_lines)
+			LCD_ScrollConsoleReset();
+		return 0;
+	}
+	m_con_top = top;
+	m_con_lh = lh;
+	m_con_lines = (TFTHEIGHT - top - bottom) / lh;
+	m_con_rows = m_con_lines * lh;
+	m_con_line = 0;
+	m_con_offset = 0;
+
+	uint16_t tfa = LCD_SCROLL_MY ? LCD_SCROLL_LINES - top - m_con_rows : top;
+	uint16_t bfa = LCD_SCROLL_LINES - tfa - m_con_rows;
+	LCD_CS_ACTIVE();
+	LCD_Write32Register8(ILI9341_VSCRDEF, ((uint32_t) tfa << 16) | m_con_rows);
+	LCD_Write8(bfa >> 8);
+	LCD_Write8(bfa);
+	LCD_CS_IDLE();
+	LCD_ScrollConsoleStart();
+
+	LCD_FillRect(0, m_con_top, m_width, m_con_rows, m_textbgcolor);
+	m_cursor_x = 0;
+	m_cursor_y = m_con_top;
+	return 1;
+}
+
+/**
+ * \brief Turns the console off, resets the scrolling and clears its area
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_ScrollConsoleEnd(void) {
+	if (!m_con_lines)
+		return;
+	LCD_ScrollConsoleReset();
+	LCD_FillRect(0, m_con_top, m_width, m_con_rows, m_textbgcolor);
+	m_cursor_x = 0;
+	m_cursor_y = m_con_top;
 }
+#endif
 
 /**
  * \brief Sets the cursor coordinates
@@ -2818,10 +4623,17 @@ void LCD_Printf(const char *fmt, ...) {
  * \param y		The y-coordinate
  *
  * \return void
+ *
+ * \info Inside the LCD_ScrollConsole() area the console goes on from the line that holds row y.
  */
 void LCD_SetCursor(uint16_t x, uint16_t y) {
 	m_cursor_x = x;
 	m_cursor_y = y;
+#if defined (USE_SCROLL_CONSOLE)
+	// the console goes on from the line that holds row y
+	if (m_con_lines && (y >= m_con_top) && (y < m_con_top + m_con_rows))
+		m_con_line = ((y - m_con_top + m_con_rows - m_con_offset) % m_con_rows) / m_con_lh;
+#endif
 }
 
 /**
@@ -2906,7 +4718,35 @@ void LCD_SetTextWrap(uint8_t w) {
  * \return void
  */
 void LCD_SetTextScaled(uint8_t s) {
-	m_scale = s;
+	m_scale = s ? 2 : 1;
+}
+
+/**
+ * \brief Sets the integer text scale factor
+ *
+ * \param s		Scale factor (1..8), every glyph pixel is drawn as s x s block
+ *
+ * \return void
+ */
+void LCD_SetTextScale(uint8_t s) {
+	if (s < 1) {
+		m_scale = 1;
+	} else if (s > 8) {
+		m_scale = 8;
+	} else {
+		m_scale = s;
+	}
+}
+
+/**
+ * \brief Gets the integer text scale factor
+ *
+ * \param
+ *
+ * \return uint8_t scale factor
+ */
+uint8_t LCD_GetTextScale(void) {
+	return m_scale;
 }
 
 #pragma GCC pop_options
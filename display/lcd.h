@@ -92,15 +92,68 @@ POSSIBILITY OF SUCH DAMAGE.
 // Uncomment to add FatFs support for drawing BMPs from SD Card
 //#define USE_FATFS
 
+// Uncomment to let LCD_Printf() scroll a console with the hardware vertical scrolling
+// (ILI934x/ILI9486, portrait only), see LCD_ScrollConsole()
+//#define USE_SCROLL_CONSOLE
+
 // Uncomment to use mpaland printf (faster and lighter) instead of libc printf
 // Source: https://github.com/mpaland/printf/
 #define USE_MPALAND_PRINTF
 
-// Uncomment to use lookup table for data output (average x2 increase in FPS, +3kB RAM)
+// Uncomment to use lookup table for data output (average x2 increase in FPS, +3kB flash)
 // FillScreen(0x051F) @ 180 MHz with lookup table    -O0: 25.5 FPS, -O2: 54.5 FPS
 // FillScreen(0x051F) @ 180 MHz without lookup table -O0: 16 FPS,   -O2: 24 FPS
+// (measured with the table in SRAM)
 #define USE_LOOKUP
 
+// Keeps the lookup table in SRAM (+3kB RAM, copied by the startup code).
+// Comment out to read it from flash through the ART accelerator, whose data cache
+// is only 8 lines of 128 bits: fills of one color hit it, byte streams (text, BMPs)
+// may not. Leave SRAM as the default until USE_LOOKUP_BENCH shows flash is as fast.
+#define USE_LOOKUP_RAM
+
+// Uncomment to time LCD_FillScreen() and a screen of text with the DWT cycle counter
+// at start-up (Src/main.c), build with and without USE_LOOKUP_RAM to compare
+//#define USE_LOOKUP_BENCH
+
+// Uncomment to draw frames through a RAM strip with LCD_RenderBands()
+// (a full 240x320 framebuffer does not fit the 128kB SRAM)
+//#define USE_BAND_RENDER
+
+// Uncomment to let the drawing functions report their bounding boxes to lcd_dirty.h
+// between LCD_ReportBegin() and LCD_ReportEnd()
+//#define USE_DIRTY_RECTS
+
+// Uncomment to draw into an 8bpp indexed canvas (240x320 = 76.8kB) selected with LCD_CanvasBegin()
+// LCD_CanvasFlush() sends only the dirty rows, LCD_CanvasSetPalette() re-colors the screen
+//#define USE_CANVAS8
+#define LCD_CANVAS_MERGE_PX	8		// pixels per row a flush may resend to join dirty rows
+
+// Uncomment to count bus transactions (WR strobes, commands, address windows, CS toggles)
+// Read the counters with LCD_GetBusStats() to compare the bus cost of drawing functions
+//#define USE_BUS_STATS
+
+// Uncomment to stream pixels with DMA2 and TIM8 instead of the CPU (requires USE_LOOKUP)
+// Call LCD_DMA_IRQHandler() from DMA2_Stream7_IRQHandler()
+//#define USE_DMA
+#define LCD_DMA_CHUNK		64		// bytes per half of the double buffer, 1.5kB RAM
+#define LCD_DMA_PERIOD		24		// TIM8 ticks per byte: 180MHz / 24 = 7.5 MB/s
+
+// Uncomment to let TIM5 strobe WR (PA1 as TIM5_CH2) for colors with equal bytes, gated by TIM2
+// Call LCD_FloodStrobe_IRQHandler() from TIM2_IRQHandler()
+//#define USE_WR_TIMER
+#define LCD_WR_TIMER_PERIOD	12		// TIM5 ticks per byte: 90MHz / 12 = 7.5 MB/s
+
+// Uncomment to let lcd_touch.c own the pins shared with the touch panel (ILI934x/ILI9486):
+// drawing switches to LCD_MODE_DRAW by itself, LCD_Touch_Read() back to LCD_MODE_TOUCH,
+// and floods, bitmaps, pixel blocks, band and canvas pushes and text pause every
+// LCD_ARBITER_CHUNK_PX pixels to take a touch sample once LCD_ARBITER_BUDGET_US
+// has passed since the last one.
+// The DMA and WR timer floods are not split.
+//#define USE_TOUCH_ARBITER
+#define LCD_ARBITER_BUDGET_US	5000	// touch sample period while drawing
+#define LCD_ARBITER_CHUNK_PX	256		// pixels between budget checks
+
 #if !(defined(ILI9325) || defined(ILI9328) || defined(ILI9340) || defined(ILI9340_INV) \
 		|| defined(ILI9341) || defined(ILI9341_00) || defined(ILI9486) \
 		|| defined(R61505) || defined(R61505V) || defined(R61520) || defined(S6D0154) \
@@ -122,6 +175,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TFTWIDTH			240
 #define TFTHEIGHT			320
 
+#define LCD_FILL_EVENODD			0
+#define LCD_FILL_NONZERO			1
+#define LCD_POLYGON_MAX_VERTICES	16		// LCD_FillPolygon() keeps its edges on the stack
+
 #define	BLACK				0x0000
 #define	BLUE				0x001F
 #define	RED					0xF800
@@ -132,6 +189,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #define WHITE				0xFFFF
 #define LIGHTGRAY			0xCDB6
 
+#if defined (USE_BUS_STATS)
+typedef struct {
+	uint32_t wr_strobes;	// WR strobes, i.e. bytes clocked into the LCD
+	uint32_t commands;		// command (CD low) phases
+	uint32_t addr_windows;	// LCD_SetAddrWindow() calls
+	uint32_t cs_toggles;	// CS activations
+} LCD_BusStats;
+#endif
+
 /* =========================================================================== */
 /* ============================ BASIC FUNCTIONS ============================== */
 /* =========================================================================== */
@@ -205,6 +271,38 @@ void LCD_SetRotation(uint8_t x);
  */
 uint8_t LCD_GetRotation(void);
 
+/**
+ * \brief Starts a bus batch: CS stays active until the matching LCD_EndBatch()
+ *
+ * \param
+ *
+ * \return void
+ *
+ * \info Batches nest, only the outermost pair toggles CS.
+ *       Do not switch the shared pins to touch mode inside a batch.
+ */
+void LCD_BeginBatch(void);
+
+/**
+ * \brief Ends a bus batch started with LCD_BeginBatch()
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_EndBatch(void);
+
+/**
+ * \brief Tells whether the LCD holds CS active past the current call
+ *
+ * \param
+ *
+ * \return uint8_t 1 - a batch, a DMA or a WR timer transfer is running
+ *
+ * \info The pins shared with the touch panel must not change meanwhile
+ */
+uint8_t LCD_IsBusBusy(void);
+
 /**
  * \brief Sets window address
  *
@@ -239,6 +337,238 @@ void LCD_DrawBMP(int16_t xPos, int16_t yPos, const uint8_t *pBmp);
 void LCD_DrawBMPFromFile(int16_t xPos, int16_t yPos, FIL * pFile);
 #endif
 
+/**
+ * \brief Writes a block of RGB565 pixels from a caller-owned buffer
+ *
+ * \param x			The x-coordinate of the upper-left corner of the block
+ * \param y			The y-coordinate of the upper-left corner of the block
+ * \param w			Width of the block
+ * \param h			Height of the block
+ * \param pixels	Row-major RGB565 pixels, w * h entries
+ *
+ * \return void
+ */
+void LCD_WritePixels(int16_t x, int16_t y, int16_t w, int16_t h, const uint16_t *pixels);
+
+/**
+ * \brief Writes a block of RGB565 pixels from a caller-owned buffer with a row stride
+ *
+ * \param x			The x-coordinate of the upper-left corner of the block
+ * \param y			The y-coordinate of the upper-left corner of the block
+ * \param w			Width of the block
+ * \param h			Height of the block
+ * \param pixels	Row-major RGB565 pixels
+ * \param stride	Distance between the starts of two rows, in pixels
+ *
+ * \return void
+ */
+void LCD_WritePixelsStride(int16_t x, int16_t y, int16_t w, int16_t h, const uint16_t *pixels, uint16_t stride);
+
+#if defined (USE_BAND_RENDER)
+/**
+ * \brief Draws a frame through a RAM strip, one band of rows at a time
+ *
+ * \param buf		Strip buffer, width * rows pixels (240 or 320 wide, by rotation)
+ * \param rows		Rows per band
+ * \param draw		Draws the whole frame, called once per band
+ *
+ * \return void
+ *
+ * \info Inside draw() the drawing functions write to the strip, which is then
+ *       pushed with one address window. Overdraw only costs RAM bandwidth.
+ *       The text cursor, colors, font and size are restored before each band.
+ *       The strip is not cleared between bands, draw() must cover every pixel
+ *       of the frame (start it with LCD_FillScreen(), for example).
+ *       LCD_DrawBMP() and LCD_DrawBMPFromFile() are skipped inside draw(),
+ *       the async fills write to the strip at once.
+ */
+void LCD_RenderBands(uint16_t *buf, uint16_t rows, void (*draw)(void));
+#endif
+
+#if defined (USE_DIRTY_RECTS)
+/**
+ * \brief Starts reporting: the drawing functions add their bounding boxes to
+ *        the dirty list (lcd_dirty.h) instead of drawing
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_ReportBegin(void);
+
+/**
+ * \brief Ends reporting, the drawing functions write to the bus again
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_ReportEnd(void);
+#endif
+
+#if defined (USE_CANVAS8)
+/**
+ * \brief Selects an 8bpp indexed canvas as the target of the drawing functions
+ *
+ * \param buf		Canvas, 240 * 320 bytes, row-major in the current rotation
+ * \param palette	256 RGB565 colors, must stay valid while the canvas is selected
+ *
+ * \return void
+ *
+ * \info Colors passed to the drawing functions are palette indices (low byte)
+ *       until LCD_CanvasEnd(). The whole canvas is marked dirty.
+ */
+void LCD_CanvasBegin(uint8_t *buf, const uint16_t *palette);
+
+/**
+ * \brief Deselects the canvas, the drawing functions write to the bus again
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_CanvasEnd(void);
+
+/**
+ * \brief Replaces the palette and marks the whole canvas dirty
+ *
+ * \param palette	256 RGB565 colors
+ *
+ * \return void
+ *
+ * \info Call it again after changing the current palette in place.
+ *       The next LCD_CanvasFlush() re-colors the screen without redrawing.
+ */
+void LCD_CanvasSetPalette(const uint16_t *palette);
+
+/**
+ * \brief Streams the dirty parts of the canvas to the LCD through the palette
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_CanvasFlush(void);
+#endif
+
+#if defined (USE_BUS_STATS)
+/**
+ * \brief Copies the bus transaction counters accumulated since the last reset
+ *
+ * \param stats	Pointer to the structure to fill
+ *
+ * \return void
+ */
+void LCD_GetBusStats(LCD_BusStats *stats);
+
+/**
+ * \brief Resets the bus transaction counters
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_ResetBusStats(void);
+#endif
+
+#if defined (USE_DMA)
+/* =========================================================================== */
+/* ============================ DMA FUNCTIONS ================================ */
+/* =========================================================================== */
+
+/**
+ * \brief Fills the current address window with color, without the CPU
+ *
+ * \param color		Color
+ * \param len		Number of pixels
+ * \param callback	Called from the interrupt when done, may be NULL
+ *
+ * \return 1 if the transfer has started, 0 if the bus is busy or len is 0
+ *
+ * \info Do not call other LCD functions until the transfer is done.
+ *       With a band strip or a canvas selected the pixels go to RAM at once
+ *       and the callback is called before returning.
+ */
+uint8_t LCD_FloodAsync(uint16_t color, uint32_t len, void (*callback)(void));
+
+/**
+ * \brief Writes a block of RGB565 pixels with a row stride, without the CPU
+ *
+ * \param x			The x-coordinate of the upper-left corner of the block
+ * \param y			The y-coordinate of the upper-left corner of the block
+ * \param w			Width of the block
+ * \param h			Height of the block
+ * \param pixels	Row-major RGB565 pixels, must stay valid until the callback
+ * \param stride	Distance between the starts of two rows, in pixels
+ * \param callback	Called from the interrupt when done, may be NULL
+ *
+ * \return 1 if the transfer has started, 0 if the bus is busy or the block is off-screen
+ *
+ * \info Do not call other LCD functions until the transfer is done.
+ *       With a band strip or a canvas selected the pixels go to RAM at once
+ *       and the callback is called before returning.
+ */
+uint8_t LCD_WritePixelsAsync(int16_t x, int16_t y, int16_t w, int16_t h, const uint16_t *pixels,
+		uint16_t stride, void (*callback)(void));
+
+/**
+ * \brief Checks whether a DMA transfer is in progress
+ *
+ * \param
+ *
+ * \return 1 if busy, 0 otherwise
+ */
+uint8_t LCD_DMA_IsBusy(void);
+
+/**
+ * \brief Chunk complete handler, call from DMA2_Stream7_IRQHandler()
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_DMA_IRQHandler(void);
+#endif
+
+#if defined (USE_WR_TIMER)
+/* =========================================================================== */
+/* ========================= WR TIMER FUNCTIONS ============================== */
+/* =========================================================================== */
+
+/**
+ * \brief Fills the current address window with a color whose bytes are equal, without the CPU
+ *
+ * \param color		Color, e.g. BLACK, WHITE or a gray like 0x8484
+ * \param len		Number of pixels
+ * \param callback	Called from the interrupt when done, may be NULL
+ *
+ * \return 1 if the transfer has started, 0 if the bus is busy, the bytes differ or len is 0
+ *
+ * \info Do not call other LCD functions until the transfer is done.
+ *       With a band strip or a canvas selected the pixels go to RAM at once
+ *       and the callback is called before returning.
+ */
+uint8_t LCD_FloodStrobeAsync(uint16_t color, uint32_t len, void (*callback)(void));
+
+/**
+ * \brief Checks whether a timer flood is in progress
+ *
+ * \param
+ *
+ * \return 1 if busy, 0 otherwise
+ */
+uint8_t LCD_FloodStrobe_IsBusy(void);
+
+/**
+ * \brief Timer flood complete handler, call from TIM2_IRQHandler()
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_FloodStrobe_IRQHandler(void);
+#endif
+
 /* =========================================================================== */
 /* ============================ GFX FUNCTIONS ================================ */
 /* =========================================================================== */
@@ -387,6 +717,21 @@ void LCD_DrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2
  */
 void LCD_FillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
 
+/**
+ * \brief Draws a filled polygon
+ *
+ * \param xy		Vertices as x, y pairs: x0, y0, x1, y1, ...
+ * \param n			Number of vertices, 3..LCD_POLYGON_MAX_VERTICES
+ * \param rule		LCD_FILL_EVENODD or LCD_FILL_NONZERO
+ * \param color		Color
+ *
+ * \return void
+ *
+ * \info Pixels whose centers lie inside the outline are filled, so polygons
+ *       sharing an edge do not overlap.
+ */
+void LCD_FillPolygon(const int16_t *xy, uint8_t n, uint8_t rule, uint16_t color);
+
 /**
  * \brief Draws a rectangle with rounded corners specified by a coordinate pair, a width, and a height.
  *
@@ -470,6 +815,8 @@ void LCD_Printf(const char *fmt, ...);
  * \param y		The y-coordinate
  *
  * \return void
+ *
+ * \info Inside the LCD_ScrollConsole() area the console goes on from the line that holds row y.
  */
 void LCD_SetCursor(uint16_t x, uint16_t y);
 
@@ -531,10 +878,52 @@ void LCD_SetTextWrap(uint8_t w);
 /**
  * \brief Sets the text scaling
  *
- * \param s		Scaling
+ * \param s		Scaling: 0 - none, otherwise x2
  *
  * \return void
  */
 void LCD_SetTextScaled(uint8_t s);
 
-#endif /* __LCD_H */
+/**
+ * \brief Sets the integer text scale factor
+ *
+ * \param s		Scale factor (1..8), every glyph pixel is drawn as s x s block
+ *
+ * \return void
+ */
+void LCD_SetTextScale(uint8_t s);
+
+/**
+ * \brief Gets the integer text scale factor
+ *
+ * \param
+ *
+ * \return uint8_t scale factor
+ */
+uint8_t LCD_GetTextScale(void);
+
+#if defined (USE_SCROLL_CONSOLE)
+/**
+ * \brief Turns LCD_Printf() into a console that scrolls with the hardware
+ *        vertical scrolling between a fixed header and footer
+ *
+ * \param top		Header height in pixels, not scrolled
+ * \param bottom	Footer height in pixels, not scrolled
+ *
+ * \return uint8_t 1 - console on, 0 - landscape rotation or no room for a line,
+ *         a console that was on is then turned off and its scrolling reset
+ */
+uint8_t LCD_ScrollConsole(uint16_t top, uint16_t bottom);
+
+/**
+ * \brief Turns the console off, resets the scrolling and clears its area
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_ScrollConsoleEnd(void);
+#endif
+
+#endif /* __LCD_H */
+
@@ -0,0 +1,215 @@
+/*
+ * lcd_dirty.c
+ *
+ * Dirty-region tracking for lcd.h drawing, see lcd_dirty.h.
+ *
+ */
+
+#include <stddef.h>
+#include "lcd_dirty.h"
+
+static LCD_DirtyRect m_rects[LCD_DIRTY_MAX];
+static uint8_t m_count = 0;
+
+
+/**
+ * \brief Returns the number of pixels of a rectangle
+ *
+ * \param r		Rectangle
+ *
+ * \return uint32_t area
+ */
+static uint32_t LCD_Dirty_Area(const LCD_DirtyRect* r) {
+	return (uint32_t) (r->x2 - r->x1 + 1) * (r->y2 - r->y1 + 1);
+}
+
+/**
+ * \brief Computes the bounding box of two rectangles
+ *
+ * \param a		First rectangle
+ * \param b		Second rectangle
+ * \param u		Bounding box, may be a or b
+ *
+ * \return void
+ */
+static void LCD_Dirty_Unite(const LCD_DirtyRect* a, const LCD_DirtyRect* b, LCD_DirtyRect* u) {
+	u->x1 = (a->x1 < b->x1) ? a->x1 : b->x1;
+	u->y1 = (a->y1 < b->y1) ? a->y1 : b->y1;
+	u->x2 = (a->x2 > b->x2) ? a->x2 : b->x2;
+	u->y2 = (a->y2 > b->y2) ? a->y2 : b->y2;
+}
+
+/**
+ * \brief Checks whether two rectangles share a pixel
+ *
+ * \param a		First rectangle
+ * \param b		Second rectangle
+ *
+ * \return 1 if they overlap, 0 otherwise
+ */
+static uint8_t LCD_Dirty_Overlap(const LCD_DirtyRect* a, const LCD_DirtyRect* b) {
+	return a->x1 <= b->x2 && b->x1 <= a->x2 && a->y1 <= b->y2 && b->y1 <= a->y2;
+}
+
+/**
+ * \brief Returns the pixels the bounding box of a and b covers on top of a and b
+ *
+ * \param a		First rectangle
+ * \param b		Second rectangle
+ *
+ * \return uint32_t extra pixels
+ */
+static uint32_t LCD_Dirty_MergeCost(const LCD_DirtyRect* a, const LCD_DirtyRect* b) {
+	LCD_DirtyRect u, i;
+	uint32_t covered = LCD_Dirty_Area(a) + LCD_Dirty_Area(b);
+	LCD_Dirty_Unite(a, b, &u);
+	if (LCD_Dirty_Overlap(a, b)) {
+		i.x1 = (a->x1 > b->x1) ? a->x1 : b->x1;
+		i.y1 = (a->y1 > b->y1) ? a->y1 : b->y1;
+		i.x2 = (a->x2 < b->x2) ? a->x2 : b->x2;
+		i.y2 = (a->y2 < b->y2) ? a->y2 : b->y2;
+		covered -= LCD_Dirty_Area(&i);
+	}
+	return LCD_Dirty_Area(&u) - covered;
+}
+
+/**
+ * \brief Merges into r every listed rectangle it overlaps or that is cheap to join
+ *
+ * \param r		Rectangle to grow, not in the list
+ *
+ * \return void
+ *
+ * \info The grown rectangle may reach rectangles it skipped, so the scan
+ *       restarts after every merge. The list never holds overlapping rectangles.
+ */
+static void LCD_Dirty_Absorb(LCD_DirtyRect* r) {
+	uint8_t i = 0;
+	while (i < m_count) {
+		if (LCD_Dirty_Overlap(r, &m_rects[i])
+				|| (LCD_Dirty_MergeCost(r, &m_rects[i]) <= LCD_DIRTY_MERGE_COST)) {
+			LCD_Dirty_Unite(r, &m_rects[i], r);
+			m_rects[i] = m_rects[--m_count];
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+}
+
+
+/**
+ * \brief Marks a rectangle as dirty, clipped to the screen in the current rotation
+ *
+ * \param x		The x-coordinate of the upper-left corner
+ * \param y		The y-coordinate of the upper-left corner
+ * \param w		Width
+ * \param h		Height
+ *
+ * \return void
+ */
+void LCD_Dirty_Add(int16_t x, int16_t y, int16_t w, int16_t h) {
+	int16_t width = (LCD_GetRotation() & 1) ? TFTHEIGHT : TFTWIDTH;
+	int16_t height = (LCD_GetRotation() & 1) ? TFTWIDTH : TFTHEIGHT;
+	LCD_DirtyRect r;
+	uint8_t i, best;
+	uint32_t cost, best_cost;
+
+	if (w <= 0 || h <= 0 || x >= width || y >= height || x + w <= 0 || y + h <= 0) {
+		return;
+	}
+	r.x1 = (x < 0) ? 0 : x;
+	r.y1 = (y < 0) ? 0 : y;
+	r.x2 = (x + w > width) ? width - 1 : x + w - 1;
+	r.y2 = (y + h > height) ? height - 1 : y + h - 1;
+
+	// Absorb overlapping and cheap neighbours
+	LCD_Dirty_Absorb(&r);
+
+	// No room: merge with the cheapest one, the result may overlap others
+	if (m_count == LCD_DIRTY_MAX) {
+		best = 0;
+		best_cost = UINT32_MAX;
+		for (i = 0; i < m_count; i++) {
+			cost = LCD_Dirty_MergeCost(&r, &m_rects[i]);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best = i;
+			}
+		}
+		LCD_Dirty_Unite(&r, &m_rects[best], &r);
+		m_rects[best] = m_rects[--m_count];
+		LCD_Dirty_Absorb(&r);
+	}
+
+	m_rects[m_count++] = r;
+}
+
+/**
+ * \brief Forgets all dirty rectangles
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_Dirty_Reset(void) {
+	m_count = 0;
+}
+
+/**
+ * \brief Returns the number of dirty rectangles
+ *
+ * \param
+ *
+ * \return uint8_t number of rectangles, 0..LCD_DIRTY_MAX
+ */
+uint8_t LCD_Dirty_Count(void) {
+	return m_count;
+}
+
+/**
+ * \brief Hands every dirty rectangle to a redraw callback and forgets them
+ *
+ * \param redraw	Called once per rectangle, sorted top to bottom, then left to right
+ *
+ * \return void
+ *
+ * \info redraw() must not add new dirty rectangles.
+ */
+void LCD_Dirty_Flush(void (*redraw)(const LCD_DirtyRect* rect)) {
+	LCD_DirtyRect r;
+	uint8_t i, j;
+
+	// Insertion sort, top to bottom then left to right
+	for (i = 1; i < m_count; i++) {
+		r = m_rects[i];
+		for (j = i; j > 0 && (m_rects[j - 1].y1 > r.y1
+				|| (m_rects[j - 1].y1 == r.y1 && m_rects[j - 1].x1 > r.x1)); j--) {
+			m_rects[j] = m_rects[j - 1];
+		}
+		m_rects[j] = r;
+	}
+
+	if (redraw != NULL) {
+		for (i = 0; i < m_count; i++) {
+			redraw(&m_rects[i]);
+		}
+	}
+	m_count = 0;
+}
+
+/**
+ * \brief Checks whether a rectangle intersects a dirty rectangle, helps redraw callbacks skip untouched widgets
+ *
+ * \param rect		Dirty rectangle
+ * \param x		The x-coordinate of the upper-left corner
+ * \param y		The y-coordinate of the upper-left corner
+ * \param w		Width
+ * \param h		Height
+ *
+ * \return 1 if they intersect, 0 otherwise
+ */
+uint8_t LCD_Dirty_Intersects(const LCD_DirtyRect* rect, int16_t x, int16_t y, int16_t w, int16_t h) {
+	return w > 0 && h > 0 && x <= rect->x2 && y <= rect->y2
+			&& x + w > rect->x1 && y + h > rect->y1;
+}
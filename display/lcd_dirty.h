@@ -0,0 +1,89 @@
+/*
+ * lcd_dirty.h
+ *
+ * Dirty-region tracking for lcd.h drawing.
+ *
+ * Mark what changed with LCD_Dirty_Add() (or let the drawing functions
+ * report their bounding boxes between LCD_ReportBegin() and LCD_ReportEnd(),
+ * see lcd.h, USE_DIRTY_RECTS), then call LCD_Dirty_Flush() once per frame:
+ * the redraw callback receives the merged rectangles in top-to-bottom order
+ * and redraws only what intersects them.
+ *
+ * Rectangles are kept in a bounded list. A new rectangle is merged with an
+ * existing one when they overlap, or when their bounding box costs at most
+ * LCD_DIRTY_MERGE_COST extra pixels, which also joins adjacent rectangles.
+ * When the list is full, the cheapest merge is taken whatever its cost.
+ * Merged rectangles are merged again until none overlap, so no pixel is
+ * redrawn twice.
+ *
+ */
+
+#ifndef __LCD_DIRTY_H
+#define __LCD_DIRTY_H
+
+#include "lcd.h"
+
+#define LCD_DIRTY_MAX			16		// rectangles in the list
+#define LCD_DIRTY_MERGE_COST	64		// extra pixels worth one rectangle less
+
+typedef struct LCD_DirtyRect {
+	int16_t x1, y1;  // upper-left corner, inclusive
+	int16_t x2, y2;  // lower-right corner, inclusive
+} LCD_DirtyRect;
+
+
+/**
+ * \brief Marks a rectangle as dirty, clipped to the screen in the current rotation
+ *
+ * \param x		The x-coordinate of the upper-left corner
+ * \param y		The y-coordinate of the upper-left corner
+ * \param w		Width
+ * \param h		Height
+ *
+ * \return void
+ */
+void LCD_Dirty_Add(int16_t x, int16_t y, int16_t w, int16_t h);
+
+/**
+ * \brief Forgets all dirty rectangles
+ *
+ * \param
+ *
+ * \return void
+ */
+void LCD_Dirty_Reset(void);
+
+/**
+ * \brief Returns the number of dirty rectangles
+ *
+ * \param
+ *
+ * \return uint8_t number of rectangles, 0..LCD_DIRTY_MAX
+ */
+uint8_t LCD_Dirty_Count(void);
+
+/**
+ * \brief Hands every dirty rectangle to a redraw callback and forgets them
+ *
+ * \param redraw	Called once per rectangle, sorted top to bottom, then left to right
+ *
+ * \return void
+ *
+ * \info redraw() must not add new dirty rectangles.
+ */
+void LCD_Dirty_Flush(void (*redraw)(const LCD_DirtyRect* rect));
+
+/**
+ * \brief Checks whether a rectangle intersects a dirty rectangle, helps redraw callbacks skip untouched widgets
+ *
+ * \param rect		Dirty rectangle
+ * \param x		The x-coordinate of the upper-left corner
+ * \param y		The y-coordinate of the upper-left corner
+ * \param w		Width
+ * \param h		Height
+ *
+ * \return 1 if they intersect, 0 otherwise
+ */
+uint8_t LCD_Dirty_Intersects(const LCD_DirtyRect* rect, int16_t x, int16_t y, int16_t w, int16_t h);
+
+#endif /* __LCD_DIRTY_H */
@@ -17,9 +17,27 @@
  *		HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_4);
  *	}
  *
+ * With USE_TOUCH_ASYNC a sample runs through these states, each step
+ * started from the interrupt that ends the previous one:
+ *
+ *	EXTI4 (touch) or period timeout
+ *	  -> SETTLE_X  X plate driven, TIM7 settling timeout
+ *	  -> CONV_X    ADC end of conversion (no touch: straight to RELEASE)
+ *	  -> SETTLE_Y  Y plate driven, TIM7 settling timeout
+ *	  -> CONV_Y    ADC end of conversion, the sample is published
+ *	  -> RELEASE   interrupt mode pins, TIM7 pull-up settling timeout,
+ *	               Y+ high means the touch ended while EXTI4 was off
+ *	  -> NEXT      TIM7 period timeout while touched
+ *
+ * EXTI4, TIM7 and ADC share one priority, so the steps never preempt
+ * each other. LCD_SetMode(LCD_MODE_DRAW) cancels a running sample.
+ *
  */
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
 #include "lcd_touch.h"
 
 #define ADC_NO_TOUCH_X_OUTSIDE (4095 - 100)
@@ -28,97 +46,520 @@
 #define TOUCH_ADC_Y_MIN 300
 #define TOUCH_ADC_Y_MAX 3780
 
-static const float ADC_UNIT_PX_X = 1.0 / (TOUCH_ADC_X_MAX - TOUCH_ADC_X_MIN);
-static const float ADC_UNIT_PX_Y = 1.0 / (TOUCH_ADC_Y_MAX - TOUCH_ADC_Y_MIN);
+#if (LCD_TOUCH_OVERSAMPLE < 1) || (LCD_TOUCH_OVERSAMPLE > 16) || (2 * LCD_TOUCH_TRIM >= LCD_TOUCH_OVERSAMPLE)
+#error Error in lcd_touch.c: LCD_TOUCH_OVERSAMPLE must be 1..16 and keep a value after LCD_TOUCH_TRIM
+#endif
+
+#define CAL_ONE (1L << LCD_TOUCH_CAL_SHIFT)
+#define CAL_MAGIC 0x54434131  // "TCA1"
+
+// Used until a calibration is made: the ADC range above mapped
+// onto the panel, both axes reversed
+static const LCD_TouchCalibration CAL_DEFAULT = {
+	.a = -(TFTWIDTH * CAL_ONE) / (TOUCH_ADC_X_MAX - TOUCH_ADC_X_MIN),
+	.b = 0,
+	.c = (int64_t) TFTWIDTH * CAL_ONE * TOUCH_ADC_X_MAX / (TOUCH_ADC_X_MAX - TOUCH_ADC_X_MIN),
+	.d = 0,
+	.e = -(TFTHEIGHT * CAL_ONE) / (TOUCH_ADC_Y_MAX - TOUCH_ADC_Y_MIN),
+	.f = (int64_t) TFTHEIGHT * CAL_ONE * TOUCH_ADC_Y_MAX / (TOUCH_ADC_Y_MAX - TOUCH_ADC_Y_MIN)
+};
+
+typedef struct TouchCalRecord {
+	uint32_t magic;
+	LCD_TouchCalibration cal;
+	uint32_t check;  // inverted sum of the words above
+} TouchCalRecord;
+
+static LCD_TouchCalibration m_cal;
 
 static ADC_HandleTypeDef* hadcX = NULL;
 static ADC_HandleTypeDef* hadcY = NULL;
 static uint32_t ADC_ChannelX;
 static uint32_t ADC_ChannelY;
-static LCD_TouchState m_touch_state = LCD_TOUCH_IDLE;
-static LCD_TouchPoint* m_last_point_ref = NULL;
 
-static float fclamp(float x, float l, float u) {
-	return x < l ? l : (x > u ? u : x);
+// Touch events go from the interrupts (the only producer, EXTI4, TIM7 and ADC
+// share one priority) to the main loop (the only consumer) through a ring.
+// Each side writes only its own index, so neither needs a lock.
+#if (LCD_TOUCH_EVENTS < 2) || (LCD_TOUCH_EVENTS & (LCD_TOUCH_EVENTS - 1))
+#error Error in lcd_touch.c: LCD_TOUCH_EVENTS must be a power of two
+#endif
+
+typedef struct TouchEvent {
+	uint16_t x, y;  // raw ADC values, unused for LCD_TOUCH_UP
+	uint32_t tick;
+	LCD_TouchState state;
+} TouchEvent;
+
+static TouchEvent m_events[LCD_TOUCH_EVENTS];
+static volatile uint32_t m_events_head;      // written by the interrupts only
+static volatile uint32_t m_events_tail;      // written by the main loop only
+static volatile uint32_t m_events_overflows;
+
+static volatile uint8_t m_touch_down;        // written by the interrupts only
+static volatile uint32_t m_touch_count;      // touches started, written by the interrupts only
+static uint32_t m_sample_count;              // m_touch_count of the last sample
+static int16_t m_last_x, m_last_y;           // last position given to the main loop
+static uint16_t m_last_raw_x, m_last_raw_y;
+static volatile uint32_t m_touch_rejected;
+static volatile uint32_t m_touch_points;      // samples given out as points
+static volatile uint64_t m_touch_cycles;      // DWT cycles spent sampling, rejected samples included
+
+static LCD_Mode m_mode = LCD_MODE_DRAW;      // LCD_Init() leaves the pins drawing
+static uint8_t m_pins_ready = 0U;
+
+#if defined (USE_MODE_STATS)
+static LCD_ModeStats m_mode_stats;
+#endif
+
+#if defined (USE_TOUCH_ARBITER)
+static uint32_t m_arb_start;                 // DWT cycles of the last sample or DRAW switch
+static uint32_t m_arb_budget;                // LCD_ARBITER_BUDGET_US in DWT cycles
+#endif
+
+#if defined (USE_TOUCH_ASYNC)
+typedef enum {
+	TOUCH_ASYNC_OFF = 0,  // DRAW mode, the pins belong to the LCD
+	TOUCH_ASYNC_WAIT,     // awaiting a touch
+	TOUCH_ASYNC_SETTLE_X,
+	TOUCH_ASYNC_CONV_X,
+	TOUCH_ASYNC_SETTLE_Y,
+	TOUCH_ASYNC_CONV_Y,
+	TOUCH_ASYNC_RELEASE,
+	TOUCH_ASYNC_NEXT
+} TouchAsyncState;
+
+static volatile TouchAsyncState m_async = TOUCH_ASYNC_OFF;
+static uint32_t m_async_x;
+static uint16_t m_burst[LCD_TOUCH_OVERSAMPLE];
+static uint8_t m_burst_n;
+#endif
+
+/*
+ * Sorts a burst of conversions and stores the mean of its middle values
+ * in *value. Returns 0 if the burst varied too much.
+ */
+static uint8_t touch_Filter(uint16_t* v, uint32_t* value) {
+	uint32_t i, j, sum = 0;
+
+	for (i = 1; i < LCD_TOUCH_OVERSAMPLE; i++) {
+		uint16_t t = v[i];
+		for (j = i; j > 0 && v[j - 1] > t; j--) {
+			v[j] = v[j - 1];
+		}
+		v[j] = t;
+	}
+	for (i = LCD_TOUCH_TRIM; i < LCD_TOUCH_OVERSAMPLE - LCD_TOUCH_TRIM; i++) {
+		sum += v[i];
+	}
+	*value = (sum + (LCD_TOUCH_OVERSAMPLE - 2 * LCD_TOUCH_TRIM) / 2) / (LCD_TOUCH_OVERSAMPLE - 2 * LCD_TOUCH_TRIM);
+
+#if LCD_TOUCH_MAX_VARIANCE && (LCD_TOUCH_OVERSAMPLE > 1)
+	// a single spike at either end is left to the trimming
+	const uint32_t lo = LCD_TOUCH_OVERSAMPLE > 2 ? 1 : 0;
+	const uint32_t n = LCD_TOUCH_OVERSAMPLE - 2 * lo;
+	int32_t mean;
+	uint32_t var = 0;
+
+	for (sum = 0, i = lo; i < lo + n; i++) {
+		sum += v[i];
+	}
+	mean = sum / n;
+	for (i = lo; i < lo + n; i++) {
+		int32_t d = (int32_t) v[i] - mean;
+		var += d * d;
+	}
+	if (var > LCD_TOUCH_MAX_VARIANCE * n) {
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+static int32_t clamp(int32_t v, int32_t l, int32_t u) {
+	return v < l ? l : (v > u ? u : v);
+}
+
+static void touch_ToPixels(uint32_t x, uint32_t y, LCD_TouchPoint* p) {
+	int32_t px = ((int64_t) m_cal.a * x + (int64_t) m_cal.b * y + m_cal.c + CAL_ONE / 2) >> LCD_TOUCH_CAL_SHIFT;
+	int32_t py = ((int64_t) m_cal.d * x + (int64_t) m_cal.e * y + m_cal.f + CAL_ONE / 2) >> LCD_TOUCH_CAL_SHIFT;
+
+	px = clamp(px, 0, TFTWIDTH - 1);
+	py = clamp(py, 0, TFTHEIGHT - 1);
+
+	// portrait to the current rotation
+	switch (LCD_GetRotation()) {
+	default:
+		p->x = px;
+		p->y = py;
+		break;
+	case 1:
+		p->x = py;
+		p->y = TFTWIDTH - 1 - px;
+		break;
+	case 2:
+		p->x = TFTWIDTH - 1 - px;
+		p->y = TFTHEIGHT - 1 - py;
+		break;
+	case 3:
+		p->x = TFTHEIGHT - 1 - py;
+		p->y = px;
+		break;
+	}
+}
+
+// The current rotation to portrait
+static void touch_ToPortrait(int16_t x, int16_t y, int32_t* px, int32_t* py) {
+	switch (LCD_GetRotation()) {
+	default:
+		*px = x;
+		*py = y;
+		break;
+	case 1:
+		*px = TFTWIDTH - 1 - y;
+		*py = x;
+		break;
+	case 2:
+		*px = TFTWIDTH - 1 - x;
+		*py = TFTHEIGHT - 1 - y;
+		break;
+	case 3:
+		*px = y;
+		*py = TFTHEIGHT - 1 - x;
+		break;
+	}
+}
+
+static uint32_t touch_CalCheck(const TouchCalRecord* r) {
+	const uint32_t* w = (const uint32_t*) r;
+	uint32_t sum = 0;
+
+	for (uint32_t i = 0; i < offsetof(TouchCalRecord, check) / 4; i++) {
+		sum += w[i];
+	}
+
+	return ~sum;
+}
+
+static void touch_LoadCalibration() {
+	const TouchCalRecord* r = (const TouchCalRecord*) LCD_TOUCH_CAL_ADDR;
+
+	if (r->magic == CAL_MAGIC && r->check == touch_CalCheck(r)) {
+		m_cal = r->cal;
+	} else {
+		m_cal = CAL_DEFAULT;
+	}
 }
 
-static float adc_norm_x(uint32_t x) {
-	return (x - TOUCH_ADC_X_MIN) * ADC_UNIT_PX_X;
+// Interrupts only
+static void Event_Push(uint32_t x, uint32_t y, LCD_TouchState state) {
+	uint32_t head = m_events_head;
+	TouchEvent* e;
+
+	if (head - m_events_tail >= LCD_TOUCH_EVENTS) {
+		m_events_overflows++;
+		// The main loop is not reading the newest event of a full ring:
+		// an UP takes the place of the last MOVE, so the stroke still ends
+		e = &m_events[(head - 1) & (LCD_TOUCH_EVENTS - 1)];
+		if (state == LCD_TOUCH_UP && e->state == LCD_TOUCH_MOVE) {
+			e->tick = HAL_GetTick();
+			e->state = LCD_TOUCH_UP;
+		}
+		return;
+	}
+	e = &m_events[head & (LCD_TOUCH_EVENTS - 1)];
+	e->x = x;
+	e->y = y;
+	e->tick = HAL_GetTick();
+	e->state = state;
+	__DMB();
+	m_events_head = head + 1;
 }
 
-static float adc_norm_y(uint32_t y) {
-	return (y - TOUCH_ADC_Y_MIN) * ADC_UNIT_PX_Y;
+// Main loop only. An UP event gets the position of the event before it.
+static uint8_t Event_Pop(LCD_TouchPoint* p) {
+	uint32_t tail = m_events_tail;
+
+	if (tail == m_events_head) {
+		return 0;
+	}
+	__DMB();
+	const TouchEvent* e = &m_events[tail & (LCD_TOUCH_EVENTS - 1)];
+	if (e->state == LCD_TOUCH_UP) {
+		p->x = m_last_x;
+		p->y = m_last_y;
+	} else {
+		touch_ToPixels(e->x, e->y, p);
+		m_last_x = p->x;
+		m_last_y = p->y;
+		m_last_raw_x = e->x;
+		m_last_raw_y = e->y;
+	}
+	p->tick = e->tick;
+	p->state = e->state;
+	__DMB();
+	m_events_tail = tail + 1;
+
+	return 1;
 }
 
-static uint32_t ADC_GetValue(ADC_HandleTypeDef* hadc, uint32_t channel) {
+// Each ADC converts one channel only, so the selection made once stays
+static void ADC_Config(ADC_HandleTypeDef* hadc, uint32_t channel) {
 	ADC_ChannelConfTypeDef sConfig;
+	const __IO uint32_t* smpr = channel > ADC_CHANNEL_9 ? &hadc->Instance->SMPR1 : &hadc->Instance->SMPR2;
+	uint32_t smp_pos = 3 * (channel > ADC_CHANNEL_9 ? channel - 10 : channel);
 
+	if ((hadc->Instance->SQR3 & ADC_SQR3_SQ1) == channel
+			&& ((*smpr >> smp_pos) & 7U) == LCD_TOUCH_SAMPLETIME) {
+		return;
+	}
 	sConfig.Channel = channel;
 	sConfig.Rank = 1;
-	sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
+	sConfig.SamplingTime = LCD_TOUCH_SAMPLETIME;
 	HAL_ADC_ConfigChannel(hadc, &sConfig);
+}
+
+#if !defined (USE_TOUCH_ASYNC) || defined (USE_TOUCH_ARBITER)
+static void ADC_GetValues(ADC_HandleTypeDef* hadc, uint32_t channel, uint16_t* v) {
+	ADC_Config(hadc, channel);
 
-	// start conversion
-	HAL_ADC_Start(hadc);
+	for (uint32_t i = 0; i < LCD_TOUCH_OVERSAMPLE; i++) {
+		// start conversion
+		HAL_ADC_Start(hadc);
 
-	// wait until finish
-	HAL_ADC_PollForConversion(hadc, 100);
+		// wait until finish
+		HAL_ADC_PollForConversion(hadc, 100);
 
-	uint32_t value = HAL_ADC_GetValue(hadc);
+		v[i] = HAL_ADC_GetValue(hadc);
+	}
 
 	HAL_ADC_Stop(hadc);
+}
+#endif
+
+// The pins shared by the LCD bus and the touch panel:
+// X- PA1 (WR), Y+ PA4 (CD), X+ PA8 (D7), Y- PB10 (D6)
+#define TOUCH_PINS_A	(GPIO_PIN_1 | GPIO_PIN_4 | GPIO_PIN_8)
+#define TOUCH_PINS_B	GPIO_PIN_10
+
+// Two-bit fields (MODER, OSPEEDR, PUPDR) of a pin
+#define PIN2(pin, v)	((uint32_t) (v) << (2 * (pin)))
+#define PIN2_MASK_A		(PIN2(1, 3) | PIN2(4, 3) | PIN2(8, 3))
+#define PIN2_MASK_B		PIN2(10, 3)
+
+#define MODE_IN		0
+#define MODE_OUT	1
+#define MODE_AN		3
+#define PULL_UP		1
+
+// Register values of the shared pins in one of the pin states,
+// what HAL_GPIO_Init() followed by HAL_GPIO_WritePin() would leave there.
+// Push-pull everywhere, low speed unless saved from the LCD.
+typedef struct TouchPins {
+	uint32_t moder_a, ospeedr_a, pupdr_a, bsrr_a;
+	uint32_t moder_b, ospeedr_b, pupdr_b, bsrr_b;
+} TouchPins;
+
+// DRAW mode: all outputs, the levels are the LCD's business.
+// LCD_SetMode(LCD_MODE_TOUCH) saves here what the LCD left.
+static TouchPins m_pins_draw = {
+	.moder_a = PIN2(1, MODE_OUT) | PIN2(4, MODE_OUT) | PIN2(8, MODE_OUT),
+	.moder_b = PIN2(10, MODE_OUT)
+};
 
-	return value;
+// TOUCH mode: Y+ pulled up, a touch connects it to X- and pulls it low
+static const TouchPins PINS_INTERRUPT = {
+	.moder_a = PIN2(1, MODE_OUT) | PIN2(4, MODE_IN) | PIN2(8, MODE_IN),
+	.pupdr_a = PIN2(4, PULL_UP),
+	.bsrr_a = GPIO_PIN_1 << 16,
+	.moder_b = PIN2(10, MODE_IN)
+};
+
+// Drives X- low and X+ high, Y+ is measured
+static const TouchPins PINS_MEASURE_X = {
+	.moder_a = PIN2(1, MODE_OUT) | PIN2(4, MODE_AN) | PIN2(8, MODE_OUT),
+	.bsrr_a = (GPIO_PIN_1 << 16) | GPIO_PIN_8,
+	.moder_b = PIN2(10, MODE_IN)
+};
+
+// Drives Y- low and Y+ high, X- is measured
+static const TouchPins PINS_MEASURE_Y = {
+	.moder_a = PIN2(1, MODE_AN) | PIN2(4, MODE_OUT) | PIN2(8, MODE_IN),
+	.bsrr_a = GPIO_PIN_4,
+	.moder_b = PIN2(10, MODE_OUT),
+	.bsrr_b = GPIO_PIN_10 << 16
+};
+
+// The output levels are set before the pins turn into outputs
+static void GPIO_SetPins(const TouchPins* s) {
+	GPIOA->BSRR = s->bsrr_a;
+	GPIOA->OTYPER &= ~TOUCH_PINS_A;
+	GPIOA->OSPEEDR = (GPIOA->OSPEEDR & ~PIN2_MASK_A) | s->ospeedr_a;
+	GPIOA->PUPDR = (GPIOA->PUPDR & ~PIN2_MASK_A) | s->pupdr_a;
+	GPIOA->MODER = (GPIOA->MODER & ~PIN2_MASK_A) | s->moder_a;
+
+	GPIOB->BSRR = s->bsrr_b;
+	GPIOB->OTYPER &= ~TOUCH_PINS_B;
+	GPIOB->OSPEEDR = (GPIOB->OSPEEDR & ~PIN2_MASK_B) | s->ospeedr_b;
+	GPIOB->PUPDR = (GPIOB->PUPDR & ~PIN2_MASK_B) | s->pupdr_b;
+	GPIOB->MODER = (GPIOB->MODER & ~PIN2_MASK_B) | s->moder_b;
 }
 
-static void GPIO_SetPinMode(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin,
-		uint32_t GPIO_PinMode) {
-	GPIO_InitTypeDef GPIO_InitStruct;
-	GPIO_InitStruct.Pin = GPIO_Pin;
-	GPIO_InitStruct.Mode = GPIO_PinMode;
-	GPIO_InitStruct.Pull = GPIO_NOPULL;
-	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-	HAL_GPIO_Init(GPIOx, &GPIO_InitStruct);
+static void GPIO_SavePins(TouchPins* s) {
+	uint32_t odr_a = GPIOA->ODR & TOUCH_PINS_A;
+	uint32_t odr_b = GPIOB->ODR & TOUCH_PINS_B;
+
+	s->moder_a = GPIOA->MODER & PIN2_MASK_A;
+	s->ospeedr_a = GPIOA->OSPEEDR & PIN2_MASK_A;
+	s->pupdr_a = GPIOA->PUPDR & PIN2_MASK_A;
+	s->bsrr_a = odr_a | ((TOUCH_PINS_A & ~odr_a) << 16);
+
+	s->moder_b = GPIOB->MODER & PIN2_MASK_B;
+	s->ospeedr_b = GPIOB->OSPEEDR & PIN2_MASK_B;
+	s->pupdr_b = GPIOB->PUPDR & PIN2_MASK_B;
+	s->bsrr_b = odr_b | ((TOUCH_PINS_B & ~odr_b) << 16);
 }
 
-static void ADC_GPIOA_init(uint16_t GPIO_Pin) {
-	GPIO_InitTypeDef GPIO_InitStruct;
-	GPIO_InitStruct.Pin = GPIO_Pin;
-	GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-	GPIO_InitStruct.Pull = GPIO_NOPULL;
-	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+// EXTI4 on PA4, both edges, masked until the TOUCH mode
+static void GPIO_EXTI_Init() {
+	__HAL_RCC_SYSCFG_CLK_ENABLE();
+	SYSCFG->EXTICR[1] &= ~SYSCFG_EXTICR2_EXTI4;  // port A
+	EXTI->IMR &= ~GPIO_PIN_4;
+	EXTI->EMR &= ~GPIO_PIN_4;
+	EXTI->RTSR |= GPIO_PIN_4;
+	EXTI->FTSR |= GPIO_PIN_4;
+	EXTI->PR = GPIO_PIN_4;
 }
 
-static uint32_t touchX() {
-	GPIO_SetPinMode(GPIOA, GPIO_PIN_1, GPIO_MODE_OUTPUT_PP);
-	GPIO_SetPinMode(GPIOA, GPIO_PIN_8, GPIO_MODE_OUTPUT_PP);
-	GPIO_SetPinMode(GPIOB, GPIO_PIN_10, GPIO_MODE_INPUT);
-	ADC_GPIOA_init(GPIO_PIN_4);
+static void touchX_Drive() {
+	GPIO_SetPins(&PINS_MEASURE_X);
+}
 
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_1, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_8, GPIO_PIN_SET);
+static void touchY_Drive() {
+	GPIO_SetPins(&PINS_MEASURE_Y);
+}
 
-	return ADC_GetValue(hadcX, ADC_ChannelX);
+static void GPIO_InterruptPins() {
+	GPIO_SetPins(&PINS_INTERRUPT);
 }
 
-static uint32_t touchY() {
-	HAL_NVIC_DisableIRQ(EXTI4_IRQn);
-	GPIO_SetPinMode(GPIOB, GPIO_PIN_10, GPIO_MODE_OUTPUT_PP);
-	GPIO_SetPinMode(GPIOA, GPIO_PIN_4, GPIO_MODE_OUTPUT_PP);
-	GPIO_SetPinMode(GPIOA, GPIO_PIN_8, GPIO_MODE_INPUT);
-	ADC_GPIOA_init(GPIO_PIN_1);
+// The cycle counter times the touch samples
+static void DWT_Init() {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+#if !defined (USE_TOUCH_ASYNC) || defined (USE_TOUCH_ARBITER)
+static void DWT_Delay(uint32_t us) {
+	uint32_t start = DWT->CYCCNT;
+	while (DWT->CYCCNT - start < SystemCoreClock / 1000000 * us);
+}
 
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_10, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
+static void touchX(uint16_t* v) {
+	touchX_Drive();
+
+	ADC_GetValues(hadcX, ADC_ChannelX, v);
+}
 
-	uint32_t adc_y = ADC_GetValue(hadcY, ADC_ChannelY);
+static void touchY(uint16_t* v) {
+	touchY_Drive();
+
+	ADC_GetValues(hadcY, ADC_ChannelY, v);
+}
+
+/*
+ * Back to the interrupt mode pins after a measurement. Y+ toggled with the
+ * plates, so the edges EXTI4 saw are dropped and the settled level tells
+ * a touch that ended meanwhile. Returns 0 then.
+ */
+static uint8_t touch_Release() {
+	GPIO_InterruptPins();
+	DWT_Delay(LCD_TOUCH_SETTLE_US);  // Y+ pull-up
 
 	__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_4);
 	HAL_NVIC_ClearPendingIRQ(EXTI4_IRQn);
-	HAL_NVIC_EnableIRQ(EXTI4_IRQn);
+	if (GPIOA->IDR & GPIO_PIN_4) {
+		LCD_Touch_OnUp();
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Measures both axes, the pins are in the interrupt mode state and are
+ * left so. EXTI4 must be off meanwhile.
+ */
+static LCD_TouchReadState touch_Measure(uint32_t* x, uint32_t* y) {
+	uint16_t v[LCD_TOUCH_OVERSAMPLE];
+	uint32_t start = DWT->CYCCNT;
+	LCD_TouchReadState status = LCD_TOUCH_READ_SUCCESS;
+	uint8_t stable;
+
+	touchX(v);
+	stable = touch_Filter(v, x);
+
+	if (*x > ADC_NO_TOUCH_X_OUTSIDE) {
+		status = LCD_TOUCH_READ_OUTSIDE;
+	} else {
+		if (stable) {
+			touchY(v);
+			stable = touch_Filter(v, y);
+		}
+		if (!stable) {
+			m_touch_rejected++;
+			status = LCD_TOUCH_READ_UNSTABLE;
+		}
+	}
+	if (!touch_Release()) {
+		status = LCD_TOUCH_READ_NO_TOUCH;
+	}
+
+	m_touch_cycles += DWT->CYCCNT - start;
+	return status;
+}
+#endif
+
+#if defined (USE_TOUCH_ASYNC)
+static void TIM_Init() {
+	__HAL_RCC_TIM7_CLK_ENABLE();
+
+	// 1 MHz ticks, APB1 timers run at twice PCLK1 when APB1 is divided
+	uint32_t clk = HAL_RCC_GetPCLK1Freq();
+	if (RCC->CFGR & RCC_CFGR_PPRE1_2) {
+		clk *= 2;
+	}
+	TIM7->CR1 = TIM_CR1_OPM | TIM_CR1_URS;
+	TIM7->PSC = clk / 1000000 - 1;
+	TIM7->EGR = TIM_EGR_UG;
+	TIM7->SR = 0;
+	TIM7->DIER = TIM_DIER_UIE;
+	HAL_NVIC_SetPriority(TIM7_IRQn, 0, 0);
+}
+
+static void TIM_Start(uint16_t us) {
+	TIM7->ARR = us - 1;
+	TIM7->CNT = 0;
+	TIM7->CR1 |= TIM_CR1_CEN;
+}
+
+static void TIM_Stop() {
+	TIM7->CR1 &= ~TIM_CR1_CEN;
+	TIM7->SR = 0;
+	HAL_NVIC_ClearPendingIRQ(TIM7_IRQn);
+}
+
+// The channel stays selected and the ADC stays on between samples
+static void ADC_InitIT(ADC_HandleTypeDef* hadc, uint32_t channel) {
+	ADC_Config(hadc, channel);
+	__HAL_ADC_ENABLE(hadc);
+	HAL_NVIC_SetPriority(ADC_IRQn, 0, 0);
+}
 
-	return adc_y;
+static void ADC_StartIT(ADC_HandleTypeDef* hadc) {
+	hadc->Instance->SR = ~(ADC_FLAG_EOC | ADC_FLAG_OVR);
+	__HAL_ADC_ENABLE_IT(hadc, ADC_IT_EOC);
+	hadc->Instance->CR2 |= ADC_CR2_SWSTART;
 }
+#endif
 
 /**
  * Saves ADC handles references to measure touch screen positions.
@@ -129,68 +570,116 @@ void LCD_Touch_Init(ADC_HandleTypeDef* aHadcX, uint32_t aADC_ChannelX,
 	hadcY = aHadcY;
 	ADC_ChannelX = aADC_ChannelX;
 	ADC_ChannelY = aADC_ChannelY;
+	touch_LoadCalibration();
+#if defined (USE_TOUCH_ASYNC)
+	TIM_Init();
+	ADC_InitIT(hadcX, ADC_ChannelX);
+	ADC_InitIT(hadcY, ADC_ChannelY);
+#else
+	ADC_Config(hadcX, ADC_ChannelX);
+	ADC_Config(hadcY, ADC_ChannelY);
+#endif
 }
 
-static void GPIO_DrawMode() {
+// Done once, by the first LCD_SetMode()
+static void GPIO_ModeInit() {
 	/* GPIO Ports Clock Enable */
 	__GPIOA_CLK_ENABLE()
 	;
 	__GPIOB_CLK_ENABLE()
 	;
-	HAL_NVIC_DisableIRQ(EXTI4_IRQn);
-
-	GPIO_InitTypeDef GPIO_InitStruct;
-	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-	GPIO_InitStruct.Pull = GPIO_NOPULL;
-	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-
-	/*Configure GPIO pins: PA1 PA4 PA8 */
-	GPIO_InitStruct.Pin = GPIO_PIN_1 | GPIO_PIN_4 | GPIO_PIN_8;
-	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+	GPIO_EXTI_Init();
+	HAL_NVIC_SetPriority(EXTI4_IRQn, 0, 0);
+	DWT_Init();
+#if defined (USE_TOUCH_ARBITER)
+	m_arb_budget = SystemCoreClock / 1000000 * LCD_ARBITER_BUDGET_US;
+	m_arb_start = DWT->CYCCNT;
+#endif
+	m_pins_ready = 1U;
+}
 
-	/*Configure GPIO data pin PB10 */
-	GPIO_InitStruct.Pin = GPIO_PIN_10;
-	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+// CD toggles PA4 while drawing, EXTI4 stays masked not to queue those edges
+static void GPIO_DrawMode() {
+	EXTI->IMR &= ~GPIO_PIN_4;
+	EXTI->PR = GPIO_PIN_4;
+	GPIO_SetPins(&m_pins_draw);
 }
 
 
 // TOUCH mode GPIO setup
 static void GPIO_InterruptMode() {
-	__GPIOA_CLK_ENABLE()
-	;
+	uint8_t touched;
 
-	GPIO_InitTypeDef GPIO_InitStruct;
-	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-
-	/* X- PA1 */
-	GPIO_InitStruct.Pin = GPIO_PIN_1;
-	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-	GPIO_InitStruct.Pull = GPIO_NOPULL;
-	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_1, GPIO_PIN_RESET);
-
-	/* X+ PA8 */
-	GPIO_InitStruct.Pin = GPIO_PIN_8;
-	GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-	GPIO_InitStruct.Pull = GPIO_NOPULL;
-	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-	/* Y- PB10 */
-	GPIO_InitStruct.Pin = GPIO_PIN_10;
-	GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-	GPIO_InitStruct.Pull = GPIO_NOPULL;
-	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-	/* Y+ PA4 */
-	GPIO_InitStruct.Pin = GPIO_PIN_4;
-	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
-	GPIO_InitStruct.Pull = GPIO_PULLUP;
-	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-	HAL_NVIC_SetPriority(EXTI4_IRQn, 0, 0);
+	GPIO_SavePins(&m_pins_draw);
+	GPIO_InterruptPins();
+
+	EXTI->PR = GPIO_PIN_4;
+	EXTI->IMR |= GPIO_PIN_4;
+	touched = (GPIOA->IDR & GPIO_PIN_4) == 0;
+	if (touched != m_touch_down) {
+		// touched or released while drawing, let EXTI4 tell
+		EXTI->SWIER = GPIO_PIN_4;
+	}
 	HAL_NVIC_EnableIRQ(EXTI4_IRQn);
 }
 
 
+#if defined (USE_TOUCH_ASYNC)
+static void Async_Start() {
+	HAL_NVIC_DisableIRQ(EXTI4_IRQn);
+	touchX_Drive();
+	m_async = TOUCH_ASYNC_SETTLE_X;
+	TIM_Start(LCD_TOUCH_SETTLE_US);
+}
+
+static void Async_Release() {
+	GPIO_InterruptPins();
+	m_async = TOUCH_ASYNC_RELEASE;
+	TIM_Start(LCD_TOUCH_SETTLE_US);
+}
+
+static void Async_Publish(uint32_t x, uint32_t y) {
+	if (!m_touch_down) {
+		return;
+	}
+	Event_Push(x, y, m_sample_count != m_touch_count ? LCD_TOUCH_DOWN : LCD_TOUCH_MOVE);
+	m_sample_count = m_touch_count;
+	m_touch_points++;
+}
+
+// Pins are in interrupt mode already
+static void Async_Resume() {
+	if (hadcX == NULL || hadcY == NULL) {
+		return;
+	}
+	__disable_irq();
+	m_async = TOUCH_ASYNC_WAIT;
+	HAL_NVIC_EnableIRQ(TIM7_IRQn);
+	HAL_NVIC_EnableIRQ(ADC_IRQn);
+	if (m_touch_down) {
+		// touched while drawing, or the touch ended and RELEASE will tell
+		Async_Start();
+	}
+	__enable_irq();
+}
+
+static void Async_Stop() {
+	if (hadcX == NULL || hadcY == NULL) {
+		return;
+	}
+	HAL_NVIC_DisableIRQ(EXTI4_IRQn);
+	HAL_NVIC_DisableIRQ(TIM7_IRQn);
+	HAL_NVIC_DisableIRQ(ADC_IRQn);
+	TIM_Stop();
+	__HAL_ADC_DISABLE_IT(hadcX, ADC_IT_EOC);
+	__HAL_ADC_DISABLE_IT(hadcY, ADC_IT_EOC);
+	HAL_NVIC_ClearPendingIRQ(ADC_IRQn);
+	m_burst_n = 0;
+	m_async = TOUCH_ASYNC_OFF;
+}
+#endif
+
+
 /**
  * Set LCD's mode to either DRAW or TOUCH.
  *
@@ -198,48 +687,369 @@ static void GPIO_InterruptMode() {
  * then switch back to TOUCH, if you want to receive touches.
  */
 HAL_StatusTypeDef LCD_SetMode(LCD_Mode mode) {
+#if defined (USE_MODE_STATS)
+	uint32_t start = DWT->CYCCNT;
+#endif
+
+	if (!m_pins_ready) {
+		GPIO_ModeInit();
+	}
+	// Every measurement gives the interrupt mode pins back before it ends,
+	// so in TOUCH mode the pins are those, or a running sample's own.
+	if (mode == m_mode) {
+		return HAL_OK;
+	}
+
 	switch (mode) {
 	case LCD_MODE_TOUCH:
 		GPIO_InterruptMode();
-		return HAL_OK;
+#if defined (USE_TOUCH_ASYNC)
+		Async_Resume();
+#endif
+		break;
 
 	case LCD_MODE_DRAW:
+#if defined (USE_TOUCH_ASYNC)
+		Async_Stop();
+#endif
 		GPIO_DrawMode();
-		return HAL_OK;
+#if defined (USE_TOUCH_ARBITER)
+		m_arb_start = DWT->CYCCNT;
+#endif
+		break;
 
 	default:
 		return HAL_ERROR;
 	}
+	m_mode = mode;
+
+#if defined (USE_MODE_STATS)
+	uint32_t cycles = DWT->CYCCNT - start;
+	m_mode_stats.switches++;
+	m_mode_stats.cycles_last = cycles;
+	m_mode_stats.cycles_total += cycles;
+	if (cycles > m_mode_stats.cycles_max) {
+		m_mode_stats.cycles_max = cycles;
+	}
+#endif
+
+	return HAL_OK;
+}
+
+#if defined (USE_MODE_STATS)
+/*
+ * Copies the LCD_SetMode() cycle counts accumulated since the last reset.
+ */
+void LCD_GetModeStats(LCD_ModeStats* stats) {
+	*stats = m_mode_stats;
+}
+
+/*
+ * Resets the LCD_SetMode() cycle counts and starts the DWT cycle counter.
+ */
+void LCD_ResetModeStats() {
+	memset(&m_mode_stats, 0, sizeof(m_mode_stats));
+	DWT_Init();
+}
+#endif
+
+#if defined (USE_TOUCH_ARBITER)
+/*
+ * Called by the LCD driver when it activates CS.
+ */
+void LCD_Touch_Arbiter_Claim() {
+	if (m_mode != LCD_MODE_DRAW || !m_pins_ready) {
+		LCD_SetMode(LCD_MODE_DRAW);
+	}
+}
+
+/*
+ * Called by the LCD driver between the chunks of long drawings.
+ * Returns 1 if LCD_ARBITER_BUDGET_US has passed since the last sample.
+ */
+uint8_t LCD_Touch_Arbiter_Due() {
+	return hadcX != NULL && m_mode == LCD_MODE_DRAW
+			&& DWT->CYCCNT - m_arb_start >= m_arb_budget;
+}
+
+// The TOUCH mode, unless a batch or a transfer of the LCD holds CS active
+static void touch_Claim() {
+	if (!LCD_IsBusBusy()) {
+		LCD_SetMode(LCD_MODE_TOUCH);
+	}
+}
+
+/*
+ * Called by the LCD driver with CS idle: takes one touch sample and gives
+ * the pins back in the state the LCD left them. The DRAW mode keeps EXTI4,
+ * TIM7 and the ADC interrupts off, so this is the only event producer then.
+ */
+void LCD_Touch_Arbiter_Sample() {
+	uint32_t x, y;
+	uint8_t touched;
+
+	GPIO_SavePins(&m_pins_draw);
+	GPIO_InterruptPins();
+
+	DWT_Delay(LCD_TOUCH_SETTLE_US);  // Y+ pull-up
+
+	touched = (GPIOA->IDR & GPIO_PIN_4) == 0;
+	if (!touched) {
+		LCD_Touch_OnUp();
+	} else {
+		LCD_Touch_OnDown();
+		if (touch_Measure(&x, &y) == LCD_TOUCH_READ_SUCCESS) {
+			Event_Push(x, y, m_sample_count != m_touch_count ? LCD_TOUCH_DOWN : LCD_TOUCH_MOVE);
+			m_sample_count = m_touch_count;
+			m_touch_points++;
+		}
+#if defined (USE_TOUCH_ASYNC)
+		// the burst stopped the ADCs, the interrupt-driven samples expect them on
+		__HAL_ADC_ENABLE(hadcX);
+		__HAL_ADC_ENABLE(hadcY);
+#endif
+	}
+
+	GPIO_SetPins(&m_pins_draw);
+	m_arb_start = DWT->CYCCNT;
 }
+#endif
 
 /*
  * Reads raw touch x- and y-positions and, if successful,
  * stores them in the LCD_TouchPoint point.
+ * Queued events come first, oldest first.
  */
 LCD_TouchReadState LCD_Touch_Read(LCD_TouchPoint* p) {
 	if (hadcX == NULL || hadcY == NULL) {
 		return LCD_TOUCH_READ_NOT_INITIALIZED;
 	}
-	if (m_touch_state == LCD_TOUCH_IDLE) {
+#if defined (USE_TOUCH_ARBITER)
+	touch_Claim();
+#endif
+	if (Event_Pop(p)) {
+		return LCD_TOUCH_READ_SUCCESS;
+	}
+#if defined (USE_TOUCH_ASYNC)
+	return LCD_TOUCH_READ_NO_TOUCH;
+#else
+	if (!m_touch_down || m_mode != LCD_MODE_TOUCH) {
+		// not touched, or the LCD holds the pins
 		return LCD_TOUCH_READ_NO_TOUCH;
 	}
-	uint32_t x = touchX();
+	uint32_t count = m_touch_count;
+	uint32_t x, y;
+	LCD_TouchReadState status;
 
-	if (x > ADC_NO_TOUCH_X_OUTSIDE) {
-		return LCD_TOUCH_READ_OUTSIDE;
-	}
+	HAL_NVIC_DisableIRQ(EXTI4_IRQn);
+	status = touch_Measure(&x, &y);
+	HAL_NVIC_EnableIRQ(EXTI4_IRQn);
 
-	uint32_t y = touchY();
+	if (status != LCD_TOUCH_READ_SUCCESS) {
+		// a touch that ended meanwhile gives its UP
+		return Event_Pop(p) ? LCD_TOUCH_READ_SUCCESS : status;
+	}
 
-	p->x = (int16_t) ((1 - fclamp(adc_norm_x(x), 0.0f, 1.0f)) * TFTWIDTH);
-	p->y = (int16_t) ((1 - fclamp(adc_norm_y(y), 0.0f, 1.0f)) * TFTHEIGHT);
+	touch_ToPixels(x, y, p);
 	p->tick = HAL_GetTick();
-	p->state = m_touch_state;
+	p->state = count != m_sample_count ? LCD_TOUCH_DOWN : LCD_TOUCH_MOVE;
 
-	m_last_point_ref = p;
-	m_touch_state = LCD_TOUCH_MOVE;
+	m_sample_count = count;
+	m_touch_points++;
+	m_last_x = p->x;
+	m_last_y = p->y;
+	m_last_raw_x = x;
+	m_last_raw_y = y;
 
 	return LCD_TOUCH_READ_SUCCESS;
+#endif
+}
+
+
+/*
+ * Copies up to max queued touch events, oldest first,
+ * and returns their number. Never waits.
+ */
+uint16_t LCD_Touch_Drain(LCD_TouchPoint* events, uint16_t max) {
+	uint16_t n = 0;
+
+#if defined (USE_TOUCH_ARBITER)
+	touch_Claim();
+#endif
+	while (n < max && Event_Pop(&events[n])) {
+		n++;
+	}
+
+	return n;
+}
+
+
+/*
+ * Returns the number of touch events lost to a full queue.
+ */
+uint32_t LCD_Touch_GetOverflows() {
+	return m_events_overflows;
+}
+
+
+/*
+ * Returns the number of samples rejected by LCD_TOUCH_MAX_VARIANCE.
+ */
+uint32_t LCD_Touch_GetRejected() {
+	return m_touch_rejected;
+}
+
+
+/*
+ * Returns the number of samples given out as points.
+ */
+uint32_t LCD_Touch_GetPoints() {
+	return m_touch_points;
+}
+
+
+/*
+ * Returns the mean DWT cycles spent sampling per point given out,
+ * the rejected samples and those without a touch included.
+ * 0 until the first point.
+ */
+uint32_t LCD_Touch_GetCyclesPerPoint() {
+	uint64_t cycles;
+	uint32_t points;
+
+	__disable_irq();
+	cycles = m_touch_cycles;
+	points = m_touch_points;
+	__enable_irq();
+
+	return points ? cycles / points : 0;
+}
+
+
+/*
+ * Returns the raw ADC values of the last point read.
+ */
+void LCD_Touch_GetRaw(uint16_t* x, uint16_t* y) {
+	*x = m_last_raw_x;
+	*y = m_last_raw_y;
+}
+
+
+/*
+ * Computes the calibration from n >= 3 screen points xy[] (x, y pairs
+ * in the current rotation) and the raw ADC values raw[] (x, y pairs)
+ * read there. Three points give an exact fit, more a least-squares one.
+ * Returns 0 if the points are collinear or too close together for the
+ * fixed point coefficients, the calibration is unchanged then.
+ *
+ * Solved once in double precision on centered sums; touch_ToPixels()
+ * then needs only integer multiply-adds.
+ */
+uint8_t LCD_Touch_Calibrate(const int16_t* xy, const uint16_t* raw, uint8_t n) {
+	double mx = 0, my = 0, mX = 0, mY = 0;
+	double sxx = 0, sxy = 0, syy = 0, sxX = 0, syX = 0, sxY = 0, syY = 0;
+	int32_t X, Y;
+	uint8_t i;
+
+	if (n < 3) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		touch_ToPortrait(xy[2 * i], xy[2 * i + 1], &X, &Y);
+		mx += raw[2 * i];
+		my += raw[2 * i + 1];
+		mX += X;
+		mY += Y;
+	}
+	mx /= n;
+	my /= n;
+	mX /= n;
+	mY /= n;
+	for (i = 0; i < n; i++) {
+		touch_ToPortrait(xy[2 * i], xy[2 * i + 1], &X, &Y);
+		double dx = raw[2 * i] - mx, dy = raw[2 * i + 1] - my;
+		sxx += dx * dx;
+		sxy += dx * dy;
+		syy += dy * dy;
+		sxX += dx * (X - mX);
+		syX += dy * (X - mX);
+		sxY += dx * (Y - mY);
+		syY += dy * (Y - mY);
+	}
+
+	double det = sxx * syy - sxy * sxy;
+	if (det <= 1e-6 * sxx * syy) {
+		return 0;
+	}
+	double a = (sxX * syy - syX * sxy) / det;
+	double b = (syX * sxx - sxX * sxy) / det;
+	double d = (sxY * syy - syY * sxy) / det;
+	double e = (syY * sxx - sxY * sxy) / det;
+	double c = mX - a * mx - b * my;
+	double f = mY - d * mx - e * my;
+
+	// points bunched on the panel overflow the fixed point coefficients
+	const double k[] = { a, b, c, d, e, f };
+	for (i = 0; i < sizeof(k) / sizeof(k[0]); i++) {
+		if (!(fabs(k[i]) * CAL_ONE < INT32_MAX)) {
+			return 0;
+		}
+	}
+
+	m_cal.a = (int32_t) (a * CAL_ONE + (a < 0 ? -0.5 : 0.5));
+	m_cal.b = (int32_t) (b * CAL_ONE + (b < 0 ? -0.5 : 0.5));
+	m_cal.c = (int32_t) (c * CAL_ONE + (c < 0 ? -0.5 : 0.5));
+	m_cal.d = (int32_t) (d * CAL_ONE + (d < 0 ? -0.5 : 0.5));
+	m_cal.e = (int32_t) (e * CAL_ONE + (e < 0 ? -0.5 : 0.5));
+	m_cal.f = (int32_t) (f * CAL_ONE + (f < 0 ? -0.5 : 0.5));
+
+	return 1;
+}
+
+
+/*
+ * Writes the calibration to LCD_TOUCH_CAL_SECTOR.
+ * LCD_Touch_Init() loads it from there.
+ * Erasing the sector stalls the CPU for about a second.
+ */
+HAL_StatusTypeDef LCD_Touch_SaveCalibration() {
+	TouchCalRecord r;
+	FLASH_EraseInitTypeDef erase;
+	HAL_StatusTypeDef status;
+	uint32_t error;
+	const uint32_t* w = (const uint32_t*) &r;
+
+	r.magic = CAL_MAGIC;
+	r.cal = m_cal;
+	r.check = touch_CalCheck(&r);
+	if (memcmp(&r, (const void*) LCD_TOUCH_CAL_ADDR, sizeof(r)) == 0) {
+		// saved already, spare the flash an erase cycle
+		return HAL_OK;
+	}
+
+	erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+	erase.Sector = LCD_TOUCH_CAL_SECTOR;
+	erase.NbSectors = 1;
+	erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+	HAL_FLASH_Unlock();
+	status = HAL_FLASHEx_Erase(&erase, &error);
+	for (uint32_t i = 0; status == HAL_OK && i < sizeof(r) / 4; i++) {
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, LCD_TOUCH_CAL_ADDR + 4 * i, w[i]);
+	}
+	HAL_FLASH_Lock();
+
+	return status;
+}
+
+
+void LCD_Touch_GetCalibration(LCD_TouchCalibration* cal) {
+	*cal = m_cal;
+}
+
+
+void LCD_Touch_SetCalibration(const LCD_TouchCalibration* cal) {
+	m_cal = *cal;
 }
 
 
@@ -248,9 +1058,15 @@ LCD_TouchReadState LCD_Touch_Read(LCD_TouchPoint* p) {
  * Should be called from EXTIx_IRQHandler interrupt only.
  */
 void LCD_Touch_OnDown() {
-	if (m_touch_state == LCD_TOUCH_IDLE) {
-		m_touch_state = LCD_TOUCH_DOWN;
+	if (!m_touch_down) {
+		m_touch_count++;
+		m_touch_down = 1U;
+	}
+#if defined (USE_TOUCH_ASYNC)
+	if (m_async == TOUCH_ASYNC_WAIT) {
+		Async_Start();
 	}
+#endif
 }
 
 
@@ -259,15 +1075,14 @@ void LCD_Touch_OnDown() {
  * Should be called from EXTIx_IRQHandler interrupt only.
  */
 void LCD_Touch_OnUp() {
-	m_touch_state = LCD_TOUCH_IDLE;
-
-	if (m_last_point_ref != NULL) {
-		// Mark the last read touch point as TOUCH_UP.
-		// Note that it changes the point state that the user specified
-		// as an argument to LCD_Touch_Read function.
-		m_last_point_ref->state = LCD_TOUCH_UP;
+	if (!m_touch_down) {
+		// repeated interrupt, the touch has ended already
+		return;
 	}
-	LCD_Touch_Draw_OnUp();
+	m_touch_down = 0U;
+
+	// LCD_Touch_Read() hands the UP out as a point of its own
+	Event_Push(0, 0, LCD_TOUCH_UP);
 }
 
 
@@ -276,5 +1091,136 @@ void LCD_Touch_OnUp() {
  * Returns the current touch state.
  */
 LCD_TouchState LCD_Touch_GetState() {
-	return m_touch_state;
+	if (!m_touch_down) {
+		return LCD_TOUCH_IDLE;
+	}
+	return m_touch_count != m_sample_count ? LCD_TOUCH_DOWN : LCD_TOUCH_MOVE;
+}
+
+
+#if defined (USE_TOUCH_ASYNC)
+/*
+ * Starts a touch sample in the background, if none is running.
+ * Samples start by themselves on a touch and every LCD_TOUCH_PERIOD_US
+ * while touched; LCD_Touch_Read() returns the last one without waiting.
+ */
+HAL_StatusTypeDef LCD_Touch_Sample() {
+	HAL_StatusTypeDef status = HAL_BUSY;
+
+	__disable_irq();
+	if (m_async == TOUCH_ASYNC_WAIT || m_async == TOUCH_ASYNC_NEXT) {
+		TIM_Stop();
+		Async_Start();
+		status = HAL_OK;
+	}
+	__enable_irq();
+
+	return status;
+}
+
+
+/*
+ * Should be called from TIM7_IRQHandler interrupt only.
+ */
+void LCD_Touch_TIM_IRQHandler() {
+	uint32_t start = DWT->CYCCNT;
+
+	if (!(TIM7->SR & TIM_SR_UIF)) {
+		return;
+	}
+	TIM7->SR = ~TIM_SR_UIF;
+
+	switch (m_async) {
+	case TOUCH_ASYNC_SETTLE_X:
+		m_async = TOUCH_ASYNC_CONV_X;
+		ADC_StartIT(hadcX);
+		break;
+
+	case TOUCH_ASYNC_SETTLE_Y:
+		m_async = TOUCH_ASYNC_CONV_Y;
+		ADC_StartIT(hadcY);
+		break;
+
+	case TOUCH_ASYNC_RELEASE:
+		__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_4);
+		if (HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_4) == GPIO_PIN_SET) {
+			// Y+ is pulled up: the touch ended while EXTI4 was off
+			m_async = TOUCH_ASYNC_WAIT;
+			LCD_Touch_OnUp();
+			__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_4);
+		} else {
+			m_async = TOUCH_ASYNC_NEXT;
+			TIM_Start(LCD_TOUCH_PERIOD_US);
+		}
+		HAL_NVIC_ClearPendingIRQ(EXTI4_IRQn);
+		HAL_NVIC_EnableIRQ(EXTI4_IRQn);
+		break;
+
+	case TOUCH_ASYNC_NEXT:
+		if (m_touch_down) {
+			Async_Start();
+		} else {
+			m_async = TOUCH_ASYNC_WAIT;
+		}
+		break;
+
+	default:
+		break;
+	}
+	m_touch_cycles += DWT->CYCCNT - start;
+}
+
+
+/*
+ * Should be called from ADC_IRQHandler interrupt only.
+ */
+void LCD_Touch_ADC_IRQHandler() {
+	ADC_HandleTypeDef* hadc;
+	uint32_t start = DWT->CYCCNT;
+	uint8_t stable;
+	uint32_t y;
+
+	if (m_async == TOUCH_ASYNC_CONV_X) {
+		hadc = hadcX;
+	} else if (m_async == TOUCH_ASYNC_CONV_Y) {
+		hadc = hadcY;
+	} else {
+		return;
+	}
+	if (!__HAL_ADC_GET_FLAG(hadc, ADC_FLAG_EOC)) {
+		return;
+	}
+
+	// the next conversion of the burst starts right away
+	m_burst[m_burst_n++] = hadc->Instance->DR;
+	if (m_burst_n < LCD_TOUCH_OVERSAMPLE) {
+		hadc->Instance->CR2 |= ADC_CR2_SWSTART;
+		m_touch_cycles += DWT->CYCCNT - start;
+		return;
+	}
+	__HAL_ADC_DISABLE_IT(hadc, ADC_IT_EOC);
+	m_burst_n = 0;
+
+	if (m_async == TOUCH_ASYNC_CONV_X) {
+		stable = touch_Filter(m_burst, &m_async_x);
+		if (m_async_x > ADC_NO_TOUCH_X_OUTSIDE) {
+			Async_Release();
+		} else if (!stable) {
+			m_touch_rejected++;
+			Async_Release();
+		} else {
+			touchY_Drive();
+			m_async = TOUCH_ASYNC_SETTLE_Y;
+			TIM_Start(LCD_TOUCH_SETTLE_US);
+		}
+	} else {
+		if (touch_Filter(m_burst, &y)) {
+			Async_Publish(m_async_x, y);
+		} else {
+			m_touch_rejected++;
+		}
+		Async_Release();
+	}
+	m_touch_cycles += DWT->CYCCNT - start;
 }
+#endif
@@ -27,6 +27,8 @@
  * You can't draw and await for touches simultaneously.
  * Set LCD_Mode to DRAW to draw or print text on LCD,
  * then switch back to TOUCH.
+ * With USE_TOUCH_ARBITER (lcd.h) the switching is done for you,
+ * and long drawings pause for touch samples.
  *
  */
 
@@ -36,6 +38,39 @@
 #include "lcd.h"
 #include "stm32f4xx_hal.h"
 
+// Uncomment to sample touches without blocking: the pin drive, settling and
+// both conversions are sequenced by TIM7 and ADC end-of-conversion interrupts.
+// Call LCD_Touch_TIM_IRQHandler() from TIM7_IRQHandler() and
+// LCD_Touch_ADC_IRQHandler() from ADC_IRQHandler().
+//#define USE_TOUCH_ASYNC
+#define LCD_TOUCH_SETTLE_US		20		// plates settling after a pin swap
+#define LCD_TOUCH_PERIOD_US		5000	// sample period while touched, 200 Hz
+
+// Touch events queued for the main loop, a power of two
+#define LCD_TOUCH_EVENTS		32
+
+// Every axis is converted LCD_TOUCH_OVERSAMPLE times, the burst is sorted and
+// LCD_TOUCH_TRIM values are dropped at each end before averaging:
+// 0 - plain mean, (LCD_TOUCH_OVERSAMPLE - 1) / 2 - median.
+// A burst whose variance (without its lowest and highest value) exceeds
+// LCD_TOUCH_MAX_VARIANCE was taken while the plates were still settling
+// and is rejected, 0 accepts every burst.
+#define LCD_TOUCH_OVERSAMPLE	5		// 1..16
+#define LCD_TOUCH_TRIM			1
+#define LCD_TOUCH_MAX_VARIANCE	256		// ADC units squared
+#define LCD_TOUCH_SAMPLETIME	ADC_SAMPLETIME_3CYCLES
+
+// Uncomment to measure LCD_SetMode() in core clock cycles with the DWT cycle counter.
+// Start the counter with LCD_ResetModeStats(), read with LCD_GetModeStats().
+//#define USE_MODE_STATS
+
+// The touch calibration is kept in this flash sector, which the linker
+// script leaves out of FLASH (sector 7 of the F446RE, 128kB)
+#define LCD_TOUCH_CAL_SECTOR	FLASH_SECTOR_7
+#define LCD_TOUCH_CAL_ADDR		0x08060000
+#define LCD_TOUCH_CAL_SHIFT		16		// fraction bits of the calibration coefficients
+#define LCD_TOUCH_CAL_POINTS	5		// most points LCD_Touch_Draw_Calibrate() can show
+
 typedef enum {
 	LCD_MODE_DRAW = 0,
 	LCD_MODE_TOUCH
@@ -52,7 +87,8 @@ typedef enum {
 	LCD_TOUCH_READ_SUCCESS = 0,
 	LCD_TOUCH_READ_NOT_INITIALIZED,  // user did not call LCD_Touch_Init()
 	LCD_TOUCH_READ_NO_TOUCH,  // idle
-	LCD_TOUCH_READ_OUTSIDE    // ADC value is outside of the acceptable range
+	LCD_TOUCH_READ_OUTSIDE,   // ADC value is outside of the acceptable range
+	LCD_TOUCH_READ_UNSTABLE   // ADC values varied too much, the sample is rejected
 } LCD_TouchReadState;
 
 typedef struct LCD_TouchPoint {
@@ -61,6 +97,22 @@ typedef struct LCD_TouchPoint {
 	LCD_TouchState state;
 } LCD_TouchPoint;
 
+// Affine map from raw ADC values to portrait (rotation 0) pixels,
+// coefficients have LCD_TOUCH_CAL_SHIFT fraction bits
+typedef struct LCD_TouchCalibration {
+	int32_t a, b, c;  // x = a * adcX + b * adcY + c
+	int32_t d, e, f;  // y = d * adcX + e * adcY + f
+} LCD_TouchCalibration;
+
+#if defined (USE_MODE_STATS)
+typedef struct LCD_ModeStats {
+	uint32_t switches;		// LCD_SetMode() calls that changed the mode
+	uint32_t cycles_last;	// cycles of the last one
+	uint32_t cycles_max;
+	uint64_t cycles_total;
+} LCD_ModeStats;
+#endif
+
 
 
 // ------------------- Initialization and setup -------------------
@@ -77,9 +129,34 @@ void LCD_Touch_Init(ADC_HandleTypeDef* hadcX, uint32_t ADC_ChannelX,
  *
  * Set LCD_Mode to DRAW to draw or print text on LCD,
  * then switch back to TOUCH, if you want to receive touches.
+ * Switching restores the pin registers saved at the last switch,
+ * asking for the current mode does nothing.
  */
 HAL_StatusTypeDef LCD_SetMode(LCD_Mode mode);
 
+#if defined (USE_TOUCH_ARBITER)
+/*
+ * Bus arbiter hooks, called by lcd.c only. Drawing claims the pins for
+ * the DRAW mode, LCD_Touch_Read() and LCD_Touch_Drain() claim them back
+ * unless LCD_IsBusBusy().
+ */
+void LCD_Touch_Arbiter_Claim();
+uint8_t LCD_Touch_Arbiter_Due();
+void LCD_Touch_Arbiter_Sample();
+#endif
+
+#if defined (USE_MODE_STATS)
+/*
+ * Copies the LCD_SetMode() cycle counts accumulated since the last reset.
+ */
+void LCD_GetModeStats(LCD_ModeStats* stats);
+
+/*
+ * Resets the LCD_SetMode() cycle counts and starts the DWT cycle counter.
+ */
+void LCD_ResetModeStats();
+#endif
+
 
 
 // ------------------- Reading a touch -------------------
@@ -87,9 +164,68 @@ HAL_StatusTypeDef LCD_SetMode(LCD_Mode mode);
 /*
  * Reads raw touch x- and y-positions and, if successful,
  * stores them in the LCD_TouchPoint point.
+ * Queued events come first, oldest first: the end of a touch is
+ * a point of its own with the LCD_TOUCH_UP state.
+ * With USE_TOUCH_ASYNC it does not wait for the ADC: every sample
+ * is queued by the interrupts.
  */
 LCD_TouchReadState LCD_Touch_Read(LCD_TouchPoint* p);
 
+/*
+ * Copies up to max queued touch events, oldest first,
+ * and returns their number. Never waits.
+ */
+uint16_t LCD_Touch_Drain(LCD_TouchPoint* events, uint16_t max);
+
+/*
+ * Returns the number of touch events lost to a full queue.
+ */
+uint32_t LCD_Touch_GetOverflows();
+
+/*
+ * Returns the number of samples rejected by LCD_TOUCH_MAX_VARIANCE.
+ */
+uint32_t LCD_Touch_GetRejected();
+
+/*
+ * Returns the number of samples given out as points.
+ */
+uint32_t LCD_Touch_GetPoints();
+
+/*
+ * Returns the mean DWT cycles spent sampling per point given out,
+ * the rejected samples and those without a touch included.
+ * 0 until the first point.
+ */
+uint32_t LCD_Touch_GetCyclesPerPoint();
+
+/*
+ * Returns the raw ADC values of the last point read.
+ */
+void LCD_Touch_GetRaw(uint16_t* x, uint16_t* y);
+
+
+
+// ------------------- Calibration -------------------
+
+/*
+ * Computes the calibration from n >= 3 screen points xy[] (x, y pairs
+ * in the current rotation) and the raw ADC values raw[] (x, y pairs)
+ * read there. Three points give an exact fit, more a least-squares one.
+ * Returns 0 if the points are collinear or too close together for the
+ * fixed point coefficients, the calibration is unchanged then.
+ */
+uint8_t LCD_Touch_Calibrate(const int16_t* xy, const uint16_t* raw, uint8_t n);
+
+/*
+ * Writes the calibration to LCD_TOUCH_CAL_SECTOR.
+ * LCD_Touch_Init() loads it from there.
+ */
+HAL_StatusTypeDef LCD_Touch_SaveCalibration();
+
+void LCD_Touch_GetCalibration(LCD_TouchCalibration* cal);
+void LCD_Touch_SetCalibration(const LCD_TouchCalibration* cal);
+
 /*
  * Indicates the start of a touch.
  * Should be called from EXTIx_IRQHandler interrupt only.
@@ -109,6 +245,25 @@ void LCD_Touch_OnUp();
  */
 LCD_TouchState LCD_Touch_GetState();
 
+#if defined (USE_TOUCH_ASYNC)
+/*
+ * Starts a touch sample in the background, if none is running.
+ * Samples start by themselves on a touch and every LCD_TOUCH_PERIOD_US
+ * while touched; LCD_Touch_Read() returns the last one without waiting.
+ */
+HAL_StatusTypeDef LCD_Touch_Sample();
+
+/*
+ * Should be called from TIM7_IRQHandler interrupt only.
+ */
+void LCD_Touch_TIM_IRQHandler();
+
+/*
+ * Should be called from ADC_IRQHandler interrupt only.
+ */
+void LCD_Touch_ADC_IRQHandler();
+#endif
+
 
 
 // -------------------- Drawing the last touch --------------------
@@ -120,4 +275,11 @@ void LCD_Touch_Draw_PrintInfo();
 void LCD_Touch_Draw_OnUp();
 void LCD_Touch_Draw_Update();
 
+/*
+ * Shows n (3..LCD_TOUCH_CAL_POINTS) crosses one by one, waits for
+ * a touch on each, then calibrates and saves the calibration.
+ * Returns 1 on success.
+ */
+uint8_t LCD_Touch_Draw_Calibrate(uint8_t n);
+
 #endif /* __LCD_TOUCH_H */
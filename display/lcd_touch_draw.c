@@ -31,9 +31,11 @@ void LCD_Touch_Draw_ConnectLastPoint(const LCD_TouchPoint* p) {
 	if (m_last_touch_point.state == LCD_TOUCH_DOWN || m_last_touch_point.state == LCD_TOUCH_MOVE) {
 		// connect two last points
 		LCD_SetMode(LCD_MODE_DRAW);
+		LCD_BeginBatch();
 		LCD_DrawLine(m_last_touch_point.x, m_last_touch_point.y, p->x, p->y, WHITE);
 		DrawTouchPoint(&m_last_touch_point);
 		DrawTouchPoint(p);
+		LCD_EndBatch();
 		LCD_SetMode(LCD_MODE_TOUCH);
 	}
 	m_last_touch_point.x = p->x;
@@ -66,7 +68,6 @@ void LCD_Touch_Draw_PrintInfo() {
 		break;
 	}
 
-	//FIXME throws extra one or two TOUCH_UP interrupts
 	LCD_SetMode(LCD_MODE_TOUCH);
 }
 
@@ -85,3 +86,60 @@ void LCD_Touch_Draw_OnUp() {
 	m_last_touch_point.state = LCD_TOUCH_UP;
 	m_is_redraw_needed = 1U;
 }
+
+static void DrawCross(int16_t x, int16_t y, uint16_t color) {
+	LCD_SetMode(LCD_MODE_DRAW);
+	LCD_DrawFastHLine(x - 8, y, 17, color);
+	LCD_DrawFastVLine(x, y - 8, 17, color);
+	LCD_SetMode(LCD_MODE_TOUCH);
+}
+
+uint8_t LCD_Touch_Draw_Calibrate(uint8_t n) {
+	int16_t w = (LCD_GetRotation() & 1) ? TFTHEIGHT : TFTWIDTH;
+	int16_t h = (LCD_GetRotation() & 1) ? TFTWIDTH : TFTHEIGHT;
+	int16_t xy[2 * LCD_TOUCH_CAL_POINTS] = {
+			w / 8, h / 8,
+			7 * w / 8, h / 8,
+			w / 2, 7 * h / 8,
+			7 * w / 8, 7 * h / 8,
+			w / 8, 7 * h / 8
+	};
+	uint16_t raw[2 * LCD_TOUCH_CAL_POINTS];
+	LCD_TouchPoint p;
+
+	if (n < 3 || n > LCD_TOUCH_CAL_POINTS) {
+		return 0;
+	}
+
+	// forget the touches made before
+	while (LCD_Touch_Drain(&p, 1));
+
+	for (uint8_t i = 0; i < n; i++) {
+		uint32_t sum_x = 0, sum_y = 0, count = 0;
+		uint16_t x, y;
+
+		DrawCross(xy[2 * i], xy[2 * i + 1], WHITE);
+		// average the touch until it is released
+		do {
+			if (LCD_Touch_Read(&p) != LCD_TOUCH_READ_SUCCESS) {
+				continue;
+			}
+			if (p.state != LCD_TOUCH_UP) {
+				LCD_Touch_GetRaw(&x, &y);
+				sum_x += x;
+				sum_y += y;
+				count++;
+			}
+		} while (count == 0 || p.state != LCD_TOUCH_UP);
+		DrawCross(xy[2 * i], xy[2 * i + 1], BLACK);
+
+		raw[2 * i] = (sum_x + count / 2) / count;
+		raw[2 * i + 1] = (sum_y + count / 2) / count;
+	}
+
+	if (!LCD_Touch_Calibrate(xy, raw, n)) {
+		return 0;
+	}
+
+	return LCD_Touch_SaveCalibration() == HAL_OK;
+}
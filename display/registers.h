@@ -75,8 +75,11 @@
 #define ILI9341_PAGEADDRSET			0x2B
 #define ILI9341_MEMORYWRITE			0x2C
 #define ILI9341_MEMORYREAD			0x2E
+#define ILI9341_MEMORYWRITECONT		0x3C
+#define ILI9341_VSCRDEF				0x33
 #define ILI9341_MEMCONTROL			0x36
 #define ILI9341_MADCTL				0x36
+#define ILI9341_VSCRSADD			0x37
 #define ILI9341_PIXELFORMAT			0x3A
 #define ILI9341_FRAMECONTROL		0xB1
 #define ILI9341_INVERSIONCONTROL	0xB4
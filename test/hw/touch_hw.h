@@ -0,0 +1,124 @@
+/*
+ * touch_hw.h
+ *
+ * Host model of the resistive touch panel on the pins it shares with the
+ * LCD bus, for tests that include display/lcd_touch.c.
+ *
+ * The real HAL and CMSIS headers are used, with GPIOA, GPIOB, EXTI, SYSCFG,
+ * RCC, TIM7, DWT and CoreDebug pointed at plain register blocks. The board
+ * side looks at those blocks whenever it acts:
+ *
+ *   - BSRR writes reach ODR by the next GPIOA or GPIOB access, and the
+ *     level of Y+ (PA4) is worked out from the pin modes and the touch: pulled up, or pulled low by X- (PA1)
+ *     while touched. A level change on an unmasked EXTI4 pends EXTI4_IRQn.
+ *   - A conversion reads the channel selected in SQR3 and counts as bad
+ *     unless the pins drive the plate it measures: channel 4 (Y+) needs
+ *     X- low and X+ (PA8) high, channel 1 (X-) needs Y+ high and Y- (PB10) low.
+ *     A conversion takes HW_ADC_CONV_US.
+ *   - Every DWT access moves the cycle counter on by one cycle.
+ *
+ * Hw_Run() lets the simulated time pass and delivers EXTI4, ADC end of
+ * conversion and TIM7 update interrupts to the lcd_touch.c handlers, in
+ * that order, as the NVIC would at one shared priority.
+ *
+ */
+
+#ifndef __TOUCH_HW_H
+#define __TOUCH_HW_H
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+#define HW_CPU_MHZ			180
+#define HW_ADC_CONV_US		1		// one conversion, sampling included
+#define HW_ADC_FULL			4095	// a floating plate reads full scale
+#define HW_IRQ_NUM			96
+#define HW_FLASH_SIZE		64
+
+typedef struct {
+	uint8_t touched;
+	uint16_t x, y;				// conversions of the touched plates
+	const uint16_t *trace;		// if set, conversions of either plate come from here first
+	uint32_t trace_len;
+	uint32_t trace_pos;
+	uint32_t release_at;		// if set, the touch ends as conversions reaches it
+	uint32_t conversions;
+	uint32_t bad_conversions;	// started with the pins in the wrong state
+} Hw_Panel;
+
+extern Hw_Panel Hw_panel;
+extern uint8_t Hw_rotation;			// LCD_GetRotation()
+extern uint8_t Hw_bus_busy;			// LCD_IsBusBusy()
+extern uint32_t Hw_flash[HW_FLASH_SIZE];
+
+extern GPIO_TypeDef Hw_GPIOA, Hw_GPIOB;
+extern EXTI_TypeDef Hw_EXTI;
+extern SYSCFG_TypeDef Hw_SYSCFG;
+extern RCC_TypeDef Hw_RCC;
+extern TIM_TypeDef Hw_TIM7;
+extern DWT_Type Hw_DWT_Regs;
+extern CoreDebug_Type Hw_CoreDebug;
+extern ADC_TypeDef Hw_ADC1, Hw_ADC2;
+extern ADC_HandleTypeDef Hw_hadc1, Hw_hadc2;	// Y (channel 1) and X (channel 4), as in main.c
+
+extern uint8_t Hw_nvic_enabled[HW_IRQ_NUM];
+extern uint8_t Hw_nvic_pending[HW_IRQ_NUM];
+extern uint8_t Hw_irq_off;
+extern uint32_t Hw_adc_configs;		// HAL_ADC_ConfigChannel() calls
+
+GPIO_TypeDef* Hw_GPIO(GPIO_TypeDef *port);
+DWT_Type* Hw_DWT(void);
+void Hw_DisableIRQ(void);
+void Hw_EnableIRQ(void);
+
+#undef GPIOA
+#undef GPIOB
+#undef EXTI
+#undef SYSCFG
+#undef RCC
+#undef TIM7
+#undef DWT
+#undef CoreDebug
+#define GPIOA		(Hw_GPIO(&Hw_GPIOA))
+#define GPIOB		(Hw_GPIO(&Hw_GPIOB))
+#define EXTI		(&Hw_EXTI)
+#define SYSCFG		(&Hw_SYSCFG)
+#define RCC			(&Hw_RCC)
+#define TIM7		(&Hw_TIM7)
+#define DWT			(Hw_DWT())
+#define CoreDebug	(&Hw_CoreDebug)
+
+// The CMSIS intrinsics are ARM instructions
+#define __DMB()				__sync_synchronize()
+#define __disable_irq()		Hw_DisableIRQ()
+#define __enable_irq()		Hw_EnableIRQ()
+
+// The calibration record lives in Hw_flash
+#include "lcd_touch.h"
+#undef LCD_TOUCH_CAL_ADDR
+#define LCD_TOUCH_CAL_ADDR	((uintptr_t) Hw_flash)
+
+/**
+ * \brief Puts the registers in the state LCD_Init() leaves, erases the flash
+ *        and clears the panel, the NVIC and the clock
+ */
+void Hw_Reset(void);
+
+/**
+ * \brief Touches or releases the panel
+ */
+void Hw_SetTouch(uint8_t touched);
+
+/**
+ * \brief Lets the simulated time pass, delivering the interrupts that come due
+ *
+ * \param us		Microseconds
+ */
+void Hw_Run(uint32_t us);
+
+/**
+ * \brief Returns the level of Y+ (PA4) as the board drives it
+ */
+uint8_t Hw_YPlus(void);
+
+#endif /* __TOUCH_HW_H */
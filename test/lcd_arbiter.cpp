@@ -0,0 +1,356 @@
+/*
+ * lcd_arbiter.cpp
+ *
+ * The USE_TOUCH_ARBITER side of lcd.c on the ILI9341 bus model. The hooks
+ * of lcd_touch.c are replaced here, and time is counted in WR strobes:
+ *   - a touch sample is due BUDGET strobes after the last one, long
+ *     floods, bitmaps (from memory and from a file), pixel blocks, band
+ *     and canvas pushes and text must take it within one chunk of
+ *     LCD_ARBITER_CHUNK_PX pixels, so no gap between samples grows past
+ *     BUDGET + 2 * LCD_ARBITER_CHUNK_PX + SLACK strobes
+ *   - samples run with CS idle, and the picture comes out whole although
+ *     they scramble the shared pins
+ *   - every primitive claims the pins before it strobes, inside a batch too,
+ *     as a touch read may have taken them between two primitives
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lcd.h"
+#include "lcd_touch.h"
+#include "ili9341_sim.h"
+
+#define BUDGET		2000		// strobes between samples
+#define SLACK		64			// a command and its window between two yield points
+#define GAP_MAX		(BUDGET + 2 * LCD_ARBITER_CHUNK_PX + SLACK)
+
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+static uint8_t m_touch_mode;		// the touch panel holds the pins
+static uint32_t m_touch_strobes;	// strobes when it took them
+static uint32_t m_last;				// strobes at the last sample or claim
+static uint32_t m_gap_max;
+static uint32_t m_samples;
+static uint32_t m_claims;
+static uint32_t m_stolen;			// strobes while the touch panel held the pins
+static uint32_t m_cs_active;		// samples with CS active
+
+static uint32_t Now(void) {
+	return Sim_GetCounts()->strobes;
+}
+
+static void Gap(void) {
+	if (Now() - m_last > m_gap_max)
+		m_gap_max = Now() - m_last;
+}
+
+// ------------------- The lcd_touch.c hooks -------------------
+
+void LCD_Touch_Arbiter_Claim() {
+	m_claims++;
+	if (m_touch_mode) {
+		if (Now() != m_touch_strobes)
+			m_stolen++;
+		m_touch_mode = 0;
+		m_last = Now();
+	}
+}
+
+uint8_t LCD_Touch_Arbiter_Due() {
+	return !m_touch_mode && Now() - m_last >= BUDGET;
+}
+
+// Drives the shared pins as a measurement would, then puts the levels back
+void LCD_Touch_Arbiter_Sample() {
+	uint32_t a = Sim_GPIOA.ODR, b = Sim_GPIOB.ODR;
+
+	if (!(Sim_GPIOB.ODR & GPIO_PIN_0))
+		m_cs_active++;
+	Gap();
+	m_samples++;
+	GPIOA->BSRR = (GPIO_PIN_1 << 16) | GPIO_PIN_4 | GPIO_PIN_8;
+	GPIOB->BSRR = GPIO_PIN_10 << 16;
+	GPIOA->BSRR = GPIO_PIN_1;
+	GPIOA->BSRR = ((GPIO_PIN_1 | GPIO_PIN_4 | GPIO_PIN_8) & a)
+			| (((GPIO_PIN_1 | GPIO_PIN_4 | GPIO_PIN_8) & ~a) << 16);
+	GPIOB->BSRR = (GPIO_PIN_10 & b) | ((GPIO_PIN_10 & ~b) << 16);
+	m_last = Now();
+}
+
+// As LCD_Touch_Read() leaves the pins
+static void TouchMode(void) {
+	m_touch_mode = 1;
+	m_touch_strobes = Now();
+}
+
+// ------------------- Latency -------------------
+
+typedef void (*Drawing)(void);
+
+static uint16_t m_bmp_td[54 / 2 + 200 * 100];	// 16 bpp, top-down
+static uint16_t m_bmp_bu[54 / 2 + 200 * 100];	// 16 bpp, bottom-up
+
+static void MakeBmp(uint16_t *bmp, int32_t height) {
+	uint8_t *h = (uint8_t *) bmp;
+	uint32_t offset = 54, size = 54 + 200 * 100 * 2;
+
+	memset(h, 0, 54);
+	memcpy(h + 2, &size, 4);
+	memcpy(h + 10, &offset, 4);
+	h[18] = 200;
+	memcpy(h + 22, &height, 4);
+	h[28] = 16;
+	for (uint32_t i = 0; i < 200 * 100; i++)
+		bmp[54 / 2 + i] = (uint16_t) (i * 2654435761U >> 16);
+}
+
+static uint16_t m_frame[SIM_HEIGHT * SIM_WIDTH];
+static uint16_t m_strip[SIM_WIDTH * 32];
+static uint8_t m_canvas[SIM_HEIGHT * SIM_WIDTH];
+static uint16_t m_palette[256];
+
+static void MakeFrame(void) {
+	for (uint32_t i = 0; i < SIM_HEIGHT * SIM_WIDTH; i++) {
+		m_frame[i] = (uint16_t) (i * 40503U);
+		m_canvas[i] = (uint8_t) (i * 7 + i / SIM_WIDTH);
+	}
+	for (uint32_t i = 0; i < 256; i++)
+		m_palette[i] = (uint16_t) (i * 0x0101 ^ 0x5A5A);
+}
+
+static FIL OpenBmp(const uint16_t *bmp) {
+	FIL f = { (const uint8_t *) bmp, 54 + 200 * 100 * 2, 0 };
+	return f;
+}
+
+static void FillScreen(void) {
+	LCD_FillScreen(0xF81F);
+}
+
+static void FillRect(void) {
+	LCD_FillRect(10, 10, 200, 250, 0x07E0);
+}
+
+static void BmpTopDown(void) {
+	LCD_DrawBMP(20, 30, (const uint8_t *) m_bmp_td);
+}
+
+static void BmpBottomUp(void) {
+	LCD_DrawBMP(20, 30, (const uint8_t *) m_bmp_bu);
+}
+
+static void BmpFileTopDown(void) {
+	FIL f = OpenBmp(m_bmp_td);
+	LCD_DrawBMPFromFile(20, 30, &f);
+}
+
+static void BmpFileBottomUp(void) {
+	FIL f = OpenBmp(m_bmp_bu);
+	LCD_DrawBMPFromFile(20, 30, &f);
+}
+
+static void WriteFrame(void) {
+	LCD_WritePixels(0, 0, SIM_WIDTH, SIM_HEIGHT, m_frame);
+}
+
+static void WriteBlock(void) {
+	LCD_WritePixelsStride(10, 10, 201, 250, m_frame, SIM_WIDTH);
+}
+
+static void Bands(void) {
+	LCD_RenderBands(m_strip, 32, WriteFrame);
+}
+
+static void CanvasFlush(void) {
+	LCD_CanvasBegin(m_canvas, m_palette);
+	LCD_CanvasFlush();
+	LCD_CanvasEnd();
+}
+
+static void Text(void) {
+	LCD_SetTextSize(4);
+	LCD_SetCursor(0, 0);
+	LCD_Printf("Touch samples run between the glyphs of long text too. 0123456789");
+}
+
+static void ScaledText(void) {
+	LCD_SetTextSize(4);
+	LCD_SetTextScale(3);
+	LCD_SetCursor(0, 0);
+	LCD_Printf("Big");
+	LCD_SetTextScale(1);
+}
+
+static void BatchedFills(void) {
+	LCD_BeginBatch();
+	for (int16_t i = 0; i < 8; i++)
+		LCD_FillRect(0, i * 40, 240, 40, i * 0x1111);
+	LCD_EndBatch();
+}
+
+static const struct {
+	const char *name;
+	Drawing draw;
+} m_drawings[] = {
+	{ "FillScreen", FillScreen },
+	{ "FillRect", FillRect },
+	{ "DrawBMP top-down", BmpTopDown },
+	{ "DrawBMP bottom-up", BmpBottomUp },
+	{ "BMP file top-down", BmpFileTopDown },
+	{ "BMP file bottom-up", BmpFileBottomUp },
+	{ "WritePixels", WriteFrame },
+	{ "WritePixelsStride", WriteBlock },
+	{ "RenderBands", Bands },
+	{ "CanvasFlush", CanvasFlush },
+	{ "Printf", Text },
+	{ "Printf scaled", ScaledText },
+	{ "batched fills", BatchedFills },
+};
+
+static void CheckLatency(void) {
+	printf("%-20s %10s %8s %8s\n", "drawing", "strobes", "samples", "max gap");
+	for (const auto &d : m_drawings) {
+		uint32_t start;
+
+		TouchMode();
+		m_gap_max = 0;
+		m_samples = 0;
+		m_cs_active = 0;
+		start = Now();
+		d.draw();
+		Gap();  // the wait after the last sample counts too
+		printf("%-20s %10u %8u %8u\n", d.name, (unsigned) (Now() - start), (unsigned) m_samples,
+				(unsigned) m_gap_max);
+		if (m_gap_max > GAP_MAX) {
+			printf("%s: %u strobes without a sample, %u allowed\n", d.name, (unsigned) m_gap_max,
+					(unsigned) GAP_MAX);
+			m_failed++;
+		}
+		CHECK(m_samples >= (Now() - start) / GAP_MAX);
+		CHECK(m_cs_active == 0);
+	}
+}
+
+// The samples must not show in the picture
+static void CheckPicture(void) {
+	const uint16_t *px = m_bmp_td + 54 / 2;
+	uint32_t bad = 0;
+
+	TouchMode();
+	FillScreen();
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			bad += Sim_GetPixel(x, y) != 0xF81F;
+	BmpTopDown();
+	for (int16_t y = 0; y < 100; y++)
+		for (int16_t x = 0; x < 200; x++)
+			bad += Sim_GetPixel(20 + x, 30 + y) != px[y * 200 + x];
+	FillScreen();
+	BmpFileBottomUp();
+	for (int16_t y = 0; y < 100; y++)
+		for (int16_t x = 0; x < 200; x++)
+			bad += Sim_GetPixel(20 + x, 129 - y) != px[y * 200 + x];
+	Bands();
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			bad += Sim_GetPixel(x, y) != m_frame[y * SIM_WIDTH + x];
+	CanvasFlush();
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			bad += Sim_GetPixel(x, y) != m_palette[m_canvas[y * SIM_WIDTH + x]];
+	CHECK(bad == 0);
+	CHECK(m_samples > 0);
+}
+
+// ------------------- Claims -------------------
+
+static const uint16_t m_pixels[4 * 4] = { 0 };
+static const int16_t m_polygon[] = { 10, 10, 100, 20, 60, 90 };
+
+static void DrawPixel(void)		{ LCD_DrawPixel(5, 5, WHITE); }
+static void Flood(void)			{ LCD_SetAddrWindow(0, 0, 9, 9); LCD_Flood(RED, 100); }
+static void HLine(void)			{ LCD_DrawFastHLine(0, 20, 100, WHITE); }
+static void VLine(void)			{ LCD_DrawFastVLine(20, 0, 100, WHITE); }
+static void Line(void)			{ LCD_DrawLine(0, 0, 100, 70, WHITE); }
+static void Rect(void)			{ LCD_DrawRect(10, 10, 50, 40, WHITE); }
+static void Circle(void)		{ LCD_DrawCircle(100, 100, 30, WHITE); }
+static void FillCircle(void)	{ LCD_FillCircle(100, 100, 30, WHITE); }
+static void Triangle(void)		{ LCD_DrawTriangle(0, 0, 50, 90, 90, 10, WHITE); }
+static void FillTriangle(void)	{ LCD_FillTriangle(0, 0, 50, 90, 90, 10, WHITE); }
+static void Polygon(void)		{ LCD_FillPolygon(m_polygon, 3, 0, WHITE); }
+static void RoundRect(void)		{ LCD_DrawRoundRect(10, 10, 80, 60, 8, WHITE); }
+static void FillRoundRect(void)	{ LCD_FillRoundRect(10, 10, 80, 60, 8, WHITE); }
+static void Char(void)			{ LCD_DrawChar(0, 0, 'A', WHITE, BLACK, 1); }
+static void Pixels(void)		{ LCD_WritePixels(0, 0, 4, 4, m_pixels); }
+static void Window(void)		{ LCD_SetAddrWindow(0, 0, 9, 9); }
+static void Rotation(void)		{ LCD_SetRotation(0); }
+
+static const struct {
+	const char *name;
+	Drawing draw;
+} m_primitives[] = {
+	{ "DrawPixel", DrawPixel }, { "Flood", Flood }, { "DrawFastHLine", HLine },
+	{ "DrawFastVLine", VLine }, { "DrawLine", Line }, { "DrawRect", Rect },
+	{ "FillRect", FillRect }, { "FillScreen", FillScreen }, { "DrawCircle", Circle },
+	{ "FillCircle", FillCircle }, { "DrawTriangle", Triangle }, { "FillTriangle", FillTriangle },
+	{ "FillPolygon", Polygon }, { "DrawRoundRect", RoundRect }, { "FillRoundRect", FillRoundRect },
+	{ "DrawChar", Char }, { "Printf", Text }, { "DrawBMP", BmpTopDown },
+	{ "WritePixels", Pixels }, { "SetAddrWindow", Window }, { "SetRotation", Rotation },
+};
+
+static void CheckClaims(uint8_t batched) {
+	if (batched)
+		LCD_BeginBatch();
+	for (const auto &p : m_primitives) {
+		TouchMode();
+		m_claims = 0;
+		m_stolen = 0;
+		p.draw();
+		if (m_claims == 0 || m_stolen) {
+			printf("%s%s: %u claims%s\n", p.name, batched ? " in a batch" : "", (unsigned) m_claims,
+					m_stolen ? ", strobed before claiming" : "");
+			m_failed++;
+		}
+	}
+	if (batched)
+		LCD_EndBatch();
+}
+
+// A batch claims the pins as it takes CS
+static void CheckBatchClaim(void) {
+	TouchMode();
+	m_claims = 0;
+	LCD_BeginBatch();
+	CHECK(m_claims == 1 && !m_touch_mode);
+	LCD_EndBatch();
+}
+
+int main(void) {
+	Sim_Reset();
+	LCD_Init();
+	MakeBmp(m_bmp_td, -100);
+	MakeBmp(m_bmp_bu, 100);
+	MakeFrame();
+
+	CheckLatency();
+	CheckPicture();
+	CheckClaims(0);
+	CheckClaims(1);
+	CheckBatchClaim();
+
+	if (m_failed) {
+		printf("lcd_arbiter: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_arbiter: ok, at most %u strobes between touch samples\n", (unsigned) GAP_MAX);
+	return 0;
+}
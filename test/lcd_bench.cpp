@@ -0,0 +1,232 @@
+/*
+ * lcd_bench.cpp
+ *
+ * Bus cost of the drawing primitives on the ILI9341 bus model.
+ *
+ * A fixed workload, modeled on the Adafruit graphicstest sketch, runs
+ * every primitive and counts WR strobes, commands, address windows (CASET
+ * and PASET) and CS activations. The counts are the cycle-cost proxy of a
+ * change: lcd.c spends its time clocking bytes out, and every command or
+ * window is bytes that carry no pixels.
+ *
+ * Usage: lcd_bench [baseline]
+ *
+ * Without an argument the counts are printed in the baseline format.
+ * With a baseline file, any count above its baseline entry, or a missing
+ * entry, fails the run. Lower counts pass and are reported, so that the
+ * baseline can be tightened with "make bench-baseline".
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lcd.h"
+#include "ili9341_sim.h"
+
+#define BENCH_MAX		32
+#define COUNT_NUM		4
+
+typedef struct {
+	const char *name;
+	uint32_t calls;
+	uint32_t count[COUNT_NUM];
+} BenchResult;
+
+static const char *const m_count_names[COUNT_NUM] = { "strobes", "commands", "windows", "cs" };
+static BenchResult m_results[BENCH_MAX];
+static uint8_t m_nresults;
+
+#define W		TFTWIDTH
+#define H		TFTHEIGHT
+
+/* Closes a primitive: stores its counts and clears the counters */
+static void Bench_End(const char *name, uint32_t calls) {
+	const Sim_Counts *c = Sim_GetCounts();
+	BenchResult *r = &m_results[m_nresults++];
+	r->name = name;
+	r->calls = calls;
+	r->count[0] = c->strobes;
+	r->count[1] = c->commands;
+	r->count[2] = c->windows;
+	r->count[3] = c->cs;
+	Sim_ResetCounts();
+}
+
+static void Bench_Workload(void) {
+	uint32_t n;
+	int16_t i, j;
+
+	Sim_ResetCounts();
+	LCD_FillScreen(BLACK);
+	LCD_FillScreen(0xF800);
+	LCD_FillScreen(0x07E0);
+	LCD_FillScreen(0x001F);
+	LCD_FillScreen(BLACK);
+	Bench_End("FillScreen", 5);
+
+	LCD_DrawPixel(0, 0, WHITE);
+	for (n = 1, i = 0; i < H; i += 7, n++)
+		LCD_DrawPixel((i * 3) % W, i, WHITE);
+	Bench_End("DrawPixel", n);
+
+	for (n = 0, i = 0; i < W; i += 6, n += 2) {
+		LCD_DrawLine(0, 0, i, H - 1, 0x07FF);
+		LCD_DrawLine(W - 1, H - 1, i, 0, 0x07FF);
+	}
+	for (i = 0; i < H; i += 6, n += 2) {
+		LCD_DrawLine(0, 0, W - 1, i, 0xFFE0);
+		LCD_DrawLine(W - 1, H - 1, 0, i, 0xFFE0);
+	}
+	Bench_End("DrawLine", n);
+
+	for (n = 0, i = 0; i < H; i += 5, n++)
+		LCD_DrawFastHLine(0, i, W, 0xF800);
+	Bench_End("DrawFastHLine", n);
+	for (n = 0, i = 0; i < W; i += 5, n++)
+		LCD_DrawFastVLine(i, 0, H, 0x001F);
+	Bench_End("DrawFastVLine", n);
+
+	for (n = 0, i = 2; i < W; i += 6, n++)
+		LCD_DrawRect(W / 2 - i / 2, H / 2 - i / 2, i, i, 0x07E0);
+	Bench_End("DrawRect", n);
+	for (n = 0, i = W - 1; i > 6; i -= 6, n++)
+		LCD_FillRect(W / 2 - i / 2, H / 2 - i / 2, i, i, 0xFFE0);
+	Bench_End("FillRect", n);
+
+	for (n = 0, i = 10; i < W; i += 20)
+		for (j = 10; j < H; j += 20, n++)
+			LCD_FillCircle(i, j, 10, 0xF81F);
+	Bench_End("FillCircle", n);
+	for (n = 0, i = 0; i < W + 10; i += 20)
+		for (j = 0; j < H + 10; j += 20, n++)
+			LCD_DrawCircle(i, j, 10, WHITE);
+	Bench_End("DrawCircle", n);
+
+	for (n = 0, i = 0; i < W / 2; i += 5, n++)
+		LCD_DrawTriangle(W / 2, H / 2 - i, W / 2 - i, H / 2 + i, W / 2 + i, H / 2 + i, 0x07FF);
+	Bench_End("DrawTriangle", n);
+	for (n = 0, i = W / 2; i > 10; i -= 5, n++)
+		LCD_FillTriangle(W / 2, H / 2 - i, W / 2 - i, H / 2 + i, W / 2 + i, H / 2 + i, LCD_Color565(0, i, i));
+	Bench_End("FillTriangle", n);
+
+	for (n = 0, i = 0; i < W / 2; i += 6, n++)
+		LCD_DrawRoundRect(W / 2 - i, H / 2 - i, 2 * i + 1, 2 * i + 1, i / 8, LCD_Color565(i, 0, 0));
+	Bench_End("DrawRoundRect", n);
+	for (n = 0, i = W / 2; i > 20; i -= 6, n++)
+		LCD_FillRoundRect(W / 2 - i, H / 2 - i, 2 * i + 1, 2 * i + 1, i / 8, LCD_Color565(0, i, 0));
+	Bench_End("FillRoundRect", n);
+
+	for (n = 0, i = 0; i < 95; i++, n++)
+		LCD_DrawChar((i % 16) * 15, (i / 16) * 30, ' ' + i, WHITE, BLACK, 3);
+	Bench_End("DrawChar", n);
+
+	LCD_FillScreen(BLACK);
+	Sim_ResetCounts();
+	LCD_SetTextColor(WHITE, BLACK);
+	LCD_SetCursor(0, 0);
+	LCD_SetTextSize(1);
+	LCD_Printf("Hello World!\n");
+	LCD_SetTextColor(0xFFE0, BLACK);
+	LCD_SetTextSize(2);
+	LCD_Printf("%.2f\n", 1234.56);
+	LCD_SetTextColor(0xF800, BLACK);
+	LCD_SetTextSize(3);
+	LCD_Printf("0x%X\n", 0xDEADBEEF);
+	LCD_SetTextColor(0x07E0, BLACK);
+	LCD_SetTextSize(4);
+	LCD_Printf("Groop\n");
+	LCD_SetTextSize(2);
+	LCD_Printf("I implore thee,\n");
+	LCD_SetTextSize(1);
+	LCD_Printf("my foonting turlingdromes.\n");
+	LCD_Printf("And hooptiously drangle me\n");
+	LCD_Printf("with crinkly bindlewurdles,\n");
+	LCD_Printf("Or I will rend thee\n");
+	LCD_Printf("in the gobberwarts\n");
+	LCD_Printf("with my blurglecruncheon,\n");
+	LCD_Printf("see if I don't!\n");
+	Bench_End("Printf", 12);
+
+	LCD_SetTextScaled(1);
+	LCD_SetTextScale(3);
+	LCD_SetCursor(0, 160);
+	LCD_Printf("Scaled 3x");
+	LCD_SetTextScaled(0);
+	Bench_End("PrintfScaled", 1);
+}
+
+static void Bench_Print(FILE *f) {
+	fprintf(f, "# %-20s %7s %10s %9s %9s %6s\n", "primitive", "calls", m_count_names[0], m_count_names[1],
+			m_count_names[2], m_count_names[3]);
+	for (uint8_t i = 0; i < m_nresults; i++) {
+		const BenchResult *r = &m_results[i];
+		fprintf(f, "%-22s %7u %10u %9u %9u %6u\n", r->name, (unsigned) r->calls, (unsigned) r->count[0],
+				(unsigned) r->count[1], (unsigned) r->count[2], (unsigned) r->count[3]);
+	}
+}
+
+/* Compares the results with a baseline file, returns the number of regressions */
+static int Bench_Compare(const char *path) {
+	char line[256];
+	uint8_t seen[BENCH_MAX] = { 0 };
+	int failed = 0;
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		printf("cannot read %s\n", path);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		char name[64];
+		unsigned calls, base[COUNT_NUM];
+		uint8_t i, k;
+		if ((line[0] == '#') || (sscanf(line, "%63s %u %u %u %u %u", name, &calls, &base[0], &base[1], &base[2], &base[3]) != 6))
+			continue;
+		for (i = 0; i < m_nresults; i++) {
+			if (!strcmp(m_results[i].name, name))
+				break;
+		}
+		if (i == m_nresults) {
+			printf("%-22s in the baseline but not measured\n", name);
+			continue;
+		}
+		seen[i] = 1;
+		for (k = 0; k < COUNT_NUM; k++) {
+			if (m_results[i].count[k] > base[k]) {
+				printf("%-22s %s %u, baseline %u: REGRESSION\n", name, m_count_names[k],
+						(unsigned) m_results[i].count[k], base[k]);
+				failed++;
+			} else if (m_results[i].count[k] < base[k]) {
+				printf("%-22s %s %u, baseline %u: lower\n", name, m_count_names[k],
+						(unsigned) m_results[i].count[k], base[k]);
+			}
+		}
+	}
+	fclose(f);
+	for (uint8_t i = 0; i < m_nresults; i++) {
+		if (!seen[i]) {
+			printf("%-22s has no baseline entry\n", m_results[i].name);
+			failed++;
+		}
+	}
+	return failed;
+}
+
+int main(int argc, char **argv) {
+	Sim_Reset();
+	LCD_Init();
+	Bench_Workload();
+
+	if (argc < 2) {
+		Bench_Print(stdout);
+		return 0;
+	}
+	int failed = Bench_Compare(argv[1]);
+	if (failed) {
+		printf("lcd_bench: %d regressions against %s\n", failed, argv[1]);
+		return 1;
+	}
+	printf("lcd_bench: no count above %s\n", argv[1]);
+	return 0;
+}
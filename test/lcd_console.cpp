@@ -0,0 +1,150 @@
+/*
+ * lcd_console.cpp
+ *
+ * LCD_ScrollConsole() scrolls LCD_Printf() text with VSCRDEF and VSCRSADD.
+ * Checks on the ILI9341 bus model, with the vertical scroll applied to the
+ * picture, that:
+ *   - after many lines the console shows the last ones, in order, between
+ *     an untouched header and footer (rotations 0 and 2)
+ *   - the VSCRDEF areas add up to the frame memory lines
+ *   - LCD_SetCursor() moves the console to the line that holds its row
+ *   - a landscape LCD_ScrollConsole() turns the console off and resets the
+ *     scrolling
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lcd.h"
+#include "ili9341_sim.h"
+
+#define TOP			24
+#define BOTTOM		30
+
+static uint16_t m_expected[SIM_HEIGHT][SIM_WIDTH];
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+static uint16_t LineHeight(void) {
+	LCD_SetCursor(0, 0);
+	LCD_Printf("\n");
+	return LCD_GetCursorY();
+}
+
+/* Header, footer and the console lines first..last drawn without scrolling */
+static void DrawExpected(uint16_t lh, uint16_t lines, int first, int last) {
+	LCD_FillScreen(0x001F);
+	LCD_FillRect(0, TOP, TFTWIDTH, lines * lh, BLACK);
+	for (int i = first; i <= last; i++) {
+		LCD_SetCursor(0, TOP + (i - first) * lh);
+		LCD_Printf("line %d", i);
+	}
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			m_expected[y][x] = Sim_GetPixel(x, y);
+}
+
+static uint8_t DisplayMatches(void) {
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			if (Sim_GetPixel(x, y) != m_expected[y][x])
+				return 0;
+	return 1;
+}
+
+static void CheckScrollAreas(void) {
+	uint16_t tfa, vsa, bfa, vsp;
+	Sim_GetScroll(&tfa, &vsa, &bfa, &vsp);
+	CHECK(tfa + vsa + bfa == SIM_HEIGHT);
+	CHECK((vsp >= tfa) && (vsp < tfa + vsa));
+}
+
+static void CheckScrolling(uint8_t rotation) {
+	LCD_SetRotation(rotation);
+	LCD_SetTextColor(WHITE, BLACK);
+	LCD_SetTextSize(1);
+	uint16_t lh = LineHeight();
+	uint16_t lines = (TFTHEIGHT - TOP - BOTTOM) / lh;
+	int n = 3 * lines + 5;
+
+	// lines and the blank line the cursor is on after the last one
+	DrawExpected(lh, lines, n - lines + 1, n - 1);
+
+	LCD_FillScreen(0x001F);
+	CHECK(LCD_ScrollConsole(TOP, BOTTOM) == 1);
+	for (int i = 0; i < n; i++)
+		LCD_Printf("line %d\n", i);
+	CHECK(DisplayMatches());
+	CheckScrollAreas();
+	LCD_ScrollConsoleEnd();
+	CheckScrollAreas();
+}
+
+static void CheckSetCursor(void) {
+	LCD_SetRotation(0);
+	LCD_SetTextSize(1);
+	uint16_t lh = LineHeight();
+	uint16_t lines = (TFTHEIGHT - TOP - BOTTOM) / lh;
+	uint16_t rows = lines * lh;
+
+	CHECK(LCD_ScrollConsole(TOP, BOTTOM) == 1);
+	LCD_SetCursor(0, TOP + 5 * lh);
+	LCD_Printf("\n");
+	CHECK(LCD_GetCursorY() == TOP + 6 * lh);
+
+	// scroll by s lines, the row of line l is then TOP + ((s + l) * lh) % rows
+	uint16_t s = 4;
+	LCD_SetCursor(0, TOP + (lines - 1) * lh);
+	for (uint16_t i = 0; i < s; i++)
+		LCD_Printf("\n");
+	LCD_SetCursor(0, TOP + ((s + 2) * lh) % rows);
+	LCD_Printf("\n");
+	CHECK(LCD_GetCursorY() == TOP + ((s + 3) * lh) % rows);
+	LCD_ScrollConsoleEnd();
+}
+
+static void CheckLandscape(void) {
+	LCD_SetRotation(0);
+	CHECK(LCD_ScrollConsole(TOP, BOTTOM) == 1);
+	for (int i = 0; i < 50; i++)
+		LCD_Printf("line %d\n", i);
+	LCD_SetRotation(1);
+	CHECK(LCD_ScrollConsole(TOP, BOTTOM) == 0);
+	CheckScrollAreas();
+	LCD_FillScreen(BLACK);
+	LCD_FillRect(10, 10, 20, 20, WHITE);
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			m_expected[y][x] = Sim_GRAM[y][x];
+	CHECK(DisplayMatches());
+
+	// the console is off, text goes down the screen again
+	LCD_SetCursor(0, 0);
+	LCD_Printf("\n\n");
+	CHECK(LCD_GetCursorY() == 2 * LineHeight());
+	LCD_SetRotation(0);
+}
+
+int main(void) {
+	Sim_Reset();
+	LCD_Init();
+
+	CheckScrolling(0);
+	CheckScrolling(2);
+	CheckSetCursor();
+	CheckLandscape();
+
+	if (m_failed) {
+		printf("lcd_console: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_console: scrolled console checks passed\n");
+	return 0;
+}
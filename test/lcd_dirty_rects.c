@@ -0,0 +1,113 @@
+/*
+ * lcd_dirty_rects.c
+ *
+ * Feeds random rectangles to lcd_dirty and checks after every
+ * LCD_Dirty_Add() that the list covers every marked pixel, stays within
+ * LCD_DIRTY_MAX and holds no overlapping rectangles, also after the merges
+ * forced by a full list. Flushes must come sorted and empty the list.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../display/lcd_dirty.c"
+
+#undef printf		// lcd.h maps it to the printf of the firmware
+
+#define SCREEN_W	TFTWIDTH
+#define SCREEN_H	TFTHEIGHT
+
+static uint8_t m_marked[SCREEN_H][SCREEN_W];
+static int m_failed;
+
+uint8_t LCD_GetRotation(void) {
+	return 0;
+}
+
+static uint32_t Random(void) {
+	static uint32_t state = 12345;
+	state = state * 1103515245 + 12345;
+	return state >> 8;
+}
+
+static void Check(uint32_t step) {
+	uint8_t i, j;
+	int16_t x, y;
+
+	if (m_count > LCD_DIRTY_MAX) {
+		printf("step %u: %u rectangles\n", (unsigned) step, m_count);
+		m_failed++;
+	}
+	for (i = 0; i < m_count; i++) {
+		for (j = i + 1; j < m_count; j++) {
+			const LCD_DirtyRect *a = &m_rects[i], *b = &m_rects[j];
+			if ((a->x1 <= b->x2) && (b->x1 <= a->x2) && (a->y1 <= b->y2) && (b->y1 <= a->y2)) {
+				printf("step %u: %d,%d-%d,%d overlaps %d,%d-%d,%d\n", (unsigned) step,
+						a->x1, a->y1, a->x2, a->y2, b->x1, b->y1, b->x2, b->y2);
+				m_failed++;
+				return;
+			}
+		}
+	}
+	for (y = 0; y < SCREEN_H; y++) {
+		for (x = 0; x < SCREEN_W; x++) {
+			if (!m_marked[y][x])
+				continue;
+			for (i = 0; i < m_count; i++) {
+				if (LCD_Dirty_Intersects(&m_rects[i], x, y, 1, 1))
+					break;
+			}
+			if (i == m_count) {
+				printf("step %u: pixel %d,%d was marked but is not dirty\n", (unsigned) step, x, y);
+				m_failed++;
+				return;
+			}
+		}
+	}
+}
+
+static void CheckSorted(const LCD_DirtyRect* rect) {
+	static LCD_DirtyRect prev;
+	static uint8_t have_prev;
+	if (rect == NULL) {
+		have_prev = 0;
+		return;
+	}
+	if (have_prev && ((rect->y1 < prev.y1) || ((rect->y1 == prev.y1) && (rect->x1 < prev.x1)))) {
+		printf("flush: %d,%d comes after %d,%d\n", rect->x1, rect->y1, prev.x1, prev.y1);
+		m_failed++;
+	}
+	prev = *rect;
+	have_prev = 1;
+}
+
+int main(void) {
+	uint32_t step;
+
+	for (step = 0; step < 4000 && !m_failed; step++) {
+		int16_t w = 1 + Random() % 4, h = 1 + Random() % 4;
+		int16_t x = Random() % (SCREEN_W + 8) - 4, y = Random() % (SCREEN_H + 8) - 4;
+		LCD_Dirty_Add(x, y, w, h);
+		for (int16_t yy = (y < 0) ? 0 : y; (yy < y + h) && (yy < SCREEN_H); yy++)
+			for (int16_t xx = (x < 0) ? 0 : x; (xx < x + w) && (xx < SCREEN_W); xx++)
+				m_marked[yy][xx] = 1;
+		Check(step);
+		if (step % 500 == 499) {
+			CheckSorted(NULL);
+			LCD_Dirty_Flush(CheckSorted);
+			memset(m_marked, 0, sizeof(m_marked));
+			if (LCD_Dirty_Count()) {
+				printf("step %u: rectangles left after a flush\n", (unsigned) step);
+				m_failed++;
+			}
+		}
+	}
+
+	if (m_failed) {
+		printf("lcd_dirty_rects: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_dirty_rects: %u rectangles added, no overlap left\n", (unsigned) step);
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * lcd_dma.cpp
+ *
+ * The USE_DMA transfers of lcd.c on the ILI9341 bus model. TIM8 and the
+ * DMA2 streams of sim/stm32f4xx_hal.h are stepped here one timer tick at
+ * a time:
+ *   - TIM8 counts up to ARR, an update ends a period, the repetition
+ *     counter loaded by UG lets RCR + 1 periods pass before one-pulse mode
+ *     stops the counter
+ *   - CNT == CCRx with CCxDE set requests one transfer of the stream of
+ *     channel x (DMA2 channel 7: CH1 stream 2, CH2 stream 3, CH3 stream 4,
+ *     CH4 stream 7), which moves one word from memory to its BSRR
+ *   - a stream turns itself off and raises TCIF when NDTR reaches 0, the
+ *     stream 7 interrupt runs LCD_DMA_IRQHandler() one tick later
+ *
+ * LCD_FloodAsync() and LCD_WritePixelsAsync() must then decode to the
+ * pixels of LCD_Flood() and LCD_WritePixelsStride(), for lengths that do
+ * and do not fill the last LCD_DMA_CHUNK, with one interrupt per chunk,
+ * no request left over once the timer stops, and one callback at the end.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+#include "lcd.h"
+#include "ili9341_sim.h"
+
+#define CHUNK_PX	(LCD_DMA_CHUNK / 2)
+#define STRIDE		250
+
+static uint16_t m_expected[SIM_HEIGHT][SIM_WIDTH];
+static uint16_t m_pixels[SIM_HEIGHT * STRIDE];
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+// ------------------- TIM8 and DMA2 -------------------
+
+static const uint8_t m_channel_stream[4] = { 2, 3, 4, 7 };
+static const uint32_t m_tcif[8] = { 1U << 5, 1U << 11, 1U << 21, 1U << 27, 1U << 5, 1U << 11, 1U << 21, 1U << 27 };
+
+static uint8_t m_on[8];			// the stream has latched its addresses
+static uint32_t m_index[8];		// words sent since
+static uint32_t m_rep;			// TIM8 repetition counter
+static uint32_t m_stray;		// requests to a stream that is off
+static uint32_t m_bad_par;		// transfers to anything but a BSRR
+static uint32_t m_irqs;
+static uint32_t m_callbacks;
+static uint8_t m_callback_busy;	// LCD_DMA_IsBusy() in the callback
+
+// The flag clear registers are write-1-to-clear
+static void ApplyClears(void) {
+	Sim_DMA2.LISR &= ~Sim_DMA2.LIFCR;
+	Sim_DMA2.LIFCR = 0;
+	Sim_DMA2.HISR &= ~Sim_DMA2.HIFCR;
+	Sim_DMA2.HIFCR = 0;
+}
+
+// A stream latches M0AR and NDTR when it is enabled
+static void LatchStreams(void) {
+	for (uint8_t s = 0; s < 8; s++) {
+		if (!(Sim_DMA2_Stream[s].CR & DMA_SxCR_EN)) {
+			m_on[s] = 0;
+		} else if (!m_on[s]) {
+			m_on[s] = 1;
+			m_index[s] = 0;
+		}
+	}
+}
+
+static GPIO_TypeDef* BsrrPort(uint32_t par) {
+	GPIO_TypeDef *ports[] = { GPIOA, GPIOB, GPIOC };
+	for (GPIO_TypeDef *port : ports) {
+		if (par == (uint32_t) (uintptr_t) &port->BSRR)
+			return port;
+	}
+	return NULL;
+}
+
+static void Request(uint8_t s) {
+	DMA_Stream_TypeDef *stream = &Sim_DMA2_Stream[s];
+	const uint32_t *word;
+	GPIO_TypeDef *port;
+
+	if (!m_on[s]) {
+		m_stray++;
+		return;
+	}
+	word = (const uint32_t *) (uintptr_t) stream->M0AR;
+	if (stream->CR & DMA_SxCR_MINC)
+		word += m_index[s];
+	port = BsrrPort(stream->PAR);
+	if (port)
+		port->BSRR = *word;
+	else
+		m_bad_par++;
+	m_index[s]++;
+	if (--stream->NDTR == 0) {
+		stream->CR &= ~DMA_SxCR_EN;
+		m_on[s] = 0;
+		if (s < 4)
+			Sim_DMA2.LISR |= m_tcif[s];
+		else
+			Sim_DMA2.HISR |= m_tcif[s];
+	}
+}
+
+static void Step(void) {
+	TIM_TypeDef *t = TIM8;
+
+	ApplyClears();
+	LatchStreams();
+	if (t->EGR & TIM_EGR_UG) {
+		t->EGR = 0;
+		t->CNT = 0;
+		m_rep = t->RCR;
+	}
+	if (t->CR1 & TIM_CR1_CEN) {
+		if (t->CNT < t->ARR) {
+			t->CNT++;
+		} else {
+			t->CNT = 0;
+			t->SR |= TIM_SR_UIF;
+			if (m_rep) {
+				m_rep--;
+			} else {
+				m_rep = t->RCR;
+				if (t->CR1 & TIM_CR1_OPM)
+					t->CR1 &= ~TIM_CR1_CEN;
+			}
+		}
+	}
+
+	// raised by the previous tick
+	if ((Sim_DMA2.HISR & DMA_HISR_TCIF7) && (Sim_DMA2_Stream[7].CR & DMA_SxCR_TCIE)
+			&& Sim_NVIC_Enabled[DMA2_Stream7_IRQn]) {
+		m_irqs++;
+		LCD_DMA_IRQHandler();
+		ApplyClears();
+		LatchStreams();
+		if (t->EGR & TIM_EGR_UG) {
+			t->EGR = 0;
+			t->CNT = 0;
+			m_rep = t->RCR;
+		}
+	}
+
+	if (t->CR1 & TIM_CR1_CEN) {
+		const uint32_t ccr[4] = { t->CCR1, t->CCR2, t->CCR3, t->CCR4 };
+		for (uint8_t c = 0; c < 4; c++) {
+			if (t->CNT == ccr[c] && (t->DIER & (TIM_DIER_CC1DE << c)))
+				Request(m_channel_stream[c]);
+		}
+	}
+}
+
+static void Done(void) {
+	m_callbacks++;
+	m_callback_busy = LCD_DMA_IsBusy();
+}
+
+// Steps until the transfer of bytes ends, then a few periods more for stray requests
+static void Run(const char *name, uint32_t bytes) {
+	uint32_t chunks = (bytes + LCD_DMA_CHUNK - 1) / LCD_DMA_CHUNK;
+	uint32_t ticks = 0, limit = (bytes + chunks) * LCD_DMA_PERIOD + 100;
+
+	while (LCD_DMA_IsBusy() && ticks++ < limit)
+		Step();
+	for (uint32_t i = 0; i < 4 * LCD_DMA_PERIOD; i++)
+		Step();
+
+	if (LCD_DMA_IsBusy() || m_irqs != chunks || m_callbacks != 1 || m_callback_busy
+			|| m_stray || m_bad_par) {
+		printf("%s: %u bytes, busy %u, %u interrupts for %u chunks, %u callbacks, %u stray requests, "
+				"%u bad addresses\n", name, (unsigned) bytes, LCD_DMA_IsBusy(), (unsigned) m_irqs,
+				(unsigned) chunks, (unsigned) m_callbacks, (unsigned) m_stray, (unsigned) m_bad_par);
+		m_failed++;
+	}
+	CHECK(!(TIM8->CR1 & TIM_CR1_CEN));
+	CHECK(Sim_GPIOB.ODR & GPIO_PIN_0);		// CS idle
+	CHECK(Sim_GPIOA.ODR & GPIO_PIN_1);		// WR idle
+}
+
+static void Start(void) {
+	m_irqs = 0;
+	m_callbacks = 0;
+	m_callback_busy = 0;
+	m_stray = 0;
+	m_bad_par = 0;
+}
+
+// ------------------- Checks -------------------
+
+static void CheckConfig(void) {
+	static const uint8_t streams[] = { 2, 3, 4, 7 };
+	GPIO_TypeDef *ports[] = { GPIOB, GPIOC, GPIOA, GPIOA };
+
+	for (uint8_t i = 0; i < 4; i++) {
+		uint32_t cr = Sim_DMA2_Stream[streams[i]].CR;
+		CHECK((cr & DMA_SxCR_CHSEL) == (7U << DMA_SxCR_CHSEL_Pos));
+		CHECK((cr & DMA_SxCR_DIR) == DMA_SxCR_DIR_0);		// memory to peripheral
+		CHECK((cr & DMA_SxCR_PSIZE) == DMA_SxCR_PSIZE_1);	// words
+		CHECK((cr & DMA_SxCR_MSIZE) == DMA_SxCR_MSIZE_1);
+		CHECK(!(cr & DMA_SxCR_EN));
+		CHECK(BsrrPort(Sim_DMA2_Stream[streams[i]].PAR) == ports[i]);
+	}
+	CHECK(TIM8->PSC == 0 && TIM8->ARR == LCD_DMA_PERIOD - 1);
+	// B and C first, then A with WR low, then WR high, all within a period
+	CHECK(TIM8->CCR1 < TIM8->CCR3 && TIM8->CCR2 < TIM8->CCR3 && TIM8->CCR3 < TIM8->CCR4
+			&& TIM8->CCR4 <= TIM8->ARR);
+	CHECK(Sim_NVIC_Enabled[DMA2_Stream7_IRQn]);
+	// the registers hold the buffers as 32-bit addresses
+	CHECK((uintptr_t) m_pixels >> 16 >> 16 == 0);
+}
+
+static void Background(void) {
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			Sim_GRAM[y][x] = (uint16_t) (x * 7 + y * 131);
+}
+
+static void Compare(const char *name) {
+	if (memcmp(m_expected, Sim_GRAM, sizeof(m_expected)) == 0)
+		return;
+	for (int16_t y = 0; y < SIM_HEIGHT; y++) {
+		for (int16_t x = 0; x < SIM_WIDTH; x++) {
+			if (m_expected[y][x] != Sim_GRAM[y][x]) {
+				printf("%s: pixel %d,%d is 0x%04X, expected 0x%04X\n", name, x, y, Sim_GRAM[y][x],
+						m_expected[y][x]);
+				m_failed++;
+				return;
+			}
+		}
+	}
+}
+
+static void CheckFlood(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint32_t len) {
+	char name[64];
+
+	snprintf(name, sizeof(name), "FloodAsync(%u px)", (unsigned) len);
+	Background();
+	LCD_SetAddrWindow(x1, y1, x2, y2);
+	LCD_Flood(0xA55A, len);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+
+	Background();
+	Start();
+	LCD_SetAddrWindow(x1, y1, x2, y2);
+	CHECK(LCD_FloodAsync(0xA55A, len, Done) == 1);
+	Run(name, len * 2);
+	Compare(name);
+}
+
+static void CheckPixels(int16_t x, int16_t y, int16_t w, int16_t h) {
+	int16_t cw = (x < 0 ? w + x : w), ch = (y < 0 ? h + y : h);
+	uint32_t bytes;
+	char name[64];
+
+	if (x + w > SIM_WIDTH) cw = SIM_WIDTH - (x < 0 ? 0 : x);
+	if (y + h > SIM_HEIGHT) ch = SIM_HEIGHT - (y < 0 ? 0 : y);
+	bytes = (uint32_t) cw * ch * 2;
+
+	snprintf(name, sizeof(name), "WritePixelsAsync(%d, %d, %d, %d)", x, y, w, h);
+	Background();
+	LCD_WritePixelsStride(x, y, w, h, m_pixels, STRIDE);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+
+	Background();
+	Start();
+	CHECK(LCD_WritePixelsAsync(x, y, w, h, m_pixels, STRIDE, Done) == 1);
+	Run(name, bytes);
+	Compare(name);
+}
+
+// A second transfer is refused while one runs
+static void CheckBusy(void) {
+	Start();
+	LCD_SetAddrWindow(0, 0, SIM_WIDTH - 1, SIM_HEIGHT - 1);
+	CHECK(LCD_FloodAsync(BLACK, 5 * CHUNK_PX, Done) == 1);
+	for (uint32_t i = 0; i < 2 * LCD_DMA_CHUNK * LCD_DMA_PERIOD; i++)
+		Step();
+	CHECK(LCD_DMA_IsBusy() && LCD_IsBusBusy());
+	CHECK(LCD_FloodAsync(WHITE, 10, Done) == 0);
+	CHECK(LCD_WritePixelsAsync(0, 0, 4, 4, m_pixels, STRIDE, Done) == 0);
+	Run("busy", 5 * LCD_DMA_CHUNK);
+	CHECK(!LCD_IsBusBusy());
+}
+
+int main(void) {
+	for (uint32_t i = 0; i < sizeof(m_pixels) / sizeof(m_pixels[0]); i++)
+		m_pixels[i] = (uint16_t) (i * 2654435761U >> 16);
+
+	Sim_Reset();
+	LCD_Init();
+	CheckConfig();
+
+	// a window that wraps the lengths over several rows
+	CheckFlood(10, 20, 49, 299, 1);
+	CheckFlood(10, 20, 49, 299, CHUNK_PX - 1);
+	CheckFlood(10, 20, 49, 299, CHUNK_PX);
+	CheckFlood(10, 20, 49, 299, CHUNK_PX + 1);
+	CheckFlood(10, 20, 49, 299, 2 * CHUNK_PX + 1);
+	CheckFlood(10, 20, 49, 299, 7 * CHUNK_PX - 1);
+	CheckFlood(0, 0, SIM_WIDTH - 1, SIM_HEIGHT - 1, SIM_WIDTH * SIM_HEIGHT);
+
+	CheckPixels(5, 5, 1, 1);
+	CheckPixels(3, 7, CHUNK_PX - 1, 1);
+	CheckPixels(3, 7, CHUNK_PX + 1, 1);
+	CheckPixels(3, 7, 11, 3);						// CHUNK_PX + 1 over three rows
+	CheckPixels(100, 50, 7, 2 * CHUNK_PX + 3);		// a row ends inside every chunk
+	CheckPixels(-5, -3, 40, 20);
+	CheckPixels(230, 310, 20, 20);
+	CheckPixels(0, 0, SIM_WIDTH, SIM_HEIGHT);
+
+	CheckBusy();
+
+	if (m_failed) {
+		printf("lcd_dma: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_dma: ok, %u-byte chunks decode to the pixels of the CPU paths\n", (unsigned) LCD_DMA_CHUNK);
+	return 0;
+}
@@ -0,0 +1,377 @@
+/*
+ * lcd_shapes.cpp
+ *
+ * LCD_FillCircle and LCD_FillRoundRect draw with merged horizontal spans.
+ * Checks on the ILI9341 bus model that they cover exactly the pixels of
+ * the column fills they replace (LCD_FillRect plus LCD_FillCircleHelper),
+ * for every small shape, degenerate radii and shapes cut by the screen
+ * edges included.
+ *
+ * LCD_FillTriangle and LCD_FillPolygon step their edges per scanline and
+ * skip the rows above the screen. They are compared with rasterizers that
+ * divide on every row of every pixel instead:
+ *   - a triangle row spans the truncated crossings x0 + dx * (y - y0) / dy
+ *     of its long edge and of the upper or lower short edge
+ *   - a polygon pixel is filled when the edges crossing its row left of
+ *     its center (or through it) add up to an odd count (EVENODD) or a
+ *     non-zero winding (NONZERO)
+ * Random, degenerate, self-intersecting and partly or far off-screen
+ * shapes are drawn, up to the LCD_POLYGON_MAX_VERTICES limit.
+ *
+ * LCD_DrawLine clips to the visible steps and draws runs. It must set the
+ * pixels of a plain 32-bit Bresenham loop over LCD_DrawPixel, for lines
+ * with one or both ends off-screen and for ends at the int16 limits.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "lcd.h"
+#include "ili9341_sim.h"
+
+static uint16_t m_expected[SIM_HEIGHT][SIM_WIDTH];
+static uint32_t m_shapes, m_failed;
+
+/* The column fills of the original driver */
+static void FillCircleColumns(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+	LCD_DrawFastVLine(x0, y0 - r, 2 * r + 1, color);
+	LCD_FillCircleHelper(x0, y0, r, 3, 0, color);
+}
+
+static void FillRoundRectColumns(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) {
+	LCD_FillRect(x + r, y, w - 2 * r, h, color);
+	LCD_FillCircleHelper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
+	LCD_FillCircleHelper(x + r, y + r, r, 2, h - 2 * r - 1, color);
+}
+
+static void Compare(const char *what, int16_t a, int16_t b, int16_t c, int16_t d, int16_t e) {
+	m_shapes++;
+	if (!memcmp(m_expected, Sim_GRAM, sizeof(m_expected)))
+		return;
+	for (int16_t y = 0; y < SIM_HEIGHT; y++) {
+		for (int16_t x = 0; x < SIM_WIDTH; x++) {
+			if (m_expected[y][x] != Sim_GRAM[y][x]) {
+				if (m_failed < 20)
+					printf("%s(%d, %d, %d, %d, %d): pixel %d,%d is 0x%04X, expected 0x%04X\n", what, a, b, c, d, e,
+							x, y, Sim_GRAM[y][x], m_expected[y][x]);
+				m_failed++;
+				return;
+			}
+		}
+	}
+}
+
+static void CheckCircle(int16_t x0, int16_t y0, int16_t r) {
+	LCD_FillScreen(BLACK);
+	FillCircleColumns(x0, y0, r, WHITE);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+	LCD_FillScreen(BLACK);
+	LCD_FillCircle(x0, y0, r, WHITE);
+	Compare("FillCircle", x0, y0, r, 0, 0);
+}
+
+static void CheckRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r) {
+	LCD_FillScreen(BLACK);
+	FillRoundRectColumns(x, y, w, h, r, WHITE);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+	LCD_FillScreen(BLACK);
+	LCD_FillRoundRect(x, y, w, h, r, WHITE);
+	Compare("FillRoundRect", x, y, w, h, r);
+}
+
+// ------------------- Triangles and polygons -------------------
+
+static uint32_t m_rnd = 2463534242U;
+
+static int32_t Random(int32_t lo, int32_t hi) {
+	m_rnd ^= m_rnd << 13;
+	m_rnd ^= m_rnd >> 17;
+	m_rnd ^= m_rnd << 5;
+	return lo + (int32_t) (m_rnd % (uint32_t) (hi - lo + 1));
+}
+
+static void Span(int32_t x1, int32_t x2, int32_t y, uint16_t color) {
+	if ((y < 0) || (y >= SIM_HEIGHT))
+		return;
+	for (int32_t x = (x1 < 0) ? 0 : x1; (x <= x2) && (x < SIM_WIDTH); x++)
+		m_expected[y][x] = color;
+}
+
+// The crossing of edge 0-1 with row y, truncated as the driver's division was
+static int32_t Cross(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t y) {
+	return x0 + (int32_t) ((int64_t) (x1 - x0) * (y - y0) / (y1 - y0));
+}
+
+static void RefTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color) {
+	if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+	if (y1 > y2) { std::swap(y2, y1); std::swap(x2, x1); }
+	if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+
+	if (y0 == y2) {
+		Span(std::min(x0, std::min(x1, x2)), std::max(x0, std::max(x1, x2)), y0, color);
+		return;
+	}
+	// the row of the middle vertex belongs to the upper part only for a flat bottom
+	int32_t last = (y1 == y2) ? y1 : y1 - 1;
+	for (int32_t y = std::max(y0, 0); y <= std::min(y2, SIM_HEIGHT - 1); y++) {
+		int32_t a = (y <= last) ? Cross(x0, y0, x1, y1, y) : Cross(x1, y1, x2, y2, y);
+		int32_t b = Cross(x0, y0, x2, y2, y);
+		Span(std::min(a, b), std::max(a, b), y, color);
+	}
+}
+
+static void RefPolygon(const int16_t *xy, uint8_t n, uint8_t rule, uint16_t color) {
+	if ((n < 3) || (n > LCD_POLYGON_MAX_VERTICES))
+		return;
+	for (int32_t y = 0; y < SIM_HEIGHT; y++) {
+		for (int32_t x = 0; x < SIM_WIDTH; x++) {
+			int32_t wind = 0, count = 0;
+			for (uint8_t i = 0; i < n; i++) {
+				int64_t x1 = xy[2 * i], y1 = xy[2 * i + 1];
+				int64_t x2 = xy[2 * ((i + 1) % n)], y2 = xy[2 * ((i + 1) % n) + 1];
+				int32_t dir = 1;
+				if (y1 == y2)
+					continue;
+				if (y1 > y2) {
+					std::swap(x1, x2);
+					std::swap(y1, y2);
+					dir = -1;
+				}
+				if ((y < y1) || (y >= y2))
+					continue;
+				// crossing x1 + (y + 1/2 - y1) * dx / dy at or left of the center x + 1/2
+				if (2 * x1 * (y2 - y1) + (2 * (y - y1) + 1) * (x2 - x1) <= (2 * x + 1) * (y2 - y1)) {
+					wind += dir;
+					count++;
+				}
+			}
+			if ((rule == LCD_FILL_NONZERO) ? (wind != 0) : (count & 1))
+				m_expected[y][x] = color;
+		}
+	}
+}
+
+static void CheckTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2) {
+	LCD_FillScreen(BLACK);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+	RefTriangle(x0, y0, x1, y1, x2, y2, WHITE);
+	LCD_FillTriangle(x0, y0, x1, y1, x2, y2, WHITE);
+	m_shapes++;
+	if (memcmp(m_expected, Sim_GRAM, sizeof(m_expected))) {
+		if (m_failed < 20)
+			printf("FillTriangle(%d, %d, %d, %d, %d, %d) differs from the reference\n", x0, y0, x1, y1, x2, y2);
+		m_failed++;
+	}
+}
+
+static void CheckPolygon(const int16_t *xy, uint8_t n, uint8_t rule) {
+	LCD_FillScreen(BLACK);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+	RefPolygon(xy, n, rule, WHITE);
+	LCD_FillPolygon(xy, n, rule, WHITE);
+	m_shapes++;
+	if (memcmp(m_expected, Sim_GRAM, sizeof(m_expected))) {
+		if (m_failed < 20) {
+			printf("FillPolygon(%s, %u vertices:", rule == LCD_FILL_NONZERO ? "NONZERO" : "EVENODD", n);
+			for (uint8_t i = 0; i < n; i++)
+				printf(" %d,%d", xy[2 * i], xy[2 * i + 1]);
+			printf(") differs from the reference\n");
+		}
+		m_failed++;
+	}
+}
+
+// The Bresenham loop of the original driver, without clipping and in 32 bits
+static void RefLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint16_t color) {
+	bool steep = abs(y1 - y0) > abs(x1 - x0);
+	if (steep) {
+		std::swap(x0, y0);
+		std::swap(x1, y1);
+	}
+	if (x0 > x1) {
+		std::swap(x0, x1);
+		std::swap(y0, y1);
+	}
+	int32_t dx = x1 - x0, dy = abs(y1 - y0), err = dx / 2, ystep = (y0 < y1) ? 1 : -1;
+	for (; x0 <= x1; x0++) {
+		if (steep)
+			LCD_DrawPixel(y0, x0, color);
+		else
+			LCD_DrawPixel(x0, y0, color);
+		err -= dy;
+		if (err < 0) {
+			y0 += ystep;
+			err += dx;
+		}
+	}
+}
+
+static void CheckLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1) {
+	LCD_FillScreen(BLACK);
+	RefLine(x0, y0, x1, y1, WHITE);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+	LCD_FillScreen(BLACK);
+	LCD_DrawLine(x0, y0, x1, y1, WHITE);
+	m_shapes++;
+	if (memcmp(m_expected, Sim_GRAM, sizeof(m_expected))) {
+		if (m_failed < 20)
+			printf("DrawLine(%d, %d, %d, %d) differs from the reference\n", x0, y0, x1, y1);
+		m_failed++;
+	}
+}
+
+// Both directions of a line
+static void CheckLineBothWays(int16_t x0, int16_t y0, int16_t x1, int16_t y1) {
+	CheckLine(x0, y0, x1, y1);
+	CheckLine(x1, y1, x0, y0);
+}
+
+static void CheckLines(void) {
+	static const int16_t lines[][4] = {
+		// points, horizontal, vertical and diagonal lines
+		{ 50, 50, 50, 50 }, { 0, 10, 239, 10 }, { 30, 0, 30, 319 }, { 0, 0, 239, 239 },
+		{ 0, 319, 239, 80 },
+		// shallow and steep
+		{ 10, 100, 230, 130 }, { 10, 130, 230, 100 }, { 100, 10, 130, 310 }, { 130, 10, 100, 310 },
+		// one end off-screen
+		{ -50, 40, 100, 60 }, { 100, -50, 120, 200 }, { 200, 100, 400, 170 }, { 60, 200, 30, 500 },
+		// both ends off-screen, across the screen or past a corner
+		{ -100, -30, 400, 350 }, { -100, 330, 400, -10 }, { -20, 100, 100, -20 }, { 230, 340, 260, 300 },
+		// both beyond the same edge
+		{ -10, -5, -3, 400 }, { 10, -5, 200, -1 },
+		// the int16 limits
+		{ -32768, -32768, 32767, 32767 }, { -32768, 32767, 32767, -32768 },
+		{ -32768, 0, 32767, 319 }, { 0, -32768, 239, 32767 }, { -32768, 160, 32767, 161 },
+		{ 120, -32768, 121, 32767 }, { -32768, -32767, 32767, -32768 }, { 32767, 32767, 0, 0 },
+		{ -32768, 100, 100, 120 }, { 100, -32768, 110, 100 }, { 100, 100, 32767, 250 },
+		{ -32768, -32768, -32768, 32767 }, { -32768, 10, 32767, 10 },
+	};
+
+	for (const auto &l : lines)
+		CheckLineBothWays(l[0], l[1], l[2], l[3]);
+
+	for (int i = 0; i < 400; i++) {
+		int32_t r = (i < 250) ? 100 : 2000;
+		CheckLineBothWays(Random(-r, SIM_WIDTH + r), Random(-r, SIM_HEIGHT + r),
+				Random(-r, SIM_WIDTH + r), Random(-r, SIM_HEIGHT + r));
+	}
+	// anywhere in int16, a few cross the screen
+	for (int i = 0; i < 200; i++)
+		CheckLineBothWays(Random(-32768, 32767), Random(-32768, 32767), Random(-32768, 32767), Random(-32768, 32767));
+	// far ends through a point on the screen
+	for (int i = 0; i < 200; i++) {
+		int32_t x = Random(0, SIM_WIDTH - 1), y = Random(0, SIM_HEIGHT - 1);
+		int32_t dx = Random(-100, 100), dy = Random(-100, 100), k = 32767 / std::max(1, std::max(abs(dx), abs(dy)));
+		auto clamp = [](int32_t v) { return (int16_t) std::min(32767, std::max(-32768, v)); };
+		CheckLineBothWays(clamp(x - k * dx), clamp(y - k * dy), clamp(x + k * dx), clamp(y + k * dy));
+	}
+}
+
+static void CheckTriangles(void) {
+	// degenerate: a point, horizontal and vertical lines, collinear points
+	CheckTriangle(50, 50, 50, 50, 50, 50);
+	CheckTriangle(10, 40, 200, 40, 90, 40);
+	CheckTriangle(-30, 40, 300, 40, 90, 40);
+	CheckTriangle(70, -10, 70, 400, 70, 100);
+	CheckTriangle(0, 0, 100, 100, 50, 50);
+	CheckTriangle(10, 300, 130, 20, 70, 160);
+	// flat tops and bottoms
+	CheckTriangle(10, 20, 200, 20, 100, 150);
+	CheckTriangle(100, 20, 10, 150, 200, 150);
+	// cut by the screen edges, or far beyond them
+	CheckTriangle(-50, -80, 200, 30, 60, 200);
+	CheckTriangle(120, -300, -200, 500, 400, 600);
+	CheckTriangle(10, 250, 230, 310, 100, 400);
+	CheckTriangle(-32768, -32768, 32767, 0, 0, 32767);
+	CheckTriangle(120, -32768, 120, 32767, 121, 160);
+	CheckTriangle(-32768, 100, 32767, 100, 0, 101);
+	CheckTriangle(0, -5, 239, -5, 100, -1);
+	CheckTriangle(0, 320, 239, 330, 100, 400);
+
+	for (int i = 0; i < 300; i++) {
+		int32_t r = (i < 200) ? 80 : 2000;		// around the screen, then far off it
+		CheckTriangle(Random(-r, SIM_WIDTH + r), Random(-r, SIM_HEIGHT + r),
+				Random(-r, SIM_WIDTH + r), Random(-r, SIM_HEIGHT + r),
+				Random(-r, SIM_WIDTH + r), Random(-r, SIM_HEIGHT + r));
+	}
+	// thin ones, two vertices on a row
+	for (int i = 0; i < 100; i++) {
+		int16_t y = Random(-20, SIM_HEIGHT + 20);
+		CheckTriangle(Random(-20, SIM_WIDTH + 20), y, Random(-20, SIM_WIDTH + 20), y,
+				Random(-20, SIM_WIDTH + 20), y + Random(-3, 3));
+	}
+}
+
+static void CheckPolygons(void) {
+	static const int16_t star[] = { 120, 10, 190, 300, 10, 110, 230, 110, 50, 300 };
+	static const int16_t bowtie[] = { 10, 10, 230, 310, 230, 10, 10, 310 };
+	// two loops around the same region, wound the same way
+	static const int16_t twice[] = { 20, 20, 220, 20, 220, 300, 20, 300, 20, 30,
+			210, 30, 210, 290, 30, 290, 30, 20 };
+	static const int16_t offscreen[] = { -100, -50, 400, 40, 120, 500, -20, 200 };
+	static const int16_t flat[] = { 10, 50, 200, 50, 100, 50 };
+	int16_t xy[2 * (LCD_POLYGON_MAX_VERTICES + 1)];
+
+	for (uint8_t rule = LCD_FILL_EVENODD; rule <= LCD_FILL_NONZERO; rule++) {
+		CheckPolygon(star, 5, rule);
+		CheckPolygon(bowtie, 4, rule);
+		CheckPolygon(twice, 9, rule);
+		CheckPolygon(offscreen, 4, rule);
+		CheckPolygon(flat, 3, rule);
+
+		for (int i = 0; i < 60; i++) {
+			uint8_t n = Random(3, LCD_POLYGON_MAX_VERTICES);
+			for (uint8_t k = 0; k < n; k++) {
+				xy[2 * k] = Random(-60, SIM_WIDTH + 60);
+				xy[2 * k + 1] = Random(-60, SIM_HEIGHT + 60);
+			}
+			CheckPolygon(xy, n, rule);
+		}
+
+		// the limit: 16 vertices are drawn, 17 are refused, as are 2
+		for (uint8_t k = 0; k <= LCD_POLYGON_MAX_VERTICES; k++) {
+			xy[2 * k] = Random(0, SIM_WIDTH - 1);
+			xy[2 * k + 1] = Random(0, SIM_HEIGHT - 1);
+		}
+		CheckPolygon(xy, LCD_POLYGON_MAX_VERTICES, rule);
+		CheckPolygon(xy, LCD_POLYGON_MAX_VERTICES + 1, rule);
+		CheckPolygon(xy, 2, rule);
+	}
+}
+
+int main(void) {
+	Sim_Reset();
+	LCD_Init();
+
+	for (int16_t r = 0; r <= 40; r++)
+		CheckCircle(100, 150, r);
+	CheckCircle(5, 5, 20);
+	CheckCircle(235, 318, 30);
+	CheckCircle(120, 160, 159);
+
+	// every shape up to 12x12, the radii past w / 2 and h / 2 included
+	for (int16_t w = 1; w <= 12; w++)
+		for (int16_t h = 1; h <= 12; h++)
+			for (int16_t r = 0; r <= 7; r++)
+				CheckRoundRect(10, 10, w, h, r);
+	CheckRoundRect(10, 10, 2, 5, 1);
+	CheckRoundRect(10, 10, 6, 2, 1);
+	CheckRoundRect(20, 30, 100, 40, 10);
+	CheckRoundRect(-10, -5, 60, 50, 12);
+	CheckRoundRect(200, 290, 60, 50, 20);
+	CheckRoundRect(0, 0, 240, 320, 119);
+
+	CheckLines();
+	CheckTriangles();
+	CheckPolygons();
+
+	if (m_failed) {
+		printf("lcd_shapes: %u of %u shapes differ\n", (unsigned) m_failed, (unsigned) m_shapes);
+		return 1;
+	}
+	printf("lcd_shapes: %u shapes match the column fills and the reference rasterizers\n", (unsigned) m_shapes);
+	return 0;
+}
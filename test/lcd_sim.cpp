@@ -0,0 +1,123 @@
+/*
+ * lcd_sim.cpp
+ *
+ * Runs lcd.c against the ILI9341 bus model: checks that the decoded GRAM
+ * matches what was drawn in every rotation, then draws a demo screen,
+ * prints the bus cost of each step and the strobes of every command, and
+ * writes the GRAM to a PPM image.
+ *
+ * Usage: lcd_sim [image.ppm]
+ *
+ */
+
+#include <stdio.h>
+
+#include "lcd.h"
+#include "ili9341_sim.h"
+
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+/* Physical position of a logical pixel of rotation r */
+static void MapPixel(uint8_t r, int16_t x, int16_t y, int16_t *px, int16_t *py) {
+	switch (r) {
+	default: *px = x; *py = y; break;
+	case 1: *px = TFTWIDTH - 1 - y; *py = x; break;
+	case 2: *px = TFTWIDTH - 1 - x; *py = TFTHEIGHT - 1 - y; break;
+	case 3: *px = y; *py = TFTHEIGHT - 1 - x; break;
+	}
+}
+
+static uint32_t CountColor(uint16_t color) {
+	uint32_t n = 0;
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			n += (Sim_GRAM[y][x] == color);
+	return n;
+}
+
+static void CheckRotations(void) {
+	for (uint8_t r = 0; r < 4; r++) {
+		int16_t px, py;
+		LCD_SetRotation(r);
+		LCD_FillScreen(BLACK);
+		CHECK(CountColor(BLACK) == (uint32_t) TFTWIDTH * TFTHEIGHT);
+
+		LCD_DrawPixel(3, 7, 0xF800);
+		MapPixel(r, 3, 7, &px, &py);
+		CHECK(Sim_GRAM[py][px] == 0xF800);
+
+		LCD_FillRect(10, 20, 30, 40, 0x07E0);
+		CHECK(CountColor(0x07E0) == 30 * 40);
+		MapPixel(r, 10, 20, &px, &py);
+		CHECK(Sim_GRAM[py][px] == 0x07E0);
+		MapPixel(r, 39, 59, &px, &py);
+		CHECK(Sim_GRAM[py][px] == 0x07E0);
+	}
+	LCD_SetRotation(0);
+}
+
+static void Step(const char *name, uint8_t print) {
+	if (print)
+		Sim_PrintCounts(name);
+}
+
+static void DrawDemo(uint8_t print) {
+	Sim_ResetCounts();
+	LCD_FillScreen(0x051F);
+	Step("FillScreen", print);
+	LCD_SetTextColor(WHITE, BLACK);
+	LCD_SetTextSize(4);
+	LCD_SetCursor(0, 0);
+	LCD_Printf("Hello 123");
+	Step("Printf size 4", print);
+	LCD_SetTextSize(1);
+	LCD_SetCursor(0, 40);
+	LCD_Printf("The quick brown fox jumps over");
+	Step("Printf size 1", print);
+	LCD_DrawLine(0, 0, 239, 200, 0xF800);
+	LCD_DrawLine(10, 300, 200, 180, 0x07E0);
+	Step("DrawLine", print);
+	LCD_DrawRect(20, 150, 60, 40, WHITE);
+	LCD_FillRect(30, 160, 40, 20, 0xF800);
+	Step("DrawRect, FillRect", print);
+	LCD_DrawCircle(150, 250, 30, 0xFFE0);
+	LCD_FillCircle(60, 250, 25, 0x07E0);
+	Step("DrawCircle, FillCircle", print);
+	LCD_FillRoundRect(100, 150, 80, 50, 10, 0x07FF);
+	LCD_DrawRoundRect(95, 145, 90, 60, 12, WHITE);
+	Step("RoundRect", print);
+	LCD_FillTriangle(10, 200, 100, 220, 50, 310, 0xF81F);
+	LCD_DrawTriangle(0, 0, 50, 20, 20, 60, WHITE);
+	Step("Triangle", print);
+}
+
+int main(int argc, char **argv) {
+	const char *path = (argc > 1) ? argv[1] : "lcd_sim.ppm";
+
+	Sim_Reset();
+	LCD_Init();
+	CheckRotations();
+
+	DrawDemo(1);
+	printf("strobes per command, whole demo:\n");
+	DrawDemo(0);
+	Sim_PrintCommandStrobes();
+
+	if (Sim_DumpGRAM(path)) {
+		printf("cannot write %s\n", path);
+		return 1;
+	}
+	if (m_failed) {
+		printf("lcd_sim: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_sim: ok, GRAM written to %s\n", path);
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * lcd_touch_async.c
+ *
+ * Runs the USE_TOUCH_ASYNC state machine of lcd_touch.c on the panel model
+ * of hw/: touches, strokes and releases at every stage of a sample, and
+ * drawing in between. Every conversion must find the pins driving the
+ * plate it measures, and the events must come out as DOWN, MOVE..., UP.
+ *
+ */
+
+#include <stdio.h>
+
+#include "hw/touch_hw.h"
+#include "lcd_touch.c"
+
+#undef printf		// lcd.h maps it to the printf of the firmware
+
+#define SAMPLE_US	(3 * LCD_TOUCH_SETTLE_US + 2 * LCD_TOUCH_OVERSAMPLE * HW_ADC_CONV_US)
+#define PERIOD_US	(LCD_TOUCH_PERIOD_US + SAMPLE_US)		// the period starts after a sample
+
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+static LCD_TouchPoint m_points[LCD_TOUCH_EVENTS];
+
+static uint16_t Drain(void) {
+	return LCD_Touch_Drain(m_points, LCD_TOUCH_EVENTS);
+}
+
+// Runs until the state machine reaches state, at most limit_us
+static uint8_t RunTo(TouchAsyncState state, uint32_t limit_us) {
+	for (uint32_t t = 0; t < limit_us; t++) {
+		if (m_async == state)
+			return 1;
+		Hw_Run(1);
+	}
+	return m_async == state;
+}
+
+static void CheckIdle(void) {
+	CHECK(m_async == TOUCH_ASYNC_WAIT);
+	CHECK(!(TIM7->CR1 & TIM_CR1_CEN));
+	CHECK(Hw_nvic_enabled[EXTI4_IRQn]);
+	CHECK(EXTI->IMR & GPIO_PIN_4);
+	CHECK(Hw_YPlus() == 1);
+}
+
+static void CheckNoTouch(void) {
+	uint32_t conversions = Hw_panel.conversions;
+
+	Hw_Run(20 * LCD_TOUCH_PERIOD_US);
+	CHECK(Drain() == 0);
+	CHECK(Hw_panel.conversions == conversions);
+	CheckIdle();
+}
+
+// A touch, a stroke of samples one period apart, a release
+static void CheckStroke(void) {
+	uint16_t n;
+
+	Hw_panel.x = 2000;
+	Hw_panel.y = 1500;
+	Hw_SetTouch(1);
+	Hw_Run(SAMPLE_US + 10);
+	n = Drain();
+	CHECK(n == 1);
+	CHECK(m_points[0].state == LCD_TOUCH_DOWN);
+	CHECK(m_last_raw_x == 2000 && m_last_raw_y == 1500);
+	CHECK(m_async == TOUCH_ASYNC_NEXT);
+	CHECK(Hw_panel.conversions == 2 * LCD_TOUCH_OVERSAMPLE);
+
+	// the main loop never waits for a sample
+	CHECK(LCD_Touch_Read(&m_points[0]) == LCD_TOUCH_READ_NO_TOUCH);
+
+	Hw_panel.x = 2100;
+	Hw_Run(4 * PERIOD_US);
+	n = Drain();
+	CHECK(n == 4);
+	for (uint16_t i = 0; i < n; i++) {
+		CHECK(m_points[i].state == LCD_TOUCH_MOVE);
+		if (i > 0)
+			CHECK(m_points[i].tick - m_points[i - 1].tick <= PERIOD_US / 1000 + 1);
+	}
+	CHECK(m_last_raw_x == 2100);
+
+	// released between samples, EXTI4 tells
+	Hw_SetTouch(0);
+	Hw_Run(1);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_UP);
+	Hw_Run(LCD_TOUCH_PERIOD_US);
+	CheckIdle();
+	CHECK(LCD_Touch_GetState() == LCD_TOUCH_IDLE);
+}
+
+// Released while EXTI4 is off: the X burst reads an open plate
+static void CheckReleaseInSample(void) {
+	Hw_SetTouch(1);
+	CHECK(RunTo(TOUCH_ASYNC_SETTLE_X, SAMPLE_US));
+	Hw_SetTouch(0);
+	Hw_Run(SAMPLE_US);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_UP);
+	Hw_Run(LCD_TOUCH_PERIOD_US);
+	CheckIdle();
+
+	// the release is only seen by the RELEASE step
+	Hw_SetTouch(1);
+	Hw_Run(SAMPLE_US + 10);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_DOWN);
+	CHECK(RunTo(TOUCH_ASYNC_CONV_X, PERIOD_US));
+	Hw_SetTouch(0);
+	CHECK(RunTo(TOUCH_ASYNC_RELEASE, SAMPLE_US));
+	Hw_Run(SAMPLE_US);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_UP);
+	CheckIdle();
+}
+
+// Drawing cancels a running sample and gives the pins back as they were
+static void CheckDrawing(void) {
+	TouchPins draw = m_pins_draw;
+	TouchPins pins;
+
+	Hw_SetTouch(1);
+	CHECK(RunTo(TOUCH_ASYNC_SETTLE_Y, SAMPLE_US));
+	CHECK(LCD_Touch_Sample() == HAL_BUSY);
+	LCD_SetMode(LCD_MODE_DRAW);
+	CHECK(m_async == TOUCH_ASYNC_OFF);
+	CHECK(!(TIM7->CR1 & TIM_CR1_CEN));
+	CHECK(!Hw_nvic_enabled[TIM7_IRQn] && !Hw_nvic_enabled[ADC_IRQn] && !Hw_nvic_enabled[EXTI4_IRQn]);
+	CHECK(!(EXTI->IMR & GPIO_PIN_4));
+	GPIO_SavePins(&pins);
+	CHECK(memcmp(&pins, &draw, sizeof(pins)) == 0);
+
+	// nothing runs while drawing
+	Hw_Run(10 * LCD_TOUCH_PERIOD_US);
+	CHECK(Drain() == 0);
+	CHECK(m_async == TOUCH_ASYNC_OFF);
+
+	// back to touch: the touch still down is sampled
+	LCD_SetMode(LCD_MODE_TOUCH);
+	Hw_Run(SAMPLE_US + 10);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_DOWN);
+	Hw_Run(PERIOD_US);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_MOVE);
+
+	// released while drawing
+	LCD_SetMode(LCD_MODE_DRAW);
+	Hw_SetTouch(0);
+	Hw_Run(LCD_TOUCH_PERIOD_US);
+	CHECK(Drain() == 0);
+	LCD_SetMode(LCD_MODE_TOUCH);
+	Hw_Run(SAMPLE_US + LCD_TOUCH_PERIOD_US);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_UP);
+	CheckIdle();
+
+	// touched while drawing
+	LCD_SetMode(LCD_MODE_DRAW);
+	Hw_SetTouch(1);
+	Hw_Run(LCD_TOUCH_PERIOD_US);
+	LCD_SetMode(LCD_MODE_TOUCH);
+	Hw_Run(SAMPLE_US + 10);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_DOWN);
+	Hw_SetTouch(0);
+	Hw_Run(LCD_TOUCH_PERIOD_US);
+	CHECK(Drain() == 1 && m_points[0].state == LCD_TOUCH_UP);
+	CheckIdle();
+}
+
+// LCD_Touch_Sample() starts a sample only between samples
+static void CheckSampleNow(void) {
+	CHECK(LCD_Touch_Sample() == HAL_OK);
+	CHECK(m_async == TOUCH_ASYNC_SETTLE_X);
+	CHECK(LCD_Touch_Sample() == HAL_BUSY);
+	Hw_Run(SAMPLE_US);
+	CHECK(Drain() == 0);  // not touched
+	CheckIdle();
+}
+
+int main(void) {
+	Hw_Reset();
+	LCD_Touch_Init(&Hw_hadc2, ADC_CHANNEL_4, &Hw_hadc1, ADC_CHANNEL_1);
+	LCD_SetMode(LCD_MODE_TOUCH);
+	CHECK(TIM7->PSC == 89);
+
+	CheckNoTouch();
+	CheckStroke();
+	CheckReleaseInSample();
+	CheckDrawing();
+	CheckSampleNow();
+	CheckNoTouch();
+
+	CHECK(Hw_panel.bad_conversions == 0);
+	CHECK(LCD_Touch_GetOverflows() == 0);
+	if (m_failed) {
+		printf("lcd_touch_async: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_touch_async: ok, %u conversions\n", (unsigned) Hw_panel.conversions);
+	return 0;
+}
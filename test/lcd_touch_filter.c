@@ -0,0 +1,173 @@
+/*
+ * lcd_touch_filter.c
+ *
+ * touch_Filter() of lcd_touch.c on bursts of conversions, and the cost of
+ * a point as the plates get noisier.
+ *
+ * The bursts are synthetic, shaped after what a resistive panel gives: a
+ * steady plate with a little noise, a single spike at either end, a plate
+ * still settling after the pin swap and a bouncing contact. The steady and
+ * spiked bursts must pass with the value of the plate, the others must be
+ * rejected.
+ *
+ * The benchmark then reads points with the blocking LCD_Touch_Read() on the
+ * panel model of hw/, with noise of growing deviation on both plates, and
+ * prints the share of rejected samples and LCD_Touch_GetCyclesPerPoint()
+ * in simulated cycles for each level.
+ *
+ * No ADC trace has been recorded from a panel yet, so both parts run on
+ * made-up data: the bursts above and roughly normal noise (Noisy()). Real
+ * panels also show drift, mains hum and pressure changes that these do
+ * not. Once a capture exists, check it in as a table of bursts next to
+ * m_bursts and run CheckBursts() and Bench() on it as well.
+ *
+ */
+
+#include <stdio.h>
+
+#include "hw/touch_hw.h"
+#include "lcd_touch.c"
+
+#undef printf		// lcd.h maps it to the printf of the firmware
+
+#define PLATE_X		2000
+#define PLATE_Y		1500
+#define SAMPLES		2000
+
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+typedef struct {
+	const char *name;
+	uint16_t v[LCD_TOUCH_OVERSAMPLE];
+	uint8_t stable;
+	uint32_t value;		// when stable
+} Burst;
+
+static const Burst m_bursts[] = {
+	{ "steady",         { 2000, 2003, 1998, 2001, 1999 }, 1, 2000 },
+	{ "high spike",     { 2000, 2001, 3500, 1999, 2000 }, 1, 2000 },
+	{ "low spike",      { 2000,   10, 2001, 1999, 2000 }, 1, 2000 },
+	{ "spread in",      { 1900, 1981, 2000, 2019, 2100 }, 1, 2000 },	// variance 722 of 768
+	{ "spread out",     { 1900, 1980, 2000, 2020, 2100 }, 0, 0 },		// variance 800
+	{ "settling",       { 1200, 1600, 1850, 1950, 2000 }, 0, 0 },
+	{ "two spikes",     { 2000, 2000, 2000, 3000, 3100 }, 0, 0 },
+	{ "bouncing",       { 2000, 4095, 2000, 4095, 2000 }, 0, 0 },
+};
+
+static void CheckBursts(void) {
+	for (uint32_t i = 0; i < sizeof(m_bursts) / sizeof(m_bursts[0]); i++) {
+		const Burst *b = &m_bursts[i];
+		uint16_t v[LCD_TOUCH_OVERSAMPLE];
+		uint32_t value;
+		uint8_t stable;
+
+		memcpy(v, b->v, sizeof(v));
+		stable = touch_Filter(v, &value);
+		if (stable != b->stable || (stable && value != b->value)) {
+			printf("%s: stable %u value %u, expected stable %u value %u\n", b->name,
+					stable, (unsigned) value, b->stable, (unsigned) b->value);
+			m_failed++;
+		}
+	}
+}
+
+static uint32_t Random(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+// Roughly normal, the sum of four uniform values
+static uint16_t Noisy(uint32_t *rnd, uint16_t value, uint32_t sigma) {
+	int32_t sum = 0;
+	for (int i = 0; i < 4; i++)
+		sum += Random(rnd) % 1024;
+	// 591 is the deviation of the sum
+	return value + (sum - 2046) * (int32_t) sigma / 591;
+}
+
+// Reads SAMPLES points with noise of deviation sigma, returns the rejected share in percent
+static uint32_t Bench(uint32_t sigma, uint32_t *cycles) {
+	uint16_t trace[2 * LCD_TOUCH_OVERSAMPLE];
+	uint32_t rnd = 2463534242U, read = 0;
+	LCD_TouchPoint p;
+
+	m_touch_rejected = 0;
+	m_touch_points = 0;
+	m_touch_cycles = 0;
+	Hw_panel.trace = trace;
+	Hw_panel.trace_len = 2 * LCD_TOUCH_OVERSAMPLE;
+
+	for (uint32_t s = 0; s < SAMPLES; s++) {
+		for (uint32_t i = 0; i < LCD_TOUCH_OVERSAMPLE; i++) {
+			trace[i] = Noisy(&rnd, PLATE_X, sigma);
+			trace[LCD_TOUCH_OVERSAMPLE + i] = Noisy(&rnd, PLATE_Y, sigma);
+		}
+		Hw_panel.trace_pos = 0;
+		if (LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS) {
+			read++;
+			if (sigma == 0)
+				CHECK(m_last_raw_x == PLATE_X && m_last_raw_y == PLATE_Y);
+		}
+	}
+	Hw_panel.trace = NULL;
+
+	CHECK(LCD_Touch_GetPoints() == read);
+	CHECK(LCD_Touch_GetRejected() + read == SAMPLES);
+	*cycles = LCD_Touch_GetCyclesPerPoint();
+	return LCD_Touch_GetRejected() * 100 / SAMPLES;
+}
+
+static void CheckBench(void) {
+	static const uint32_t sigmas[] = { 0, 4, 8, 16, 24, 32 };
+	uint32_t last_rejected = 0, last_cycles = 0;
+
+	Hw_SetTouch(1);
+	Hw_Run(1);
+	CHECK(m_touch_down);
+
+	printf("%-8s %10s %16s\n", "sigma", "rejected", "cycles/point");
+	for (uint32_t i = 0; i < sizeof(sigmas) / sizeof(sigmas[0]); i++) {
+		uint32_t cycles;
+		uint32_t rejected = Bench(sigmas[i], &cycles);
+
+		printf("%-8u %9u%% %16u\n", (unsigned) sigmas[i], (unsigned) rejected, (unsigned) cycles);
+		if (sigmas[i] == 0) {
+			CHECK(rejected == 0);
+			// both bursts, one conversion each
+			CHECK(cycles >= 2 * LCD_TOUCH_OVERSAMPLE * HW_ADC_CONV_US * HW_CPU_MHZ);
+		} else {
+			CHECK(rejected >= last_rejected);
+			CHECK(cycles >= last_cycles);
+		}
+		last_rejected = rejected;
+		last_cycles = cycles;
+	}
+	CHECK(last_rejected > 0);
+}
+
+int main(void) {
+	CheckBursts();
+
+	Hw_Reset();
+	LCD_Touch_Init(&Hw_hadc2, ADC_CHANNEL_4, &Hw_hadc1, ADC_CHANNEL_1);
+	LCD_SetMode(LCD_MODE_TOUCH);
+	CHECK(LCD_Touch_GetCyclesPerPoint() == 0);
+	CheckBench();
+
+	CHECK(Hw_panel.bad_conversions == 0);
+	if (m_failed) {
+		printf("lcd_touch_filter: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_touch_filter: ok\n");
+	return 0;
+}
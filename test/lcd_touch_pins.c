@@ -0,0 +1,334 @@
+/*
+ * lcd_touch_pins.c
+ *
+ * Compares the register snapshots of lcd_touch.c (PINS_MEASURE_X,
+ * PINS_MEASURE_Y, PINS_INTERRUPT and the draw state) with what the
+ * HAL_GPIO_Init() and HAL_GPIO_WritePin() calls they replaced leave in the
+ * registers, starting from random register contents.
+ *
+ * The snapshots may differ only where the hardware ignores the bits: the
+ * speed and output type of input and analog pins, and the pull of analog
+ * pins. HAL_GPIO_Init() leaves a pull-up set when a pin turns analog.
+ *
+ * Also checks that the blocking reads select each ADC channel only once.
+ *
+ */
+
+#include <stdio.h>
+
+#include "hw/touch_hw.h"
+#include "lcd_touch.c"
+
+#undef printf		// lcd.h maps them to the printf of the firmware
+#undef snprintf
+
+#define ROUNDS		2000
+
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+/*
+ * The pin setup of lcd_touch.c before the snapshots
+ */
+
+static void Ref_SetPinMode(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, uint32_t GPIO_PinMode) {
+	GPIO_InitTypeDef GPIO_InitStruct;
+	GPIO_InitStruct.Pin = GPIO_Pin;
+	GPIO_InitStruct.Mode = GPIO_PinMode;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(GPIOx, &GPIO_InitStruct);
+}
+
+static void Ref_AnalogPin(uint16_t GPIO_Pin) {
+	GPIO_InitTypeDef GPIO_InitStruct;
+	GPIO_InitStruct.Pin = GPIO_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+}
+
+static void Ref_MeasureX(void) {
+	Ref_SetPinMode(GPIOA, GPIO_PIN_1, GPIO_MODE_OUTPUT_PP);
+	Ref_SetPinMode(GPIOA, GPIO_PIN_8, GPIO_MODE_OUTPUT_PP);
+	Ref_SetPinMode(GPIOB, GPIO_PIN_10, GPIO_MODE_INPUT);
+	Ref_AnalogPin(GPIO_PIN_4);
+
+	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_1, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_8, GPIO_PIN_SET);
+}
+
+static void Ref_MeasureY(void) {
+	Ref_SetPinMode(GPIOB, GPIO_PIN_10, GPIO_MODE_OUTPUT_PP);
+	Ref_SetPinMode(GPIOA, GPIO_PIN_4, GPIO_MODE_OUTPUT_PP);
+	Ref_SetPinMode(GPIOA, GPIO_PIN_8, GPIO_MODE_INPUT);
+	Ref_AnalogPin(GPIO_PIN_1);
+
+	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_10, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
+}
+
+static void Ref_Interrupt(void) {
+	GPIO_InitTypeDef GPIO_InitStruct;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+
+	GPIO_InitStruct.Pin = GPIO_PIN_1;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_1, GPIO_PIN_RESET);
+
+	GPIO_InitStruct.Pin = GPIO_PIN_8;
+	GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = GPIO_PIN_10;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = GPIO_PIN_4;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+	GPIO_InitStruct.Pull = GPIO_PULLUP;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+}
+
+static void Ref_Draw(void) {
+	GPIO_InitTypeDef GPIO_InitStruct;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+
+	GPIO_InitStruct.Pin = GPIO_PIN_1 | GPIO_PIN_4 | GPIO_PIN_8;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+	GPIO_InitStruct.Pin = GPIO_PIN_10;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+}
+
+/*
+ * The same states with the snapshots
+ */
+
+static void New_MeasureX(void) {
+	GPIO_SetPins(&PINS_MEASURE_X);
+}
+
+static void New_MeasureY(void) {
+	GPIO_SetPins(&PINS_MEASURE_Y);
+}
+
+// as GPIO_InterruptMode() does it
+static void New_Interrupt(void) {
+	GPIO_InterruptPins();
+	GPIO_EXTI_Init();
+	EXTI->IMR |= GPIO_PIN_4;
+}
+
+static void New_Draw(void) {
+	GPIO_SetPins(&m_pins_draw);
+}
+
+typedef struct {
+	const char *name;
+	void (*ref)(void);
+	void (*snapshot)(void);
+	uint8_t exti;
+} PinState;
+
+static const PinState m_states[] = {
+	{ "measure X", Ref_MeasureX, New_MeasureX, 0 },
+	{ "measure Y", Ref_MeasureY, New_MeasureY, 0 },
+	{ "interrupt", Ref_Interrupt, New_Interrupt, 1 },
+	{ "draw", Ref_Draw, New_Draw, 0 },
+};
+
+typedef struct {
+	GPIO_TypeDef a, b;
+	EXTI_TypeDef exti;
+	uint32_t exticr;
+} Regs;
+
+static uint32_t Random(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void RandomPort(uint32_t *rnd, GPIO_TypeDef *g) {
+	memset(g, 0, sizeof(*g));
+	g->MODER = Random(rnd);
+	g->OTYPER = Random(rnd) & 0xFFFFU;
+	g->OSPEEDR = Random(rnd);
+	g->PUPDR = Random(rnd) & 0x55555555U;  // 3 is reserved
+	g->ODR = Random(rnd) & 0xFFFFU;
+	g->AFR[0] = Random(rnd);
+	g->AFR[1] = Random(rnd);
+}
+
+static void RandomRegs(uint32_t *rnd, Regs *r) {
+	RandomPort(rnd, &r->a);
+	RandomPort(rnd, &r->b);
+	memset(&r->exti, 0, sizeof(r->exti));
+	r->exti.IMR = Random(rnd) & 0x7FFFFFU;
+	r->exti.EMR = Random(rnd) & 0x7FFFFFU;
+	r->exti.RTSR = Random(rnd) & 0x7FFFFFU;
+	r->exti.FTSR = Random(rnd) & 0x7FFFFFU;
+	r->exticr = Random(rnd) & 0xFFFFU;
+}
+
+static void Load(const Regs *r) {
+	Hw_GPIOA = r->a;
+	Hw_GPIOB = r->b;
+	Hw_EXTI = r->exti;
+	Hw_SYSCFG.EXTICR[1] = r->exticr;
+}
+
+static void Save(Regs *r) {
+	Hw_YPlus();  // lands the BSRR writes in ODR
+	r->a = Hw_GPIOA;
+	r->b = Hw_GPIOB;
+	r->exti = Hw_EXTI;
+	r->exticr = Hw_SYSCFG.EXTICR[1];
+}
+
+static uint8_t Differs(const char *state, const char *reg, uint32_t ref, uint32_t got, uint32_t mask) {
+	if ((ref ^ got) & mask) {
+		printf("%s: %s %08x, expected %08x\n", state, reg, (unsigned) got, (unsigned) ref);
+		return 1;
+	}
+	return 0;
+}
+
+// Compares a port, except the bits the pin modes of ref make meaningless
+static uint8_t ComparePort(const char *state, char port, const GPIO_TypeDef *ref, const GPIO_TypeDef *got) {
+	uint32_t speed = ~0U, type = ~0U, pull = ~0U;
+	char reg[16];
+	uint8_t bad = 0;
+
+	for (uint32_t pin = 0; pin < 16; pin++) {
+		uint32_t mode = (ref->MODER >> (2 * pin)) & 3U;
+		if (mode == MODE_IN || mode == MODE_AN) {
+			speed &= ~PIN2(pin, 3);
+			type &= ~(1U << pin);
+		}
+		if (mode == MODE_AN) {
+			pull &= ~PIN2(pin, 3);
+		}
+	}
+#define PORT_REG(r, mask)	(snprintf(reg, sizeof(reg), "GPIO%c->" #r, port), \
+							 bad |= Differs(state, reg, ref->r, got->r, mask))
+	PORT_REG(MODER, ~0U);
+	PORT_REG(OTYPER, type);
+	PORT_REG(OSPEEDR, speed);
+	PORT_REG(PUPDR, pull);
+	PORT_REG(ODR, ~0U);
+	PORT_REG(AFR[0], ~0U);
+	PORT_REG(AFR[1], ~0U);
+#undef PORT_REG
+	return bad;
+}
+
+static void CheckSnapshots(void) {
+	uint32_t rnd = 2463534242U;
+
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		for (uint32_t s = 0; s < sizeof(m_states) / sizeof(m_states[0]); s++) {
+			const PinState *st = &m_states[s];
+			Regs init, ref, got;
+			uint8_t bad;
+
+			RandomRegs(&rnd, &init);
+			Load(&init);
+			st->ref();
+			Save(&ref);
+			Load(&init);
+			st->snapshot();
+			Save(&got);
+
+			bad = ComparePort(st->name, 'A', &ref.a, &got.a);
+			bad |= ComparePort(st->name, 'B', &ref.b, &got.b);
+			if (st->exti) {
+				bad |= Differs(st->name, "EXTI->IMR", ref.exti.IMR, got.exti.IMR, ~0U);
+				bad |= Differs(st->name, "EXTI->EMR", ref.exti.EMR, got.exti.EMR, ~0U);
+				bad |= Differs(st->name, "EXTI->RTSR", ref.exti.RTSR, got.exti.RTSR, ~0U);
+				bad |= Differs(st->name, "EXTI->FTSR", ref.exti.FTSR, got.exti.FTSR, ~0U);
+				bad |= Differs(st->name, "SYSCFG->EXTICR[1]", ref.exticr, got.exticr, ~0U);
+			}
+			if (bad) {
+				m_failed++;
+				return;
+			}
+		}
+	}
+}
+
+// GPIO_SavePins() then GPIO_SetPins() gives back what the LCD left
+static void CheckSaveRestore(void) {
+	uint32_t rnd = 88172645U;
+
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		Regs init, got;
+		TouchPins saved;
+
+		RandomRegs(&rnd, &init);
+		init.a.OTYPER &= ~TOUCH_PINS_A;  // push-pull, as the LCD drives them
+		init.b.OTYPER &= ~TOUCH_PINS_B;
+		Load(&init);
+		GPIO_SavePins(&saved);
+		GPIO_SetPins(&PINS_MEASURE_Y);
+		GPIO_SetPins(&saved);
+		Save(&got);
+		if (ComparePort("restored", 'A', &init.a, &got.a) || ComparePort("restored", 'B', &init.b, &got.b)) {
+			m_failed++;
+			return;
+		}
+	}
+}
+
+// Each ADC converts one channel only, LCD_Touch_Init() selects it once
+static void CheckChannelCache(void) {
+	LCD_TouchPoint p;
+
+	Hw_Reset();
+	LCD_Touch_Init(&Hw_hadc2, ADC_CHANNEL_4, &Hw_hadc1, ADC_CHANNEL_1);
+	CHECK(Hw_adc_configs == 2);
+	LCD_SetMode(LCD_MODE_TOUCH);
+	Hw_panel.x = 2000;
+	Hw_panel.y = 1500;
+	Hw_SetTouch(1);
+	Hw_Run(1);
+
+	for (uint32_t i = 0; i < 100; i++) {
+		CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS);
+	}
+	CHECK(Hw_adc_configs == 2);
+
+	// an ADC used for something else meanwhile is selected again
+	Hw_ADC2.SQR3 = ADC_CHANNEL_0;
+	CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS);
+	CHECK(Hw_adc_configs == 3);
+	Hw_ADC1.SMPR2 = 0x3FFFFFFFU;
+	CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS);
+	CHECK(Hw_adc_configs == 4);
+	CHECK(Hw_panel.bad_conversions == 0);
+}
+
+int main(void) {
+	Hw_Reset();
+	CheckSnapshots();
+	CheckSaveRestore();
+	CheckChannelCache();
+
+	if (m_failed) {
+		printf("lcd_touch_pins: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_touch_pins: %u rounds of %u pin states match HAL_GPIO_Init()\n", (unsigned) ROUNDS,
+			(unsigned) (sizeof(m_states) / sizeof(m_states[0])));
+	return 0;
+}
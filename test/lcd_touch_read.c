@@ -0,0 +1,192 @@
+/*
+ * lcd_touch_read.c
+ *
+ * The blocking LCD_Touch_Read() of lcd_touch.c on the panel model of hw/:
+ * strokes, and releases at every conversion of a measurement. A read must
+ * leave the interrupt mode pins with EXTI4 on, and a touch that ends while
+ * EXTI4 is off must still give its UP, or the read loop of
+ * LCD_Touch_Draw_Calibrate() never ends.
+ *
+ * Since the pins are the TOUCH mode ones after every read, LCD_SetMode()
+ * may skip a switch to the mode it is in.
+ *
+ * Built with USE_TOUCH_ARBITER as well: a read then claims the pins back
+ * from drawing, unless the LCD holds CS active.
+ *
+ * Also checks that LCD_Touch_Calibrate() refuses coefficients beyond the
+ * fixed point range.
+ *
+ */
+
+#include <stdio.h>
+
+#include "hw/touch_hw.h"
+#include "lcd_touch.c"
+
+#undef printf		// lcd.h maps it to the printf of the firmware
+
+#define READS_MAX	10		// a release must show within this many reads
+
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+// The pins as GPIO_InterruptPins() sets them, EXTI4 on
+static uint8_t InInterruptMode(void) {
+	TouchPins pins;
+
+	GPIO_SavePins(&pins);
+	return pins.moder_a == PINS_INTERRUPT.moder_a && pins.pupdr_a == PINS_INTERRUPT.pupdr_a
+			&& pins.moder_b == PINS_INTERRUPT.moder_b && !(GPIOA->ODR & GPIO_PIN_1)
+			&& Hw_nvic_enabled[EXTI4_IRQn] && (EXTI->IMR & GPIO_PIN_4);
+}
+
+// After a read the pins are in TOUCH mode, the switch to it leaves them as they are
+static uint8_t TouchModeKept(void) {
+	TouchPins before, after;
+
+	GPIO_SavePins(&before);
+	if (m_mode != LCD_MODE_TOUCH || LCD_SetMode(LCD_MODE_TOUCH) != HAL_OK) {
+		return 0;
+	}
+	GPIO_SavePins(&after);
+	return memcmp(&before, &after, sizeof(before)) == 0 && InInterruptMode();
+}
+
+// Reads as LCD_Touch_Draw_Calibrate() does until the UP, returns the reads taken
+static uint32_t ReadToUp(void) {
+	LCD_TouchPoint p;
+
+	for (uint32_t n = 1; n <= READS_MAX; n++) {
+		if (LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS && p.state == LCD_TOUCH_UP) {
+			return n;
+		}
+		Hw_Run(100);
+	}
+	return 0;
+}
+
+static void CheckStroke(void) {
+	LCD_TouchPoint p;
+
+	Hw_panel.x = 2000;
+	Hw_panel.y = 1500;
+	Hw_SetTouch(1);
+	Hw_Run(1);
+	CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS && p.state == LCD_TOUCH_DOWN);
+	CHECK(InInterruptMode());
+	CHECK(Hw_YPlus() == 0);
+	CHECK(TouchModeKept());
+	Hw_Run(100);
+	CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS && p.state == LCD_TOUCH_MOVE);
+	CHECK(m_last_raw_x == 2000 && m_last_raw_y == 1500);
+
+	// released between reads, EXTI4 tells
+	Hw_SetTouch(0);
+	Hw_Run(1);
+	CHECK(ReadToUp() == 1);
+	CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_NO_TOUCH);
+	CHECK(InInterruptMode());
+	CHECK(LCD_Touch_GetState() == LCD_TOUCH_IDLE);
+}
+
+// Released at each conversion of a read, EXTI4 off
+static void CheckReleaseInRead(void) {
+	LCD_TouchPoint p;
+
+	for (uint32_t r = 1; r <= 2 * LCD_TOUCH_OVERSAMPLE; r++) {
+		uint32_t reads;
+
+		Hw_SetTouch(1);
+		Hw_Run(1);
+		CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS && p.state == LCD_TOUCH_DOWN);
+
+		Hw_panel.release_at = Hw_panel.conversions + r;
+		reads = ReadToUp();
+		Hw_panel.release_at = 0;
+		if (reads != 1) {
+			printf("released at conversion %u: %u reads to the UP\n", (unsigned) r, (unsigned) reads);
+			m_failed++;
+		}
+		CHECK(TouchModeKept());
+		CHECK(Hw_YPlus() == 1);
+		CHECK(LCD_Touch_GetState() == LCD_TOUCH_IDLE);
+
+		// the next touch is seen again
+		Hw_SetTouch(1);
+		Hw_Run(1);
+		CHECK(LCD_Touch_GetState() == LCD_TOUCH_DOWN);
+		Hw_SetTouch(0);
+		Hw_Run(1);
+		CHECK(ReadToUp() == 1);
+	}
+}
+
+#if defined (USE_TOUCH_ARBITER)
+static void CheckClaim(void) {
+	LCD_TouchPoint p;
+	uint32_t conversions;
+
+	Hw_SetTouch(1);
+	Hw_Run(1);
+	LCD_Touch_Arbiter_Claim();  // as a drawing does
+	CHECK(m_mode == LCD_MODE_DRAW);
+
+	// a batch or a transfer holds CS active
+	conversions = Hw_panel.conversions;
+	Hw_bus_busy = 1;
+	CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_NO_TOUCH);
+	CHECK(LCD_Touch_Drain(&p, 1) == 0);
+	CHECK(m_mode == LCD_MODE_DRAW);
+	CHECK(Hw_panel.conversions == conversions);
+
+	Hw_bus_busy = 0;
+	CHECK(LCD_Touch_Read(&p) == LCD_TOUCH_READ_SUCCESS && p.state == LCD_TOUCH_DOWN);
+	CHECK(m_mode == LCD_MODE_TOUCH);
+	Hw_SetTouch(0);
+	Hw_Run(1);
+	CHECK(ReadToUp() == 1);
+}
+#endif
+
+static void CheckCalibrateRange(void) {
+	const int16_t xy[] = { 30, 30, 210, 30, 30, 290 };
+	// a panel read over its whole span
+	const uint16_t raw[] = { 3700, 3600, 500, 3600, 3700, 400 };
+	// a panel that barely moves: a and e near 180 fit, c and f do not
+	const uint16_t bunched[] = { 4000, 4000, 4001, 4000, 4000, 4001 };
+	LCD_TouchCalibration cal, after;
+
+	CHECK(LCD_Touch_Calibrate(xy, raw, 3) == 1);
+	LCD_Touch_GetCalibration(&cal);
+	CHECK(LCD_Touch_Calibrate(xy, bunched, 3) == 0);
+	LCD_Touch_GetCalibration(&after);
+	CHECK(memcmp(&cal, &after, sizeof(cal)) == 0);
+}
+
+int main(void) {
+	Hw_Reset();
+	LCD_Touch_Init(&Hw_hadc2, ADC_CHANNEL_4, &Hw_hadc1, ADC_CHANNEL_1);
+	LCD_SetMode(LCD_MODE_TOUCH);
+
+	CheckStroke();
+	CheckReleaseInRead();
+#if defined (USE_TOUCH_ARBITER)
+	CheckClaim();
+#endif
+	CheckCalibrateRange();
+
+	CHECK(Hw_panel.bad_conversions == 0);
+	CHECK(LCD_Touch_GetOverflows() == 0);
+	if (m_failed) {
+		printf("lcd_touch_read: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_touch_read: ok\n");
+	return 0;
+}
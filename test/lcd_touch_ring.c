@@ -0,0 +1,177 @@
+/*
+ * lcd_touch_ring.c
+ *
+ * Stress test of the touch event ring of lcd_touch.c. A second thread
+ * plays the interrupts and pushes strokes (DOWN, MOVE..., UP) with
+ * Event_Push(), the main thread takes them out with LCD_Touch_Drain() and
+ * LCD_Touch_Read() at its own pace.
+ *
+ * Every point carries its sequence number in its raw position, mapped
+ * 1:1 to pixels, so the consumer sees any lost, repeated, reordered or
+ * torn event. Without overflows no point may be lost. With overflows
+ * every push must be either delivered or counted, and the last UP must
+ * still come out.
+ *
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "hw/touch_hw.h"
+#include "lcd_touch.c"
+
+#undef printf		// lcd.h maps it to the printf of the firmware
+
+#define SEQ_MOD		(TFTWIDTH * TFTHEIGHT)
+#define STROKES		2000
+
+static int m_failed;
+
+typedef struct {
+	uint8_t wait_room;		// the producer waits while the ring is full
+	uint32_t strokes;
+	volatile uint32_t pushed;
+	volatile uint8_t done;
+} Producer;
+
+typedef struct {
+	uint32_t delivered;
+	uint32_t points;
+	uint32_t seq;			// next sequence number expected at least
+	LCD_TouchState last;
+} Consumer;
+
+static uint32_t Random(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void Spin(uint32_t n) {
+	while (n--)
+		__asm__ volatile("");
+}
+
+static void Push(Producer *p, uint32_t seq, LCD_TouchState state) {
+	if (p->wait_room) {
+		while (m_events_head - m_events_tail >= LCD_TOUCH_EVENTS)
+			sched_yield();
+	}
+	Event_Push(seq % TFTWIDTH, (seq / TFTWIDTH) % TFTHEIGHT, state);
+	p->pushed++;
+}
+
+static void* Producer_Run(void *arg) {
+	Producer *p = arg;
+	uint32_t rnd = 2463534242U, seq = 0;
+
+	for (uint32_t s = 0; s < p->strokes; s++) {
+		uint32_t moves = Random(&rnd) % 40;
+		Push(p, seq++, LCD_TOUCH_DOWN);
+		for (uint32_t m = 0; m < moves; m++) {
+			Push(p, seq++, LCD_TOUCH_MOVE);
+			Spin(Random(&rnd) % 1000);
+		}
+		Push(p, 0, LCD_TOUCH_UP);
+		// lets the main thread run on a single core as well
+		if (Random(&rnd) % 4 == 0)
+			sched_yield();
+	}
+	__sync_synchronize();
+	p->done = 1;
+	return NULL;
+}
+
+static void Consume(Consumer *c, const LCD_TouchPoint *e) {
+	c->delivered++;
+	if (e->state != LCD_TOUCH_UP) {
+		uint32_t seq = (uint32_t) e->x + (uint32_t) e->y * TFTWIDTH;
+		uint32_t ahead = (seq + SEQ_MOD - c->seq % SEQ_MOD) % SEQ_MOD;
+		if (ahead >= SEQ_MOD / 2) {
+			printf("point %u after %u: repeated or out of order\n", (unsigned) seq, (unsigned) (c->seq - 1));
+			m_failed++;
+		}
+		c->seq += ahead + 1;
+		c->points++;
+	}
+	c->last = e->state;
+}
+
+// Takes events out at an uneven pace, as a main loop busy drawing would
+static void Consumer_Run(Producer *p, Consumer *c) {
+	LCD_TouchPoint events[LCD_TOUCH_EVENTS];
+	uint32_t rnd = 88172645U;
+
+	for (;;) {
+		uint8_t done = p->done;
+		uint16_t n;
+		if (Random(&rnd) % 4 == 0) {
+			LCD_TouchPoint e;
+			n = 0;
+			if (LCD_Touch_Read(&e) == LCD_TOUCH_READ_SUCCESS) {
+				Consume(c, &e);
+				n = 1;
+			}
+		} else {
+			n = LCD_Touch_Drain(events, 1 + Random(&rnd) % LCD_TOUCH_EVENTS);
+			for (uint16_t i = 0; i < n; i++)
+				Consume(c, &events[i]);
+		}
+		if (n == 0) {
+			if (done)
+				break;
+			sched_yield();
+		}
+		// now and then a long drawing
+		Spin(Random(&rnd) % 64 == 0 ? 200000 : Random(&rnd) % 3000);
+	}
+}
+
+static void Run(const char *name, uint8_t wait_room) {
+	Producer p = { .wait_room = wait_room, .strokes = STROKES };
+	Consumer c = { 0 };
+	uint32_t overflows = m_events_overflows;
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, Producer_Run, &p);
+	Consumer_Run(&p, &c);
+	pthread_join(thread, NULL);
+
+	overflows = m_events_overflows - overflows;
+	if (c.delivered + overflows != p.pushed) {
+		printf("%s: %u pushed, %u delivered, %u overflows\n", name, (unsigned) p.pushed,
+				(unsigned) c.delivered, (unsigned) overflows);
+		m_failed++;
+	}
+	if (wait_room && overflows) {
+		printf("%s: %u overflows with room left\n", name, (unsigned) overflows);
+		m_failed++;
+	}
+	if (c.last != LCD_TOUCH_UP) {
+		printf("%s: the last stroke did not end\n", name);
+		m_failed++;
+	}
+	printf("%-12s %8u pushed %8u delivered %8u overflows\n", name, (unsigned) p.pushed,
+			(unsigned) c.delivered, (unsigned) overflows);
+}
+
+int main(void) {
+	// raw values are pixels
+	const LCD_TouchCalibration identity = { .a = CAL_ONE, .e = CAL_ONE };
+
+	Hw_Reset();
+	LCD_Touch_Init(&Hw_hadc2, ADC_CHANNEL_4, &Hw_hadc1, ADC_CHANNEL_1);
+	LCD_Touch_SetCalibration(&identity);
+
+	Run("lossless", 1);
+	Run("overflowing", 0);
+
+	if (m_failed) {
+		printf("lcd_touch_ring: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_touch_ring: ok\n");
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * lcd_wr_timer.cpp
+ *
+ * The USE_WR_TIMER flood of lcd.c on the ILI9341 bus model. TIM2, TIM5
+ * and PA1 are stepped here one timer tick at a time:
+ *   - TIM2 counts up to ARR once (one-pulse mode), UG clears the counter
+ *     and sets UIF unless URS is set
+ *   - OC1REF follows OC1M (PWM mode 1 high below CCR1, mode 2 from CCR1
+ *     on) and is TRGO when MMS is 100
+ *   - TIM5 in gated mode on ITR0 counts only while TIM2 TRGO is high,
+ *     OC2REF follows OC2M against CCR2 the same way
+ *   - PA1 shows OC2REF while it is in AF2 mode with CC2E set, and its ODR
+ *     bit otherwise
+ *   - the TIM2 update interrupt runs LCD_FloodStrobe_IRQHandler()
+ *     IRQ_LATENCY ticks after UIF, the timers keep going meanwhile
+ *
+ * Every rising edge of PA1 is counted, and the edges the timer makes go
+ * to the bus decoder. LCD_FloodStrobeAsync() must strobe exactly two
+ * edges per pixel, draw the pixels of LCD_Flood() and give PA1 back to
+ * the GPIO as a high output, with one callback at the end.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+#include "lcd.h"
+#include "ili9341_sim.h"
+
+#define IRQ_LATENCY		16		// TIM5 ticks at 90MHz from UIF to the handler
+
+static uint16_t m_expected[SIM_HEIGHT][SIM_WIDTH];
+static int m_failed;
+
+#define CHECK(cond)		do {																\
+							if (!(cond)) {													\
+								printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+								m_failed++;													\
+							}																\
+						} while(0)
+
+// ------------------- TIM2, TIM5 and PA1 -------------------
+
+static uint8_t m_pin = 1;		// PA1 level
+static uint8_t m_af;			// PA1 was on TIM5_CH2 at the last tick
+static uint32_t m_edges;		// rising edges of PA1
+static uint32_t m_irqs;
+static uint32_t m_irq_wait;		// ticks since UIF
+static uint32_t m_callbacks;
+
+// OCxREF while counting up
+static uint8_t OcRef(uint32_t mode, uint32_t cnt, uint32_t ccr) {
+	switch (mode) {
+	case 5:  return 1;				// forced active
+	case 6:  return cnt < ccr;		// PWM mode 1
+	case 7:  return cnt >= ccr;		// PWM mode 2
+	default: return 0;
+	}
+}
+
+static void Update(TIM_TypeDef *t) {
+	if (t->EGR & TIM_EGR_UG) {
+		t->EGR = 0;
+		t->CNT = 0;
+		if (!(t->CR1 & TIM_CR1_URS))
+			t->SR |= TIM_SR_UIF;
+	}
+}
+
+static void Count(TIM_TypeDef *t) {
+	if (t->CNT < t->ARR) {
+		t->CNT++;
+	} else {
+		t->CNT = 0;
+		t->SR |= TIM_SR_UIF;
+		if (t->CR1 & TIM_CR1_OPM)
+			t->CR1 &= ~TIM_CR1_CEN;
+	}
+}
+
+static void Pin(void) {
+	uint8_t af = ((GPIOA->MODER & GPIO_MODER_MODER1) == GPIO_MODER_MODER1_1)
+			&& ((GPIOA->AFR[0] & GPIO_AFRL_AFSEL1) >> GPIO_AFRL_AFSEL1_Pos) == 2;
+	uint8_t level;
+
+	if (af) {
+		level = (TIM5->CCER & TIM_CCER_CC2E)
+				&& OcRef((TIM5->CCMR1 >> TIM_CCMR1_OC2M_Pos) & 7, TIM5->CNT, TIM5->CCR2);
+	} else {
+		level = (GPIOA->ODR & GPIO_PIN_1) != 0;
+	}
+	if (level && !m_pin) {
+		m_edges++;
+		// the CPU writes reach the decoder by themselves, the timer ones go as a pulse
+		if (af || m_af) {
+			GPIOA->BSRR = (uint32_t) GPIO_PIN_1 << 16;
+			GPIOA->BSRR = GPIO_PIN_1;
+		}
+	}
+	m_pin = level;
+	m_af = af;
+}
+
+static void Step(void) {
+	uint8_t trgo;
+
+	Update(TIM2);
+	Update(TIM5);
+	if (TIM2->CR1 & TIM_CR1_CEN)
+		Count(TIM2);
+	trgo = (TIM2->CR2 & TIM_CR2_MMS) == TIM_CR2_MMS_2
+			&& OcRef((TIM2->CCMR1 >> TIM_CCMR1_OC1M_Pos) & 7, TIM2->CNT, TIM2->CCR1);
+	if (TIM5->CR1 & TIM_CR1_CEN) {
+		// gated: SMS 101, TS 000 is ITR0, the TRGO of TIM2
+		uint8_t gated = (TIM5->SMCR & TIM_SMCR_SMS) == (TIM_SMCR_SMS_2 | TIM_SMCR_SMS_0);
+		if (!gated || ((TIM5->SMCR & TIM_SMCR_TS) == 0 && trgo))
+			Count(TIM5);
+	}
+	Pin();
+
+	if ((TIM2->SR & TIM_SR_UIF) && (TIM2->DIER & TIM_DIER_UIE) && Sim_NVIC_Enabled[TIM2_IRQn]
+			&& ++m_irq_wait >= IRQ_LATENCY) {
+		m_irq_wait = 0;
+		m_irqs++;
+		LCD_FloodStrobe_IRQHandler();
+		Pin();
+	}
+}
+
+static void Done(void) {
+	m_callbacks++;
+}
+
+// ------------------- Checks -------------------
+
+static void Background(void) {
+	for (int16_t y = 0; y < SIM_HEIGHT; y++)
+		for (int16_t x = 0; x < SIM_WIDTH; x++)
+			Sim_GRAM[y][x] = (uint16_t) (x * 7 + y * 131);
+}
+
+static void CheckFlood(uint16_t color, uint32_t len) {
+	uint32_t ticks = 0, limit = len * 2 * LCD_WR_TIMER_PERIOD + IRQ_LATENCY + 100;
+
+	Background();
+	LCD_SetAddrWindow(0, 0, SIM_WIDTH - 1, SIM_HEIGHT - 1);
+	LCD_Flood(color, len);
+	memcpy(m_expected, Sim_GRAM, sizeof(m_expected));
+
+	Background();
+	LCD_SetAddrWindow(0, 0, SIM_WIDTH - 1, SIM_HEIGHT - 1);
+	m_edges = 0;
+	m_irqs = 0;
+	m_callbacks = 0;
+	CHECK(LCD_FloodStrobeAsync(color, len, Done) == 1);
+	CHECK(Sim_GPIOA.ODR & GPIO_PIN_1);		// the level PA1 goes back to
+	while (LCD_FloodStrobe_IsBusy() && ticks++ < limit)
+		Step();
+	// nothing may move once the gate is closed
+	for (uint32_t i = 0; i < IRQ_LATENCY + 4 * LCD_WR_TIMER_PERIOD; i++)
+		Step();
+
+	if (LCD_FloodStrobe_IsBusy() || m_edges != len * 2 || m_irqs != 1 || m_callbacks != 1) {
+		printf("FloodStrobeAsync(0x%04X, %u): busy %u, %u WR edges, %u expected, %u interrupts, %u callbacks\n",
+				color, (unsigned) len, LCD_FloodStrobe_IsBusy(), (unsigned) m_edges, (unsigned) len * 2,
+				(unsigned) m_irqs, (unsigned) m_callbacks);
+		m_failed++;
+	}
+	if (memcmp(m_expected, Sim_GRAM, sizeof(m_expected))) {
+		printf("FloodStrobeAsync(0x%04X, %u): the pixels differ from LCD_Flood()\n", color, (unsigned) len);
+		m_failed++;
+	}
+	// PA1 is a high GPIO output again
+	CHECK((GPIOA->MODER & GPIO_MODER_MODER1) == GPIO_MODER_MODER1_0);
+	CHECK(m_pin == 1);
+	CHECK(Sim_GPIOB.ODR & GPIO_PIN_0);		// CS idle
+	CHECK(!(TIM2->CR1 & TIM_CR1_CEN) && !(TIM5->CR1 & TIM_CR1_CEN));
+}
+
+int main(void) {
+	Sim_Reset();
+	LCD_Init();
+	CHECK(Sim_NVIC_Enabled[TIM2_IRQn]);
+	CHECK((GPIOA->MODER & GPIO_MODER_MODER1) == GPIO_MODER_MODER1_0);
+
+	CheckFlood(WHITE, 1);
+	CheckFlood(BLACK, 2);
+	CheckFlood(0x8484, 3);
+	CheckFlood(WHITE, 4);
+	CheckFlood(0x2121, 241);
+	CheckFlood(BLACK, 1000);
+	CheckFlood(0xC6C6, 65535);
+	CheckFlood(WHITE, SIM_WIDTH * SIM_HEIGHT);
+
+	// the bytes of the color differ
+	CHECK(LCD_FloodStrobeAsync(0x1234, 10, Done) == 0);
+	CHECK(LCD_FloodStrobeAsync(WHITE, 0, Done) == 0);
+
+	if (m_failed) {
+		printf("lcd_wr_timer: %d checks failed\n", m_failed);
+		return 1;
+	}
+	printf("lcd_wr_timer: ok, two WR edges per pixel at a period of %u ticks\n", (unsigned) LCD_WR_TIMER_PERIOD);
+	return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * ff.h
+ *
+ * Host stand-in for the parts of FatFs that lcd.c uses with USE_FATFS:
+ * a FIL is a file held in memory, f_read() and f_lseek() move through it.
+ *
+ */
+
+#ifndef __FF_H
+#define __FF_H
+
+#include <stdint.h>
+#include <string.h>
+
+typedef unsigned int UINT;
+typedef uint32_t FSIZE_t;
+
+typedef enum {
+	FR_OK = 0,
+	FR_INVALID_OBJECT = 9
+} FRESULT;
+
+typedef struct {
+	const uint8_t *data;
+	FSIZE_t size;
+	FSIZE_t fptr;				// read pointer
+} FIL;
+
+static inline FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br) {
+	FSIZE_t left = fp->fptr < fp->size ? fp->size - fp->fptr : 0;
+
+	if (!fp->data)
+		return FR_INVALID_OBJECT;
+	*br = btr < left ? btr : (UINT) left;
+	memcpy(buff, fp->data + fp->fptr, *br);
+	fp->fptr += *br;
+	return FR_OK;
+}
+
+static inline FRESULT f_lseek(FIL *fp, FSIZE_t ofs) {
+	if (!fp->data)
+		return FR_INVALID_OBJECT;
+	fp->fptr = ofs < fp->size ? ofs : fp->size;
+	return FR_OK;
+}
+
+#endif /* __FF_H */
@@ -0,0 +1,225 @@
+/*
+ * ili9341_sim.cpp
+ *
+ * ILI9341 bus decoder and GRAM model, see ili9341_sim.h.
+ *
+ */
+
+#include "stm32f4xx_hal.h"
+#include "ili9341_sim.h"
+
+#include <stdio.h>
+
+#define SIM_CASET		0x2A
+#define SIM_PASET		0x2B
+#define SIM_RAMWR		0x2C
+#define SIM_VSCRDEF		0x33
+#define SIM_MADCTL		0x36
+#define SIM_VSCRSADD	0x37
+#define SIM_RAMWRC		0x3C
+
+#define SIM_MADCTL_MY	0x80
+#define SIM_MADCTL_MX	0x40
+#define SIM_MADCTL_MV	0x20
+
+GPIO_TypeDef Sim_GPIOA, Sim_GPIOB, Sim_GPIOC;
+DMA_TypeDef Sim_DMA2;
+DMA_Stream_TypeDef Sim_DMA2_Stream[8];
+TIM_TypeDef Sim_TIM2, Sim_TIM5, Sim_TIM8;
+RCC_TypeDef Sim_RCC;
+uint8_t Sim_NVIC_Enabled[96];
+uint16_t Sim_GRAM[SIM_HEIGHT][SIM_WIDTH];
+
+static Sim_Counts m_counts;
+static int m_cmd = -1;				// command the data bytes belong to
+static uint8_t m_args[8];
+static uint32_t m_nargs;
+static uint8_t m_hi;				// first byte of a pixel
+static uint8_t m_have_hi;
+static uint16_t m_xs, m_xe, m_ys, m_ye;	// address window
+static uint16_t m_cx, m_cy;			// address counter
+static uint8_t m_madctl;
+static uint16_t m_vs_top, m_vs_area = SIM_HEIGHT, m_vs_bottom, m_vs_start;
+
+static uint8_t Sim_DataPins(void) {
+	uint32_t a = Sim_GPIOA.ODR, b = Sim_GPIOB.ODR, c = Sim_GPIOC.ODR;
+	return ((a >> 9) & 1) | (((c >> 7) & 1) << 1) | (((a >> 10) & 1) << 2) | (((b >> 3) & 1) << 3)
+			| (((b >> 5) & 1) << 4) | (((b >> 4) & 1) << 5) | (((b >> 10) & 1) << 6) | (((a >> 8) & 1) << 7);
+}
+
+/* Stores a pixel at the address counter and advances it inside the window */
+static void Sim_PutPixel(uint16_t color) {
+	int16_t px = m_cx, py = m_cy;
+	if (m_madctl & SIM_MADCTL_MV) {
+		px = m_cy;
+		py = m_cx;
+	}
+	// the panel of this board shows column 0 at the left edge only with MX set
+	if (!(m_madctl & SIM_MADCTL_MX))
+		px = SIM_WIDTH - 1 - px;
+	if (m_madctl & SIM_MADCTL_MY)
+		py = SIM_HEIGHT - 1 - py;
+	if ((px >= 0) && (px < SIM_WIDTH) && (py >= 0) && (py < SIM_HEIGHT))
+		Sim_GRAM[py][px] = color;
+	if (++m_cx > m_xe) {
+		m_cx = m_xs;
+		if (++m_cy > m_ye)
+			m_cy = m_ys;
+	}
+}
+
+static void Sim_Command(uint8_t cmd) {
+	m_counts.commands++;
+	m_cmd = cmd;
+	m_nargs = 0;
+	m_have_hi = 0;
+	if ((cmd == SIM_CASET) || (cmd == SIM_PASET))
+		m_counts.windows++;
+	if (cmd == SIM_RAMWR) {
+		m_cx = m_xs;
+		m_cy = m_ys;
+	}
+}
+
+static void Sim_Data(uint8_t d) {
+	if ((m_cmd == SIM_RAMWR) || (m_cmd == SIM_RAMWRC)) {
+		if (!m_have_hi) {
+			m_hi = d;
+			m_have_hi = 1;
+		} else {
+			Sim_PutPixel((m_hi << 8) | d);
+			m_have_hi = 0;
+		}
+		return;
+	}
+	if (m_nargs < sizeof(m_args))
+		m_args[m_nargs] = d;
+	m_nargs++;
+	switch (m_cmd) {
+	case SIM_CASET:
+		if (m_nargs == 4) {
+			m_xs = (m_args[0] << 8) | m_args[1];
+			m_xe = (m_args[2] << 8) | m_args[3];
+		}
+		break;
+	case SIM_PASET:
+		if (m_nargs == 4) {
+			m_ys = (m_args[0] << 8) | m_args[1];
+			m_ye = (m_args[2] << 8) | m_args[3];
+		}
+		break;
+	case SIM_MADCTL:
+		if (m_nargs == 1)
+			m_madctl = d;
+		break;
+	case SIM_VSCRDEF:
+		if (m_nargs == 6) {
+			m_vs_top = (m_args[0] << 8) | m_args[1];
+			m_vs_area = (m_args[2] << 8) | m_args[3];
+			m_vs_bottom = (m_args[4] << 8) | m_args[5];
+		}
+		break;
+	case SIM_VSCRSADD:
+		if (m_nargs == 2)
+			m_vs_start = (m_args[0] << 8) | m_args[1];
+		break;
+	}
+}
+
+void Sim_GPIO_Write(GPIO_TypeDef *port, uint32_t bsrr) {
+	uint32_t old = port->ODR;
+	port->ODR = (old | (bsrr & 0xFFFF)) & ~(bsrr >> 16);
+	if ((port == &Sim_GPIOB) && (old & GPIO_PIN_0) && !(port->ODR & GPIO_PIN_0))
+		m_counts.cs++;
+	if ((port != &Sim_GPIOA) || (old & GPIO_PIN_1) || !(port->ODR & GPIO_PIN_1))
+		return;
+	if (Sim_GPIOB.ODR & GPIO_PIN_0)
+		return;
+	// WR rising edge with CS low
+	uint8_t d = Sim_DataPins();
+	m_counts.strobes++;
+	if (Sim_GPIOA.ODR & GPIO_PIN_4)
+		Sim_Data(d);
+	else
+		Sim_Command(d);
+	if (m_cmd >= 0)
+		m_counts.cmd_strobes[m_cmd]++;
+}
+
+void Sim_Reset(void) {
+	memset(Sim_GRAM, 0, sizeof(Sim_GRAM));
+	m_cmd = -1;
+	m_nargs = 0;
+	m_have_hi = 0;
+	m_xs = m_xe = m_ys = m_ye = m_cx = m_cy = 0;
+	m_madctl = 0;
+	m_vs_top = 0;
+	m_vs_area = SIM_HEIGHT;
+	m_vs_bottom = 0;
+	m_vs_start = 0;
+	Sim_ResetCounts();
+}
+
+const Sim_Counts* Sim_GetCounts(void) {
+	return &m_counts;
+}
+
+void Sim_ResetCounts(void) {
+	memset(&m_counts, 0, sizeof(m_counts));
+}
+
+void Sim_PrintCounts(const char *name) {
+	printf("%-24s strobes %9u  commands %6u  windows %6u  cs %5u\n", name,
+			(unsigned) m_counts.strobes, (unsigned) m_counts.commands,
+			(unsigned) m_counts.windows, (unsigned) m_counts.cs);
+	Sim_ResetCounts();
+}
+
+void Sim_PrintCommandStrobes(void) {
+	for (int i = 0; i < 256; i++) {
+		if (m_counts.cmd_strobes[i])
+			printf("  cmd 0x%02X  strobes %9u\n", i, (unsigned) m_counts.cmd_strobes[i]);
+	}
+}
+
+uint16_t Sim_GetPixel(int16_t x, int16_t y) {
+	int16_t row = y;
+	if ((y >= m_vs_top) && (y < m_vs_top + m_vs_area) && m_vs_area)
+		row = m_vs_top + (y - m_vs_top + m_vs_start - m_vs_top + m_vs_area) % m_vs_area;
+	return Sim_GRAM[row][x];
+}
+
+void Sim_GetScroll(uint16_t *tfa, uint16_t *vsa, uint16_t *bfa, uint16_t *vsp) {
+	*tfa = m_vs_top;
+	*vsa = m_vs_area;
+	*bfa = m_vs_bottom;
+	*vsp = m_vs_start;
+}
+
+static int Sim_WritePPM(const char *path, uint8_t scrolled) {
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return -1;
+	fprintf(f, "P6\n%d %d\n255\n", SIM_WIDTH, SIM_HEIGHT);
+	for (int16_t y = 0; y < SIM_HEIGHT; y++) {
+		for (int16_t x = 0; x < SIM_WIDTH; x++) {
+			uint16_t c = scrolled ? Sim_GetPixel(x, y) : Sim_GRAM[y][x];
+			uint8_t rgb[3] = { (uint8_t) ((c >> 11) << 3), (uint8_t) (((c >> 5) & 0x3F) << 2), (uint8_t) ((c & 0x1F) << 3) };
+			fwrite(rgb, 1, 3, f);
+		}
+	}
+	return fclose(f) ? -1 : 0;
+}
+
+int Sim_DumpGRAM(const char *path) {
+	return Sim_WritePPM(path, 0);
+}
+
+int Sim_DumpDisplay(const char *path) {
+	return Sim_WritePPM(path, 1);
+}
+
+/* printf.c prints through this, lcd.c only formats into buffers */
+extern "C" void _putchar(char character) {
+	putchar(character);
+}
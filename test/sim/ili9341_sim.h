@@ -0,0 +1,101 @@
+/*
+ * ili9341_sim.h
+ *
+ * Host model of an ILI9341 panel on the 8-bit bus of lcd.c.
+ *
+ * Every BSRR write of lcd.c lands in Sim_GPIO_Write(). A rising WR edge
+ * while CS is low latches the data pins as one byte, CD low marks it as a
+ * command. The decoder follows CASET, PASET, RAMWR, RAMWR continue, MADCTL
+ * and the vertical scrolling registers into a 240x320 RGB565 GRAM and
+ * counts the bus traffic, so drawing code can be checked and costed
+ * without a board.
+ *
+ * Data pins: PA9, PC7, PA10, PB3, PB5, PB4, PB10, PA8 (D0..D7)
+ * Control:   CS PB0, CD PA4, WR PA1
+ *
+ */
+
+#ifndef __ILI9341_SIM_H
+#define __ILI9341_SIM_H
+
+#include <stdint.h>
+
+#define SIM_WIDTH		240
+#define SIM_HEIGHT		320
+
+typedef struct {
+	uint32_t strobes;			// WR strobes, command and data bytes
+	uint32_t commands;			// command bytes
+	uint32_t windows;			// CASET or PASET commands
+	uint32_t cs;				// CS activations
+	uint32_t cmd_strobes[256];	// strobes of every command, its own byte included
+} Sim_Counts;
+
+extern uint16_t Sim_GRAM[SIM_HEIGHT][SIM_WIDTH];
+
+/**
+ * \brief Clears the GRAM, the decoder state and the counters
+ */
+void Sim_Reset(void);
+
+/**
+ * \brief Returns the bus counters collected since the last Sim_ResetCounts()
+ */
+const Sim_Counts* Sim_GetCounts(void);
+
+/**
+ * \brief Clears the bus counters
+ */
+void Sim_ResetCounts(void);
+
+/**
+ * \brief Prints the counters of one step as a single line and clears them
+ *
+ * \param name		Step name, first column of the line
+ */
+void Sim_PrintCounts(const char *name);
+
+/**
+ * \brief Prints the strobes of every command that was sent since the last reset
+ */
+void Sim_PrintCommandStrobes(void);
+
+/**
+ * \brief Writes the GRAM as a binary PPM image in memory order
+ *
+ * \param path		File name
+ *
+ * \return 0 on success
+ */
+int Sim_DumpGRAM(const char *path);
+
+/**
+ * \brief Writes the image the panel shows, with the vertical scroll applied
+ *
+ * \param path		File name
+ *
+ * \return 0 on success
+ */
+int Sim_DumpDisplay(const char *path);
+
+/**
+ * \brief Reads a pixel as the panel shows it, with the vertical scroll applied
+ *
+ * \param x		Physical column, 0..SIM_WIDTH-1
+ * \param y		Physical row, 0..SIM_HEIGHT-1
+ *
+ * \return RGB565 color
+ */
+uint16_t Sim_GetPixel(int16_t x, int16_t y);
+
+/**
+ * \brief Returns the vertical scrolling registers, as last written
+ *
+ * \param tfa		Top fixed area lines (VSCRDEF)
+ * \param vsa		Vertical scrolling area lines (VSCRDEF)
+ * \param bfa		Bottom fixed area lines (VSCRDEF)
+ * \param vsp		Vertical scrolling start address (VSCRSADD)
+ */
+void Sim_GetScroll(uint16_t *tfa, uint16_t *vsa, uint16_t *bfa, uint16_t *vsp);
+
+#endif /* __ILI9341_SIM_H */
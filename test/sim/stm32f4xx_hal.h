@@ -0,0 +1,273 @@
+/*
+ * stm32f4xx_hal.h
+ *
+ * Host stand-in for the parts of the STM32 HAL that lcd.c uses, so that
+ * lcd.c can be built and run on a PC (see ili9341_sim.h).
+ *
+ * lcd.c is compiled as C++ against this header: BSRR is a small class
+ * whose assignment forwards the write to the bus decoder, every other
+ * GPIO register is plain memory. The default lcd.h configuration is
+ * covered, plus USE_BUS_STATS and USE_TOUCH_ARBITER.
+ *
+ * For USE_DMA and USE_WR_TIMER the DMA2 streams, TIM2, TIM5, TIM8, RCC
+ * and the NVIC are plain memory as well. Nothing moves in them by itself: a test that starts a transfer
+ * steps the timer and the streams and calls the interrupt handlers. The
+ * registers hold 32-bit addresses, so such a test is linked with -no-pie
+ * to keep its buffers below 4GB.
+ *
+ */
+
+#ifndef __STM32F4XX_HAL_H
+#define __STM32F4XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef enum {
+	HAL_OK = 0x00U,
+	HAL_ERROR = 0x01U,
+	HAL_BUSY = 0x02U,
+	HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum {
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+struct GPIO_TypeDef;
+
+void Sim_GPIO_Write(GPIO_TypeDef *port, uint32_t bsrr);
+
+struct GPIO_BsrrReg {
+	GPIO_BsrrReg &operator=(uint32_t value);
+};
+
+struct GPIO_TypeDef {
+	volatile uint32_t MODER;
+	volatile uint32_t OTYPER;
+	volatile uint32_t OSPEEDR;
+	volatile uint32_t PUPDR;
+	volatile uint32_t IDR;
+	volatile uint32_t ODR;
+	GPIO_BsrrReg BSRR;
+	volatile uint32_t LCKR;
+	volatile uint32_t AFR[2];
+};
+
+extern GPIO_TypeDef Sim_GPIOA, Sim_GPIOB, Sim_GPIOC;
+
+#define GPIOA		(&Sim_GPIOA)
+#define GPIOB		(&Sim_GPIOB)
+#define GPIOC		(&Sim_GPIOC)
+
+/* The decoder finds its port from the register address */
+inline GPIO_BsrrReg &GPIO_BsrrReg::operator=(uint32_t value) {
+	Sim_GPIO_Write((GPIO_TypeDef *) ((uint8_t *) this - offsetof(GPIO_TypeDef, BSRR)), value);
+	return *this;
+}
+
+#define GPIO_PIN_0					((uint16_t)0x0001)
+#define GPIO_PIN_1					((uint16_t)0x0002)
+#define GPIO_PIN_2					((uint16_t)0x0004)
+#define GPIO_PIN_3					((uint16_t)0x0008)
+#define GPIO_PIN_4					((uint16_t)0x0010)
+#define GPIO_PIN_5					((uint16_t)0x0020)
+#define GPIO_PIN_6					((uint16_t)0x0040)
+#define GPIO_PIN_7					((uint16_t)0x0080)
+#define GPIO_PIN_8					((uint16_t)0x0100)
+#define GPIO_PIN_9					((uint16_t)0x0200)
+#define GPIO_PIN_10					((uint16_t)0x0400)
+
+#define GPIO_MODE_INPUT				0x00000000U
+#define GPIO_MODE_OUTPUT_PP			0x00000001U
+#define GPIO_NOPULL					0x00000000U
+#define GPIO_PULLUP					0x00000001U
+#define GPIO_SPEED_FREQ_LOW			0x00000000U
+#define GPIO_SPEED_FREQ_VERY_HIGH	0x00000003U
+
+typedef struct {
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+	uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+/* lcd.c only configures the bus pins as outputs or inputs */
+static inline void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init) {
+	for (uint32_t pin = 0; pin < 16; pin++) {
+		if (init->Pin & (1U << pin))
+			port->MODER = (port->MODER & ~(3U << (2 * pin))) | ((init->Mode & 3U) << (2 * pin));
+	}
+}
+
+/* DMA2, the timers and RCC as far as USE_DMA and USE_WR_TIMER use them, bit values from stm32f446xx.h */
+typedef struct {
+	volatile uint32_t CR;
+	volatile uint32_t NDTR;
+	volatile uint32_t PAR;
+	volatile uint32_t M0AR;
+	volatile uint32_t M1AR;
+	volatile uint32_t FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+	volatile uint32_t LISR;
+	volatile uint32_t HISR;
+	volatile uint32_t LIFCR;
+	volatile uint32_t HIFCR;
+} DMA_TypeDef;
+
+typedef struct {
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t SMCR;
+	volatile uint32_t DIER;
+	volatile uint32_t SR;
+	volatile uint32_t EGR;
+	volatile uint32_t CCMR1;
+	volatile uint32_t CCMR2;
+	volatile uint32_t CCER;
+	volatile uint32_t CNT;
+	volatile uint32_t PSC;
+	volatile uint32_t ARR;
+	volatile uint32_t RCR;
+	volatile uint32_t CCR1;
+	volatile uint32_t CCR2;
+	volatile uint32_t CCR3;
+	volatile uint32_t CCR4;
+	volatile uint32_t BDTR;
+	volatile uint32_t DCR;
+	volatile uint32_t DMAR;
+	volatile uint32_t OR;
+} TIM_TypeDef;
+
+typedef struct {
+	volatile uint32_t AHB1ENR;
+	volatile uint32_t APB1ENR;
+	volatile uint32_t APB2ENR;
+} RCC_TypeDef;
+
+extern DMA_TypeDef Sim_DMA2;
+extern DMA_Stream_TypeDef Sim_DMA2_Stream[8];
+extern TIM_TypeDef Sim_TIM2, Sim_TIM5, Sim_TIM8;
+extern RCC_TypeDef Sim_RCC;
+
+#define DMA2				(&Sim_DMA2)
+#define DMA2_Stream2		(&Sim_DMA2_Stream[2])
+#define DMA2_Stream3		(&Sim_DMA2_Stream[3])
+#define DMA2_Stream4		(&Sim_DMA2_Stream[4])
+#define DMA2_Stream7		(&Sim_DMA2_Stream[7])
+#define TIM2				(&Sim_TIM2)
+#define TIM5				(&Sim_TIM5)
+#define TIM8				(&Sim_TIM8)
+#define RCC					(&Sim_RCC)
+
+#define RCC_AHB1ENR_DMA2EN	0x00400000U
+#define RCC_APB1ENR_TIM2EN	0x00000001U
+#define RCC_APB1ENR_TIM5EN	0x00000008U
+#define RCC_APB2ENR_TIM8EN	0x00000002U
+
+#define DMA_SxCR_EN			0x00000001U
+#define DMA_SxCR_TCIE		0x00000010U
+#define DMA_SxCR_DIR		0x000000C0U
+#define DMA_SxCR_DIR_0		0x00000040U
+#define DMA_SxCR_MINC		0x00000400U
+#define DMA_SxCR_PSIZE		0x00001800U
+#define DMA_SxCR_PSIZE_1	0x00001000U
+#define DMA_SxCR_MSIZE		0x00006000U
+#define DMA_SxCR_MSIZE_1	0x00004000U
+#define DMA_SxCR_PL			0x00030000U
+#define DMA_SxCR_CHSEL_Pos	25U
+#define DMA_SxCR_CHSEL		0x0E000000U
+
+/* The flags of streams 0/4, 1/5, 2/6 and 3/7 start at bits 0, 6, 16 and 22 */
+#define DMA_LIFCR_CFEIF2	0x00010000U
+#define DMA_LIFCR_CDMEIF2	0x00040000U
+#define DMA_LIFCR_CTEIF2	0x00080000U
+#define DMA_LIFCR_CHTIF2	0x00100000U
+#define DMA_LIFCR_CTCIF2	0x00200000U
+#define DMA_LIFCR_CFEIF3	0x00400000U
+#define DMA_LIFCR_CDMEIF3	0x01000000U
+#define DMA_LIFCR_CTEIF3	0x02000000U
+#define DMA_LIFCR_CHTIF3	0x04000000U
+#define DMA_LIFCR_CTCIF3	0x08000000U
+#define DMA_HIFCR_CFEIF4	0x00000001U
+#define DMA_HIFCR_CDMEIF4	0x00000004U
+#define DMA_HIFCR_CTEIF4	0x00000008U
+#define DMA_HIFCR_CHTIF4	0x00000010U
+#define DMA_HIFCR_CTCIF4	0x00000020U
+#define DMA_HIFCR_CFEIF7	0x00400000U
+#define DMA_HIFCR_CDMEIF7	0x01000000U
+#define DMA_HIFCR_CTEIF7	0x02000000U
+#define DMA_HIFCR_CHTIF7	0x04000000U
+#define DMA_HIFCR_CTCIF7	0x08000000U
+#define DMA_HISR_TCIF7		0x08000000U
+
+#define TIM_CR1_CEN			0x00000001U
+#define TIM_CR1_URS			0x00000004U
+#define TIM_CR1_OPM			0x00000008U
+#define TIM_CR2_MMS			0x00000070U
+#define TIM_CR2_MMS_2		0x00000040U
+#define TIM_SMCR_SMS		0x00000007U
+#define TIM_SMCR_SMS_0		0x00000001U
+#define TIM_SMCR_SMS_2		0x00000004U
+#define TIM_SMCR_TS			0x00000070U
+#define TIM_DIER_UIE		0x00000001U
+#define TIM_DIER_CC1DE		0x00000200U
+#define TIM_DIER_CC2DE		0x00000400U
+#define TIM_DIER_CC3DE		0x00000800U
+#define TIM_DIER_CC4DE		0x00001000U
+#define TIM_SR_UIF			0x00000001U
+#define TIM_EGR_UG			0x00000001U
+#define TIM_CCMR1_OC1M_Pos	4U
+#define TIM_CCMR1_OC1M_0	0x00000010U
+#define TIM_CCMR1_OC1M_1	0x00000020U
+#define TIM_CCMR1_OC1M_2	0x00000040U
+#define TIM_CCMR1_OC2M_Pos	12U
+#define TIM_CCMR1_OC2M_0	0x00001000U
+#define TIM_CCMR1_OC2M_1	0x00002000U
+#define TIM_CCMR1_OC2M_2	0x00004000U
+#define TIM_CCER_CC2E		0x00000010U
+
+#define GPIO_MODER_MODER1		0x0000000CU
+#define GPIO_MODER_MODER1_0		0x00000004U
+#define GPIO_MODER_MODER1_1		0x00000008U
+#define GPIO_AFRL_AFSEL1_Pos	4U
+#define GPIO_AFRL_AFSEL1		0x000000F0U
+
+typedef enum {
+	EXTI4_IRQn = 10,
+	TIM2_IRQn = 28,
+	DMA2_Stream7_IRQn = 70
+} IRQn_Type;
+
+extern uint8_t Sim_NVIC_Enabled[96];
+
+static inline void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub) {
+	(void) irq;
+	(void) preempt;
+	(void) sub;
+}
+
+static inline void HAL_NVIC_EnableIRQ(IRQn_Type irq) {
+	Sim_NVIC_Enabled[irq] = 1;
+}
+
+/* lcd_touch.h with USE_TOUCH_ARBITER names the ADC handles only */
+typedef struct __ADC_HandleTypeDef ADC_HandleTypeDef;
+
+static inline void HAL_Delay(uint32_t delay) {
+	(void) delay;
+}
+
+#define __GPIOA_CLK_ENABLE()
+#define __GPIOB_CLK_ENABLE()
+#define __GPIOC_CLK_ENABLE()
+#define __HAL_RCC_GPIOA_CLK_ENABLE()
+#define __HAL_RCC_GPIOB_CLK_ENABLE()
+#define __HAL_RCC_GPIOC_CLK_ENABLE()
+
+#endif /* __STM32F4XX_HAL_H */